@@ -0,0 +1,69 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file AcquisitionDigests.cpp
+* Contains the implementation of the acquisition hash lookup.
+*/
+
+#ifdef HAVE_LIBEWF
+#include <libewf.h>
+#endif
+
+// Module includes
+#include "AcquisitionDigests.h"
+
+#ifdef HAVE_LIBEWF
+
+bool readAcquisitionDigests(const std::vector<std::string>& imageNames, FileDigests& digests,
+    uint64_t& mediaSize)
+{
+    digests = FileDigests();
+    mediaSize = 0;
+    if (imageNames.empty())
+        return false;
+
+    libewf_error_t * error = NULL;
+    libewf_handle_t * handle = NULL;
+    if (libewf_handle_initialize(&handle, &error) != 1) {
+        libewf_error_free(&error);
+        return false;
+    }
+
+    std::vector<char *> names;
+    for (std::vector<std::string>::const_iterator it = imageNames.begin(); it != imageNames.end(); ++it)
+        names.push_back(const_cast<char *>(it->c_str()));
+
+    bool opened = libewf_handle_open(handle, &names[0], (int) names.size(), LIBEWF_OPEN_READ, &error) == 1;
+    if (opened) {
+        // Both functions return 0 if the image does not record the hash.
+        digests.hasMD5 = libewf_handle_get_md5_hash(handle, digests.md5, FileDigests::MD5_LENGTH, &error) == 1;
+        digests.hasSHA1 = libewf_handle_get_sha1_hash(handle, digests.sha1, FileDigests::SHA1_LENGTH, &error) == 1;
+        if (libewf_handle_get_media_size(handle, &mediaSize, &error) != 1)
+            mediaSize = 0;
+        libewf_handle_close(handle, &error);
+    }
+
+    libewf_handle_free(&handle, &error);
+    libewf_error_free(&error);
+    return opened;
+}
+
+#else
+
+bool readAcquisitionDigests(const std::vector<std::string>& imageNames, FileDigests& digests,
+    uint64_t& mediaSize)
+{
+    (void) imageNames;
+    digests = FileDigests();
+    mediaSize = 0;
+    return false;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file AcquisitionDigests.h
+* Contains the interface of the function that reads the acquisition hashes
+* stored in the metadata of an image.
+*/
+
+#ifndef _ACQUISITION_DIGESTS_H
+#define _ACQUISITION_DIGESTS_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+// Module includes
+#include "FileDigests.h"
+
+/**
+* Reads the MD5 and SHA-1 hashes recorded at acquisition time from the
+* metadata of an EWF (E01) image. Only available if the module is built
+* with HAVE_LIBEWF.
+*
+* @param imageNames Paths of all segment files of the image.
+* @param digests Receives the stored digests; only those that are present
+* in the image are flagged.
+* @param mediaSize Receives the size of the acquired media in bytes.
+* @returns false if the image cannot be opened with libewf or the module
+* is built without it.
+*/
+bool readAcquisitionDigests(const std::vector<std::string>& imageNames, FileDigests& digests,
+    uint64_t& mediaSize);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file AlignedBufferPool.cpp
+* Contains the implementation of the pool of aligned read buffers.
+*/
+
+// System includes
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Module includes
+#include "AlignedBufferPool.h"
+
+AlignedBufferPool::AlignedBufferPool(size_t bufferLength, size_t alignment)
+    : m_bufferLength(bufferLength), m_alignment(alignment)
+{
+}
+
+AlignedBufferPool::~AlignedBufferPool()
+{
+    for (std::vector<unsigned char *>::iterator it = m_allocated.begin(); it != m_allocated.end(); ++it) {
+#ifdef _WIN32
+        _aligned_free(*it);
+#else
+        free(*it);
+#endif
+    }
+}
+
+unsigned char * AlignedBufferPool::acquire()
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    if (!m_free.empty()) {
+        unsigned char * buffer = m_free.back();
+        m_free.pop_back();
+        return buffer;
+    }
+
+    void * buffer = NULL;
+#ifdef _WIN32
+    buffer = _aligned_malloc(m_bufferLength, m_alignment);
+#else
+    if (posix_memalign(&buffer, m_alignment, m_bufferLength) != 0)
+        buffer = NULL;
+#endif
+    if (buffer == NULL)
+        return NULL;
+
+    m_allocated.push_back((unsigned char *) buffer);
+    m_free.reserve(m_allocated.size());
+    return (unsigned char *) buffer;
+}
+
+void AlignedBufferPool::release(unsigned char * buffer)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+    m_free.push_back(buffer);
+}
@@ -0,0 +1,88 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file AlignedBufferPool.h
+* Contains the interface of the pool of aligned read buffers used for
+* direct (unbuffered) image reads.
+*/
+
+#ifndef _ALIGNED_BUFFER_POOL_H
+#define _ALIGNED_BUFFER_POOL_H
+
+// System includes
+#include <vector>
+#include <cstddef>
+
+// Poco includes
+#include "Poco/Mutex.h"
+
+/**
+* Hands out fixed-size buffers whose address is a multiple of a given
+* alignment. Buffers are allocated on first use and kept for reuse until
+* the pool is destroyed, so hashing many files does not allocate per file.
+*/
+class AlignedBufferPool
+{
+public:
+    /**
+    * @param bufferLength Length of each buffer; a multiple of alignment.
+    * @param alignment Alignment of the buffers; a power of two.
+    */
+    AlignedBufferPool(size_t bufferLength, size_t alignment);
+    ~AlignedBufferPool();
+
+    /**
+    * Takes a buffer from the pool, allocating a new one if all buffers are
+    * in use.
+    *
+    * @returns The buffer, or NULL if it cannot be allocated.
+    */
+    unsigned char * acquire();
+
+    /**
+    * Returns a buffer taken with acquire() to the pool.
+    */
+    void release(unsigned char * buffer);
+
+    size_t bufferLength() const { return m_bufferLength; }
+
+private:
+    AlignedBufferPool(const AlignedBufferPool&);
+    AlignedBufferPool& operator=(const AlignedBufferPool&);
+
+    size_t m_bufferLength;
+    size_t m_alignment;
+
+    // Every buffer allocated by the pool, and those not in use.
+    std::vector<unsigned char *> m_allocated;
+    std::vector<unsigned char *> m_free;
+    Poco::FastMutex m_lock;
+};
+
+/**
+* Holds a buffer of a pool for the lifetime of a scope.
+*/
+class PooledBuffer
+{
+public:
+    explicit PooledBuffer(AlignedBufferPool& pool) : m_pool(pool), m_buffer(pool.acquire()) {}
+    ~PooledBuffer() { if (m_buffer != NULL) m_pool.release(m_buffer); }
+
+    unsigned char * get() const { return m_buffer; }
+
+private:
+    PooledBuffer(const PooledBuffer&);
+    PooledBuffer& operator=(const PooledBuffer&);
+
+    AlignedBufferPool& m_pool;
+    unsigned char * m_buffer;
+};
+
+#endif
@@ -0,0 +1,776 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ArchiveStream.cpp
+* Contains the implementation of the streaming archive reader.
+*/
+
+// System includes
+#include <cstring>
+#include <cstdlib>
+
+// Module includes
+#include "ArchiveStream.h"
+
+namespace
+{
+    const size_t TAR_BLOCK = 512;
+    const size_t ZIP_LOCAL_HEADER = 30;
+
+    // Longest GNU long name or POSIX extended header accepted.
+    const uint64_t MAX_LONG_NAME = 65536;
+
+    const uint32_t ZIP_LOCAL_SIGNATURE = 0x04034b50;
+    const uint32_t ZIP_CENTRAL_SIGNATURE = 0x02014b50;
+    const uint32_t ZIP_END_SIGNATURE = 0x06054b50;
+    const uint32_t ZIP64_END_SIGNATURE = 0x06064b50;
+    const uint32_t ZIP_DESCRIPTOR_SIGNATURE = 0x08074b50;
+    const uint16_t ZIP64_EXTRA_ID = 0x0001;
+
+    const uint16_t ZIP_FLAG_ENCRYPTED = 0x0001;
+    const uint16_t ZIP_FLAG_DESCRIPTOR = 0x0008;
+    const uint16_t ZIP_METHOD_STORED = 0;
+    const uint16_t ZIP_METHOD_DEFLATED = 8;
+
+#ifdef HAVE_LIBZ
+    const size_t OUTPUT_SIZE = 65536;
+
+    // zlib counts input in 32 bits.
+    const size_t MAX_INFLATE_INPUT = 0x40000000;
+#endif
+
+    uint16_t le16(const unsigned char * p)
+    {
+        return (uint16_t) (p[0] | (p[1] << 8));
+    }
+
+    uint32_t le32(const unsigned char * p)
+    {
+        return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+    }
+
+    uint64_t le64(const unsigned char * p)
+    {
+        return (uint64_t) le32(p) | ((uint64_t) le32(p + 4) << 32);
+    }
+
+    /**
+    * Parses a numeric field of a TAR header: octal digits padded with
+    * spaces or nulls, or a base-256 number for values that do not fit.
+    */
+    bool tarNumber(const unsigned char * field, size_t length, uint64_t& value)
+    {
+        value = 0;
+        if (field[0] & 0x80) {
+            value = field[0] & 0x7f;
+            for (size_t i = 1; i < length; i++) {
+                if (value >> 56)
+                    return false;
+                value = (value << 8) | field[i];
+            }
+            return true;
+        }
+
+        size_t i = 0;
+        while (i < length && (field[i] == ' ' || field[i] == '\0'))
+            i++;
+        for (; i < length && field[i] >= '0' && field[i] <= '7'; i++)
+            value = value * 8 + (field[i] - '0');
+        for (; i < length; i++) {
+            if (field[i] != ' ' && field[i] != '\0')
+                return false;
+        }
+        return true;
+    }
+
+    /**
+    * Checks the checksum of a TAR header, the sum of its bytes with the
+    * checksum field taken as spaces.
+    */
+    bool tarChecksumValid(const unsigned char * header)
+    {
+        uint64_t stored;
+        if (!tarNumber(header + 148, 8, stored))
+            return false;
+
+        uint64_t sum = 0;
+        for (size_t i = 0; i < TAR_BLOCK; i++)
+            sum += (i >= 148 && i < 156) ? ' ' : header[i];
+        return sum == stored;
+    }
+
+    std::string tarString(const unsigned char * field, size_t length)
+    {
+        size_t n = 0;
+        while (n < length && field[n] != '\0')
+            n++;
+        return std::string((const char *) field, n);
+    }
+
+    /**
+    * Returns the path of a POSIX extended header, a sequence of
+    * "<length> <keyword>=<value>\n" records, or an empty string.
+    */
+    std::string paxPath(const std::string& records)
+    {
+        size_t position = 0;
+        while (position < records.size()) {
+            size_t length = (size_t) strtoul(records.c_str() + position, NULL, 10);
+            if (length == 0 || length > records.size() - position)
+                break;
+
+            std::string record = records.substr(position, length);
+            size_t keyword = record.find(' ');
+            if (keyword != std::string::npos && record.compare(keyword + 1, 5, "path=") == 0 &&
+                record[record.size() - 1] == '\n')
+                return record.substr(keyword + 6, record.size() - keyword - 7);
+            position += length;
+        }
+        return std::string();
+    }
+}
+
+ArchiveStream::Format ArchiveStream::detect(const unsigned char * head, size_t length)
+{
+#ifdef HAVE_LIBZ
+    if (length >= 4 && le32(head) == ZIP_LOCAL_SIGNATURE)
+        return FORMAT_ZIP;
+
+    // Deflate is the only compression method GZIP defines.
+    if (length >= 3 && head[0] == 0x1f && head[1] == 0x8b && head[2] == 8)
+        return FORMAT_GZIP;
+#endif
+
+    if (length >= DETECT_LENGTH && memcmp(head + 257, "ustar", 5) == 0)
+        return FORMAT_TAR;
+
+    return FORMAT_NONE;
+}
+
+ArchiveStream::ArchiveStream(ArchiveMemberListener& listener)
+    : m_listener(listener), m_format(FORMAT_NONE), m_state(STATE_DONE), m_failed(false),
+      m_inMember(false), m_skipped(0), m_headerLength(0), m_remaining(0), m_padding(0), m_paxHeader(false),
+      m_zipFlags(0), m_zipMethod(0), m_zip64(false)
+#ifdef HAVE_LIBZ
+      , m_zstreamReady(false), m_windowBits(0), m_output(OUTPUT_SIZE), m_gzipDetected(false),
+      m_gzipTar(false), m_gzipMembers(0), m_gzipComplete(false), m_gzipMemberOutput(0), m_inner(NULL)
+#endif
+{
+    m_header.reserve(TAR_BLOCK);
+}
+
+ArchiveStream::~ArchiveStream()
+{
+#ifdef HAVE_LIBZ
+    if (m_zstreamReady)
+        inflateEnd(&m_zstream);
+    delete m_inner;
+#endif
+}
+
+void ArchiveStream::begin(Format format)
+{
+    m_format = format;
+    m_failed = false;
+    m_inMember = false;
+    m_skipped = 0;
+    m_remaining = 0;
+    m_padding = 0;
+    m_longName.clear();
+    nextHeader();
+
+#ifdef HAVE_LIBZ
+    if (format == FORMAT_GZIP) {
+        m_gzipHead.clear();
+        m_gzipDetected = false;
+        m_gzipTar = false;
+        m_gzipMembers = 0;
+        m_gzipComplete = false;
+        m_gzipMemberOutput = 0;
+
+        if (!startInflate(16 + MAX_WBITS)) {
+            m_state = STATE_DONE;
+            m_failed = true;
+            return;
+        }
+
+        // Only the name of the first member is kept; the members of a
+        // concatenated stream are one file.
+        memset(&m_gzipHeader, 0, sizeof(m_gzipHeader));
+        memset(m_gzipName, 0, sizeof(m_gzipName));
+        m_gzipHeader.name = (Bytef *) m_gzipName;
+        m_gzipHeader.name_max = sizeof(m_gzipName) - 1;
+        inflateGetHeader(&m_zstream, &m_gzipHeader);
+        m_state = STATE_INFLATE;
+    }
+#else
+    if (format == FORMAT_ZIP || format == FORMAT_GZIP)
+        m_state = STATE_DONE;
+#endif
+
+    if (format == FORMAT_NONE)
+        m_state = STATE_DONE;
+}
+
+void ArchiveStream::update(const unsigned char * data, size_t length)
+{
+    while (length > 0 && m_state != STATE_DONE) {
+        size_t used;
+        if (m_format == FORMAT_TAR)
+            used = updateTar(data, length);
+#ifdef HAVE_LIBZ
+        else if (m_format == FORMAT_GZIP)
+            used = updateGzip(data, length);
+#endif
+        else
+            used = updateZip(data, length);
+
+        data += used;
+        length -= used;
+    }
+}
+
+void ArchiveStream::end()
+{
+    if (m_state == STATE_DONE)
+        return;
+
+#ifdef HAVE_LIBZ
+    if (m_format == FORMAT_GZIP) {
+        // The content is complete if the last member ended, or if only
+        // bytes that do not start another member followed.
+        finishGzip(m_gzipMembers > 0 && (m_gzipComplete || m_gzipMemberOutput == 0));
+        return;
+    }
+#endif
+
+    if (m_inMember) {
+        m_listener.endMember(false);
+        m_inMember = false;
+    }
+    m_state = STATE_DONE;
+}
+
+bool ArchiveStream::failed() const
+{
+#ifdef HAVE_LIBZ
+    if (m_gzipTar && m_inner->failed())
+        return true;
+#endif
+    return m_failed;
+}
+
+size_t ArchiveStream::skipped() const
+{
+#ifdef HAVE_LIBZ
+    if (m_gzipTar)
+        return m_skipped + m_inner->skipped();
+#endif
+    return m_skipped;
+}
+
+size_t ArchiveStream::collectHeader(const unsigned char * data, size_t length)
+{
+    size_t wanted = m_headerLength - m_header.size();
+    size_t n = length < wanted ? length : wanted;
+    m_header.insert(m_header.end(), data, data + n);
+    return n;
+}
+
+void ArchiveStream::nextHeader()
+{
+    m_header.clear();
+    m_headerLength = m_format == FORMAT_ZIP ? ZIP_LOCAL_HEADER : TAR_BLOCK;
+    m_state = STATE_HEADER;
+}
+
+void ArchiveStream::startSkip(uint64_t length)
+{
+    m_remaining = length;
+    m_state = STATE_SKIP;
+    if (length == 0)
+        endSkip();
+}
+
+void ArchiveStream::endSkip()
+{
+    if (m_format == FORMAT_ZIP)
+        endZipData();
+    else
+        nextHeader();
+}
+
+size_t ArchiveStream::copyMember(const unsigned char * data, size_t length)
+{
+    size_t n = m_remaining < length ? (size_t) m_remaining : length;
+    m_listener.memberData(data, n);
+    m_remaining -= n;
+
+    if (m_remaining == 0) {
+        m_listener.endMember(true);
+        m_inMember = false;
+        if (m_format == FORMAT_ZIP)
+            endZipData();
+        else
+            startSkip(m_padding);
+    }
+    return n;
+}
+
+void ArchiveStream::fail()
+{
+    m_failed = true;
+
+#ifdef HAVE_LIBZ
+    if (m_gzipTar)
+        m_inner->end();
+#endif
+
+    if (m_inMember) {
+        m_listener.endMember(false);
+        m_inMember = false;
+    }
+    m_state = STATE_DONE;
+}
+
+size_t ArchiveStream::updateTar(const unsigned char * data, size_t length)
+{
+    switch (m_state) {
+    case STATE_HEADER:
+        {
+            size_t used = collectHeader(data, length);
+            if (m_header.size() == m_headerLength)
+                parseTarHeader();
+            return used;
+        }
+
+    case STATE_DATA:
+        return copyMember(data, length);
+
+    case STATE_LONG_NAME:
+        {
+            size_t n = m_remaining < length ? (size_t) m_remaining : length;
+            m_longName.append((const char *) data, n);
+            m_remaining -= n;
+            if (m_remaining == 0) {
+                if (m_paxHeader)
+                    m_longName = paxPath(m_longName);
+                else
+                    m_longName.resize(strlen(m_longName.c_str()));
+                startSkip(m_padding);
+            }
+            return n;
+        }
+
+    case STATE_SKIP:
+        {
+            size_t n = m_remaining < length ? (size_t) m_remaining : length;
+            m_remaining -= n;
+            if (m_remaining == 0)
+                endSkip();
+            return n;
+        }
+
+    default:
+        fail();
+        return length;
+    }
+}
+
+void ArchiveStream::parseTarHeader()
+{
+    const unsigned char * header = &m_header[0];
+
+    // The archive ends with blocks of zeros.
+    size_t i = 0;
+    while (i < TAR_BLOCK && header[i] == 0)
+        i++;
+    if (i == TAR_BLOCK) {
+        m_state = STATE_DONE;
+        return;
+    }
+
+    uint64_t size;
+    if (!tarChecksumValid(header) || !tarNumber(header + 124, 12, size)) {
+        fail();
+        return;
+    }
+    m_padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+
+    // A GNU long name entry or a POSIX extended header holds the name of
+    // the entry that follows.
+    char type = (char) header[156];
+    if (type == 'L' || type == 'x') {
+        if (size > MAX_LONG_NAME) {
+            fail();
+            return;
+        }
+        m_longName.clear();
+        m_paxHeader = type == 'x';
+        m_remaining = size;
+        m_state = STATE_LONG_NAME;
+        if (size == 0)
+            startSkip(m_padding);
+        return;
+    }
+
+    std::string name;
+    name.swap(m_longName);
+    if (name.empty()) {
+        name = tarString(header, 100);
+        if (memcmp(header + 257, "ustar", 5) == 0) {
+            std::string prefix = tarString(header + 345, 155);
+            if (!prefix.empty())
+                name = prefix + "/" + name;
+        }
+    }
+
+    // Directories, links, devices and extended headers have no content
+    // of their own to hash.
+    if (type != '0' && type != '\0' && type != '7') {
+        startSkip(size + m_padding);
+        return;
+    }
+
+    m_listener.beginMember(name);
+    m_inMember = true;
+    m_remaining = size;
+    m_state = STATE_DATA;
+    if (size == 0) {
+        m_listener.endMember(true);
+        m_inMember = false;
+        startSkip(m_padding);
+    }
+}
+
+size_t ArchiveStream::updateZip(const unsigned char * data, size_t length)
+{
+    switch (m_state) {
+    case STATE_HEADER:
+        {
+            size_t used = collectHeader(data, length);
+            if (m_header.size() == m_headerLength)
+                parseZipHeader();
+            return used;
+        }
+
+    case STATE_NAME:
+        {
+            size_t used = collectHeader(data, length);
+            if (m_header.size() == m_headerLength)
+                parseZipName();
+            return used;
+        }
+
+    case STATE_DATA:
+        return copyMember(data, length);
+
+#ifdef HAVE_LIBZ
+    case STATE_INFLATE:
+        {
+            size_t used = 0;
+            int ret = inflateContent(data, length, used);
+            if (ret == Z_STREAM_END) {
+                m_listener.endMember(true);
+                m_inMember = false;
+                endZipData();
+                return used;
+            }
+            if ((ret != Z_OK && ret != Z_BUF_ERROR) || used == 0) {
+                fail();
+                return length;
+            }
+            return used;
+        }
+#endif
+
+    case STATE_DESCRIPTOR:
+        {
+            size_t used = collectHeader(data, length);
+            if (m_header.size() == m_headerLength)
+                parseZipDescriptor();
+            return used;
+        }
+
+    case STATE_SKIP:
+        {
+            size_t n = m_remaining < length ? (size_t) m_remaining : length;
+            m_remaining -= n;
+            if (m_remaining == 0)
+                endSkip();
+            return n;
+        }
+
+    default:
+        fail();
+        return length;
+    }
+}
+
+void ArchiveStream::parseZipHeader()
+{
+    const unsigned char * header = &m_header[0];
+
+    // The members are followed by the central directory, which only
+    // repeats what the local headers said.
+    uint32_t signature = le32(header);
+    if (signature == ZIP_CENTRAL_SIGNATURE || signature == ZIP_END_SIGNATURE ||
+        signature == ZIP64_END_SIGNATURE) {
+        m_state = STATE_DONE;
+        return;
+    }
+    if (signature != ZIP_LOCAL_SIGNATURE) {
+        fail();
+        return;
+    }
+
+    m_headerLength = ZIP_LOCAL_HEADER + le16(header + 26) + le16(header + 28);
+    m_state = STATE_NAME;
+    if (m_header.size() == m_headerLength)
+        parseZipName();
+}
+
+void ArchiveStream::parseZipName()
+{
+    const unsigned char * header = &m_header[0];
+    uint16_t nameLength = le16(header + 26);
+    uint16_t extraLength = le16(header + 28);
+    uint32_t compressedSize = le32(header + 18);
+    uint32_t size = le32(header + 22);
+
+    m_zipFlags = le16(header + 6);
+    m_zipMethod = le16(header + 8);
+    m_remaining = compressedSize;
+    m_zip64 = false;
+
+    // The ZIP64 extra field holds the 64 bit sizes of the fields that are
+    // all ones, the uncompressed size first.
+    const unsigned char * extra = header + ZIP_LOCAL_HEADER + nameLength;
+    const unsigned char * extraEnd = extra + extraLength;
+    while (extraEnd - extra >= 4) {
+        uint16_t id = le16(extra);
+        const unsigned char * field = extra + 4;
+        const unsigned char * fieldEnd = field + le16(extra + 2);
+        if (fieldEnd > extraEnd)
+            break;
+
+        if (id == ZIP64_EXTRA_ID) {
+            m_zip64 = true;
+            if (size == 0xffffffff && fieldEnd - field >= 8)
+                field += 8;
+            if (compressedSize == 0xffffffff && fieldEnd - field >= 8)
+                m_remaining = le64(field);
+        }
+        extra = fieldEnd;
+    }
+
+    std::string name((const char *) header + ZIP_LOCAL_HEADER, nameLength);
+    bool directory = !name.empty() && name[name.size() - 1] == '/';
+    bool encrypted = (m_zipFlags & ZIP_FLAG_ENCRYPTED) != 0;
+    bool deflated = m_zipMethod == ZIP_METHOD_DEFLATED;
+
+    // Without a compressed size in the local header only deflated content
+    // can be followed, since it marks its own end.
+    if ((m_zipFlags & ZIP_FLAG_DESCRIPTOR) && m_remaining == 0 && (directory || encrypted || !deflated)) {
+        fail();
+        return;
+    }
+
+    if (directory || encrypted || (m_zipMethod != ZIP_METHOD_STORED && !deflated)) {
+        if (!directory)
+            m_skipped++;
+        startSkip(m_remaining);
+        return;
+    }
+
+#ifdef HAVE_LIBZ
+    if (deflated) {
+        if (!startInflate(-MAX_WBITS)) {
+            fail();
+            return;
+        }
+        m_listener.beginMember(name);
+        m_inMember = true;
+        m_state = STATE_INFLATE;
+        return;
+    }
+#endif
+
+    m_listener.beginMember(name);
+    m_inMember = true;
+    m_state = STATE_DATA;
+    if (m_remaining == 0) {
+        m_listener.endMember(true);
+        m_inMember = false;
+        endZipData();
+    }
+}
+
+void ArchiveStream::endZipData()
+{
+    if (!(m_zipFlags & ZIP_FLAG_DESCRIPTOR)) {
+        nextHeader();
+        return;
+    }
+
+    // The data descriptor starts with an optional signature; its first
+    // four bytes tell how long it is.
+    m_header.clear();
+    m_headerLength = 4;
+    m_state = STATE_DESCRIPTOR;
+}
+
+void ArchiveStream::parseZipDescriptor()
+{
+    if (m_headerLength == 4) {
+        // CRC-32 and the two sizes follow the signature; without one the
+        // CRC-32 has just been read.
+        m_headerLength += m_zip64 ? 16 : 8;
+        if (le32(&m_header[0]) == ZIP_DESCRIPTOR_SIGNATURE)
+            m_headerLength += 4;
+        return;
+    }
+    nextHeader();
+}
+
+#ifdef HAVE_LIBZ
+
+bool ArchiveStream::startInflate(int windowBits)
+{
+    if (m_zstreamReady && m_windowBits == windowBits)
+        return inflateReset(&m_zstream) == Z_OK;
+
+    if (m_zstreamReady)
+        inflateEnd(&m_zstream);
+    memset(&m_zstream, 0, sizeof(m_zstream));
+    m_zstreamReady = inflateInit2(&m_zstream, windowBits) == Z_OK;
+    m_windowBits = windowBits;
+    return m_zstreamReady;
+}
+
+int ArchiveStream::inflateContent(const unsigned char * data, size_t length, size_t& used)
+{
+    if (length > MAX_INFLATE_INPUT)
+        length = MAX_INFLATE_INPUT;
+
+    m_zstream.next_in = const_cast<Bytef *>(data);
+    m_zstream.avail_in = (uInt) length;
+
+    int ret;
+    do {
+        m_zstream.next_out = &m_output[0];
+        m_zstream.avail_out = (uInt) m_output.size();
+        ret = inflate(&m_zstream, Z_NO_FLUSH);
+
+        size_t produced = m_output.size() - m_zstream.avail_out;
+        if (produced > 0) {
+            if (m_format == FORMAT_GZIP)
+                gzipOutput(&m_output[0], produced);
+            else
+                m_listener.memberData(&m_output[0], produced);
+        }
+    } while (ret == Z_OK && (m_zstream.avail_in > 0 || m_zstream.avail_out == 0));
+
+    used = length - m_zstream.avail_in;
+    return ret;
+}
+
+size_t ArchiveStream::updateGzip(const unsigned char * data, size_t length)
+{
+    // More content after the end of a member is the next member of a
+    // concatenated stream.
+    if (m_gzipComplete) {
+        inflateReset(&m_zstream);
+        m_gzipComplete = false;
+        m_gzipMemberOutput = 0;
+    }
+
+    size_t used = 0;
+    int ret = inflateContent(data, length, used);
+    if (ret == Z_STREAM_END) {
+        m_gzipMembers++;
+        m_gzipComplete = true;
+        return used;
+    }
+
+    if ((ret != Z_OK && ret != Z_BUF_ERROR) || used == 0) {
+        // Archivers pad streams with zeros; what follows the last member
+        // without producing content is ignored.
+        if (m_gzipMembers > 0 && m_gzipMemberOutput == 0)
+            finishGzip(true);
+        else
+            fail();
+        return length;
+    }
+    return used;
+}
+
+void ArchiveStream::gzipOutput(const unsigned char * data, size_t length)
+{
+    m_gzipMemberOutput += length;
+
+    if (!m_gzipDetected) {
+        size_t wanted = TAR_BLOCK - m_gzipHead.size();
+        size_t n = length < wanted ? length : wanted;
+        m_gzipHead.insert(m_gzipHead.end(), data, data + n);
+        data += n;
+        length -= n;
+        if (m_gzipHead.size() < TAR_BLOCK)
+            return;
+        startGzipContent();
+    }
+
+    if (length == 0)
+        return;
+
+    if (m_gzipTar)
+        m_inner->update(data, length);
+    else
+        m_listener.memberData(data, length);
+}
+
+void ArchiveStream::startGzipContent()
+{
+    m_gzipDetected = true;
+
+    const unsigned char * head = m_gzipHead.empty() ? NULL : &m_gzipHead[0];
+    m_gzipTar = m_gzipHead.size() == TAR_BLOCK && memcmp(head + 257, "ustar", 5) == 0 &&
+        tarChecksumValid(head);
+
+    if (m_gzipTar) {
+        if (m_inner == NULL)
+            m_inner = new ArchiveStream(m_listener);
+        m_inner->begin(FORMAT_TAR);
+        m_inner->update(head, m_gzipHead.size());
+        return;
+    }
+
+    m_listener.beginMember(m_gzipHeader.done == 1 ? std::string(m_gzipName) : std::string());
+    m_inMember = true;
+    if (head != NULL)
+        m_listener.memberData(head, m_gzipHead.size());
+}
+
+void ArchiveStream::finishGzip(bool complete)
+{
+    if (!m_gzipDetected)
+        startGzipContent();
+
+    if (m_gzipTar) {
+        m_inner->end();
+    }
+    else if (m_inMember) {
+        m_listener.endMember(complete);
+        m_inMember = false;
+    }
+    m_state = STATE_DONE;
+}
+
+#endif
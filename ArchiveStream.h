@@ -0,0 +1,220 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ArchiveStream.h
+* Contains the interface of the streaming reader that extracts the members
+* of ZIP, GZIP and TAR content as it is passed in, without a seekable file
+* and without writing the members anywhere.
+*/
+
+#ifndef _ARCHIVE_STREAM_H
+#define _ARCHIVE_STREAM_H
+
+// System includes
+#include <string>
+#include <vector>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* Receives the members of an archive, in the order they are stored.
+*/
+class ArchiveMemberListener
+{
+public:
+    virtual ~ArchiveMemberListener() {}
+
+    /**
+    * Called at the start of each regular file member.
+    *
+    * @param name Path of the member in the archive. Empty for the content
+    * of a GZIP stream that does not record the original file name.
+    */
+    virtual void beginMember(const std::string& name) = 0;
+
+    /**
+    * Called with the content of the current member, in order.
+    */
+    virtual void memberData(const unsigned char * data, size_t length) = 0;
+
+    /**
+    * Called at the end of the current member.
+    *
+    * @param complete false if the archive ended or turned out to be
+    * corrupt before all content of the member was read.
+    */
+    virtual void endMember(bool complete) = 0;
+};
+
+/**
+* Extracts the members of an archive from its content given in order, in
+* chunks of any size. Only the members are reported; directories, links
+* and members that are encrypted or use an unsupported compression method
+* are skipped. A TAR archive inside a GZIP stream is extracted as well.
+* ZIP and GZIP need a build with HAVE_LIBZ.
+*/
+class ArchiveStream
+{
+public:
+    enum Format
+    {
+        FORMAT_NONE,
+        FORMAT_ZIP,
+        FORMAT_GZIP,
+        FORMAT_TAR
+    };
+
+    /// Number of bytes at the start of content that detect() looks at.
+    static const size_t DETECT_LENGTH = 262;
+
+    /**
+    * Recognizes a supported archive from the start of its content.
+    *
+    * @param head The first bytes of the content, up to DETECT_LENGTH.
+    * @param length Number of bytes in head; less than DETECT_LENGTH only
+    * if the content is shorter.
+    */
+    static Format detect(const unsigned char * head, size_t length);
+
+    explicit ArchiveStream(ArchiveMemberListener& listener);
+    ~ArchiveStream();
+
+    /**
+    * Starts reading an archive of the given format; keeps the buffers.
+    */
+    void begin(Format format);
+
+    /**
+    * Extracts members from the next part of the archive.
+    */
+    void update(const unsigned char * data, size_t length);
+
+    /**
+    * Ends the archive; a member that is still open is ended incomplete.
+    */
+    void end();
+
+    /**
+    * @returns true if the archive turned out to be corrupt or uses a
+    * layout the stream cannot follow. The rest of the content was ignored.
+    */
+    bool failed() const;
+
+    /**
+    * @returns The number of members skipped because they are encrypted or
+    * compressed with an unsupported method.
+    */
+    size_t skipped() const;
+
+private:
+    ArchiveStream(const ArchiveStream&);
+    ArchiveStream& operator=(const ArchiveStream&);
+
+    enum State
+    {
+        STATE_HEADER,
+        STATE_NAME,
+        STATE_DATA,
+        STATE_INFLATE,
+        STATE_DESCRIPTOR,
+        STATE_LONG_NAME,
+        STATE_SKIP,
+        STATE_DONE
+    };
+
+    // Parsers of the container layouts. Each consumes what it can of the
+    // data up to the end of the current header or content and returns the
+    // number of bytes used, changing the state where that part ends.
+    size_t updateTar(const unsigned char * data, size_t length);
+    size_t updateZip(const unsigned char * data, size_t length);
+
+    // Collects header bytes until m_header holds m_headerLength of them.
+    size_t collectHeader(const unsigned char * data, size_t length);
+    void nextHeader();
+
+    // Skips content that is not hashed, then continues after it.
+    void startSkip(uint64_t length);
+    void endSkip();
+
+    // Passes stored member content to the listener.
+    size_t copyMember(const unsigned char * data, size_t length);
+
+    void parseTarHeader();
+    void parseZipHeader();
+    void parseZipName();
+    void endZipData();
+    void parseZipDescriptor();
+
+    // Ends the current member, if any, and ignores the rest of the content.
+    void fail();
+
+#ifdef HAVE_LIBZ
+    bool startInflate(int windowBits);
+
+    // Decompresses deflated content; the output goes to the member or, for
+    // GZIP, to gzipOutput(). Returns the zlib status.
+    int inflateContent(const unsigned char * data, size_t length, size_t& used);
+
+    size_t updateGzip(const unsigned char * data, size_t length);
+    void gzipOutput(const unsigned char * data, size_t length);
+    void startGzipContent();
+    void finishGzip(bool complete);
+#endif
+
+    ArchiveMemberListener& m_listener;
+    Format m_format;
+    State m_state;
+    bool m_failed;
+    bool m_inMember;
+    size_t m_skipped;
+
+    std::vector<unsigned char> m_header;
+    size_t m_headerLength;
+    uint64_t m_remaining;
+    uint64_t m_padding;
+    // Name of the next TAR entry, from a GNU long name or POSIX extended
+    // header.
+    std::string m_longName;
+    bool m_paxHeader;
+
+    // ZIP member being read.
+    uint16_t m_zipFlags;
+    uint16_t m_zipMethod;
+    bool m_zip64;
+
+#ifdef HAVE_LIBZ
+    z_stream m_zstream;
+    bool m_zstreamReady;
+    int m_windowBits;
+    std::vector<unsigned char> m_output;
+
+    gz_header m_gzipHeader;
+    char m_gzipName[256];
+
+    // Decompressed GZIP content is collected until it is known whether it
+    // is a TAR archive, which the inner stream then extracts.
+    std::vector<unsigned char> m_gzipHead;
+    bool m_gzipDetected;
+    bool m_gzipTar;
+    // Members of the stream that ended, whether the last one did, and the
+    // content of the current one.
+    unsigned int m_gzipMembers;
+    bool m_gzipComplete;
+    uint64_t m_gzipMemberOutput;
+    ArchiveStream * m_inner;
+#endif
+};
+
+#endif
@@ -0,0 +1,335 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file BatchReader.cpp
+* Contains the io_uring and thread pool implementations of the batch read
+* engine.
+*/
+
+// System includes
+#include <utility>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <sys/uio.h>
+#include <errno.h>
+#endif
+
+// Poco includes
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+#include "Poco/Mutex.h"
+#include "Poco/Condition.h"
+
+// Module includes
+#include "BatchReader.h"
+
+namespace
+{
+    /**
+    * Reads with a pool of threads, each doing blocking positional reads, so
+    * that up to one read per thread is queued at the device.
+    */
+    class ThreadPoolBatchReader : public BatchReader, public Poco::Runnable
+    {
+    public:
+        ThreadPoolBatchReader(RawImage& image, size_t threadCount)
+            : m_image(image), m_requests(NULL), m_next(0), m_stopping(false),
+              m_threads(threadCount)
+        {
+            for (size_t i = 0; i < m_threads.size(); i++) {
+                m_threads[i] = new Poco::Thread("BatchReader");
+                m_threads[i]->start(*this);
+            }
+        }
+
+        virtual ~ThreadPoolBatchReader()
+        {
+            {
+                Poco::FastMutex::ScopedLock guard(m_lock);
+                m_stopping = true;
+                m_work.broadcast();
+            }
+            for (size_t i = 0; i < m_threads.size(); i++) {
+                m_threads[i]->join();
+                delete m_threads[i];
+            }
+        }
+
+        virtual const char * name() const
+        {
+            return "thread pool";
+        }
+
+        virtual void readAll(const std::vector<BatchReadRequest>& requests, BatchReadListener& listener)
+        {
+            std::vector<std::pair<size_t, bool> > ready;
+
+            m_lock.lock();
+            m_requests = &requests;
+            m_next = 0;
+            m_completed.clear();
+            m_work.broadcast();
+
+            size_t reported = 0;
+            while (reported < requests.size()) {
+                while (m_completed.empty())
+                    m_done.wait(m_lock);
+                ready.swap(m_completed);
+
+                // Let the workers continue while the completions are
+                // handed to the listener.
+                m_lock.unlock();
+                for (size_t i = 0; i < ready.size(); i++)
+                    listener.readCompleted(requests[ready[i].first], ready[i].second);
+                reported += ready.size();
+                ready.clear();
+                m_lock.lock();
+            }
+
+            m_requests = NULL;
+            m_lock.unlock();
+        }
+
+        virtual void run()
+        {
+            m_lock.lock();
+            while (true) {
+                while (!m_stopping && (m_requests == NULL || m_next >= m_requests->size()))
+                    m_work.wait(m_lock);
+                if (m_stopping)
+                    break;
+
+                size_t index = m_next++;
+                BatchReadRequest request = (*m_requests)[index];
+
+                m_lock.unlock();
+                bool success = m_image.read(request.offset, request.buffer, request.length);
+                m_lock.lock();
+
+                m_completed.push_back(std::make_pair(index, success));
+                m_done.signal();
+            }
+            m_lock.unlock();
+        }
+
+    private:
+        RawImage& m_image;
+
+        const std::vector<BatchReadRequest> * m_requests;
+        size_t m_next;
+        std::vector<std::pair<size_t, bool> > m_completed;
+        bool m_stopping;
+
+        std::vector<Poco::Thread *> m_threads;
+        Poco::FastMutex m_lock;
+        Poco::Condition m_work;
+        Poco::Condition m_done;
+    };
+
+#ifdef HAVE_LIBURING
+    /**
+    * Reads through an io_uring submission queue, keeping up to the queue
+    * depth of reads in flight from a single thread. The buffer area is
+    * registered with the kernel so that reads do not have to map the
+    * destination pages each time.
+    */
+    class UringBatchReader : public BatchReader
+    {
+    public:
+        UringBatchReader(int fd, unsigned int depth)
+            : m_fd(fd), m_depth(depth), m_buffers(NULL), m_bufferLength(0),
+              m_initialized(false), m_fixed(false)
+        {
+        }
+
+        virtual ~UringBatchReader()
+        {
+            if (m_initialized)
+                io_uring_queue_exit(&m_ring);
+        }
+
+        bool init(unsigned char * buffers, size_t bufferLength)
+        {
+            m_buffers = buffers;
+            m_bufferLength = bufferLength;
+            if (io_uring_queue_init(m_depth, &m_ring, 0) < 0)
+                return false;
+            m_initialized = true;
+
+            // Registration fails if the buffer area exceeds RLIMIT_MEMLOCK;
+            // plain reads still work in that case.
+            struct iovec iov;
+            iov.iov_base = buffers;
+            iov.iov_len = bufferLength;
+            m_fixed = io_uring_register_buffers(&m_ring, &iov, 1) == 0;
+            return true;
+        }
+
+        virtual const char * name() const
+        {
+            return m_fixed ? "io_uring (registered buffers)" : "io_uring";
+        }
+
+        virtual void readAll(const std::vector<BatchReadRequest>& requests, BatchReadListener& listener)
+        {
+            size_t next = 0;
+            size_t inFlight = 0;
+            size_t completed = 0;
+            std::vector<bool> done(requests.size(), false);
+
+            // The ring could not be recreated after an earlier error.
+            if (!m_initialized) {
+                failRemaining(requests, done, listener);
+                return;
+            }
+
+            while (completed < requests.size()) {
+                // Fill the submission queue.
+                while (next < requests.size() && inFlight < m_depth) {
+                    struct io_uring_sqe * sqe = io_uring_get_sqe(&m_ring);
+                    if (sqe == NULL)
+                        break;
+
+                    const BatchReadRequest& request = requests[next];
+                    if (m_fixed)
+                        io_uring_prep_read_fixed(sqe, m_fd, request.buffer, request.length, request.offset, 0);
+                    else
+                        io_uring_prep_read(sqe, m_fd, request.buffer, request.length, request.offset);
+                    io_uring_sqe_set_data(sqe, (void *) &request);
+                    next++;
+                    inFlight++;
+                }
+
+                int ret = io_uring_submit_and_wait(&m_ring, 1);
+                if (ret < 0 && ret != -EINTR) {
+                    // Reads the kernel accepted still complete into the
+                    // buffers of this batch and carry pointers into its
+                    // requests, so they are waited for here rather than
+                    // taken for completions of the next batch. Reads that
+                    // were prepared but not submitted would go out with the
+                    // next batch; the ring is recreated without them.
+                    drainCompletions(requests, done, listener, inFlight - io_uring_sq_ready(&m_ring));
+                    recreateRing();
+                    failRemaining(requests, done, listener);
+                    return;
+                }
+
+                // Hand every available completion to the listener while the
+                // remaining reads proceed in the kernel.
+                unsigned int count = reapCompletions(requests, done, listener);
+                inFlight -= count;
+                completed += count;
+            }
+        }
+
+    private:
+        /**
+        * Hands every available completion to the listener.
+        *
+        * @returns The number of completions.
+        */
+        unsigned int reapCompletions(const std::vector<BatchReadRequest>& requests, std::vector<bool>& done,
+            BatchReadListener& listener)
+        {
+            struct io_uring_cqe * cqe;
+            unsigned int head;
+            unsigned int count = 0;
+            io_uring_for_each_cqe(&m_ring, head, cqe) {
+                const BatchReadRequest * request = (const BatchReadRequest *) io_uring_cqe_get_data(cqe);
+                done[request - &requests[0]] = true;
+                listener.readCompleted(*request, cqe->res == (int) request->length);
+                count++;
+            }
+            io_uring_cq_advance(&m_ring, count);
+            return count;
+        }
+
+        /**
+        * Waits for the given number of submitted reads to complete and
+        * hands them to the listener.
+        */
+        void drainCompletions(const std::vector<BatchReadRequest>& requests, std::vector<bool>& done,
+            BatchReadListener& listener, size_t pending)
+        {
+            while (pending > 0) {
+                struct io_uring_cqe * cqe;
+                int ret = io_uring_wait_cqe(&m_ring, &cqe);
+                if (ret == -EINTR)
+                    continue;
+                if (ret < 0)
+                    break;
+
+                unsigned int count = reapCompletions(requests, done, listener);
+                pending = count < pending ? pending - count : 0;
+            }
+        }
+
+        /**
+        * Replaces the ring by a new one with no queued reads. If that fails
+        * the reader reports every later read as failed, and files are read
+        * one by one instead.
+        */
+        void recreateRing()
+        {
+            io_uring_queue_exit(&m_ring);
+            m_initialized = false;
+            m_fixed = false;
+            init(m_buffers, m_bufferLength);
+        }
+
+        /**
+        * Reports every request that has not completed as failed.
+        */
+        void failRemaining(const std::vector<BatchReadRequest>& requests, std::vector<bool>& done,
+            BatchReadListener& listener)
+        {
+            for (size_t i = 0; i < requests.size(); i++) {
+                if (!done[i]) {
+                    done[i] = true;
+                    listener.readCompleted(requests[i], false);
+                }
+            }
+        }
+
+        int m_fd;
+        unsigned int m_depth;
+        unsigned char * m_buffers;
+        size_t m_bufferLength;
+        struct io_uring m_ring;
+        bool m_initialized;
+        bool m_fixed;
+    };
+#endif
+}
+
+BatchReader * BatchReader::create(RawImage& image, bool preferUring, size_t depth,
+    unsigned char * buffers, size_t bufferLength)
+{
+    if (depth == 0)
+        depth = 1;
+
+#ifdef HAVE_LIBURING
+    if (preferUring) {
+        UringBatchReader * reader = new UringBatchReader(image.descriptor(), (unsigned int) depth);
+        if (reader->init(buffers, bufferLength))
+            return reader;
+        delete reader;
+    }
+#else
+    (void) preferUring;
+    (void) buffers;
+    (void) bufferLength;
+#endif
+
+    // More threads than this only add contention.
+    static const size_t MAX_THREADS = 64;
+    return new ThreadPoolBatchReader(image, depth < MAX_THREADS ? depth : MAX_THREADS);
+}
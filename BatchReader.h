@@ -0,0 +1,94 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file BatchReader.h
+* Contains the interface of the read engines that issue many image reads at
+* once so that small files do not each pay a full device round trip.
+*/
+
+#ifndef _BATCH_READER_H
+#define _BATCH_READER_H
+
+// System includes
+#include <vector>
+
+// Module includes
+#include "RawImage.h"
+
+/**
+* One read of a batch.
+*/
+struct BatchReadRequest
+{
+    /// Byte offset in the image.
+    uint64_t offset;
+    /// Number of bytes to read.
+    uint32_t length;
+    /// Destination; must lie inside the buffer area given to the reader.
+    unsigned char * buffer;
+    /// Caller defined value identifying what the read belongs to.
+    size_t tag;
+};
+
+/**
+* Receives the completions of a batch.
+*/
+class BatchReadListener
+{
+public:
+    virtual ~BatchReadListener() {}
+
+    /**
+    * Called on the thread that issued the batch, once per request, in
+    * completion order.
+    *
+    * @param request The completed request.
+    * @param success false if the request could not be read completely.
+    */
+    virtual void readCompleted(const BatchReadRequest& request, bool success) = 0;
+};
+
+/**
+* Issues a batch of reads against a raw image with many reads in flight.
+*/
+class BatchReader
+{
+public:
+    /**
+    * Creates the best available reader: io_uring if the module was built
+    * with HAVE_LIBURING and the kernel supports it, otherwise a pool of
+    * threads doing positional reads.
+    *
+    * @param image The image to read from. Must stay open while the reader
+    * exists.
+    * @param preferUring false to always use the thread pool.
+    * @param depth Maximum number of reads in flight.
+    * @param buffers Start of the memory all requests read into. io_uring
+    * registers it with the kernel once.
+    * @param bufferLength Length of the buffer area in bytes.
+    */
+    static BatchReader * create(RawImage& image, bool preferUring, size_t depth,
+        unsigned char * buffers, size_t bufferLength);
+
+    virtual ~BatchReader() {}
+
+    /**
+    * @returns A short name of the engine for log messages.
+    */
+    virtual const char * name() const = 0;
+
+    /**
+    * Reads every request of a batch and reports each completion to the
+    * listener. Returns when all requests have completed.
+    */
+    virtual void readAll(const std::vector<BatchReadRequest>& requests, BatchReadListener& listener) = 0;
+};
+
+#endif
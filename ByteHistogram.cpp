@@ -0,0 +1,112 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ByteHistogram.cpp
+* Contains the implementation of the byte histogram.
+*/
+
+// System includes
+#include <cstring>
+#include <cmath>
+
+// Module includes
+#include "ByteHistogram.h"
+
+// No lane counts more than the bytes counted since the last fold, so the
+// lanes are folded before that reaches the range of their counters.
+static const uint64_t MAX_UNFOLDED = 0xffffffff;
+
+ByteHistogram::ByteHistogram()
+{
+    reset();
+}
+
+void ByteHistogram::reset()
+{
+    memset(m_lanes, 0, sizeof(m_lanes));
+    memset(m_counts, 0, sizeof(m_counts));
+    m_unfolded = 0;
+}
+
+void ByteHistogram::update(const unsigned char * data, size_t length)
+{
+    while (length > 0) {
+        size_t chunk = length < MAX_UNFOLDED ? length : (size_t) MAX_UNFOLDED;
+        if (m_unfolded + chunk > MAX_UNFOLDED)
+            fold();
+
+        count(data, chunk);
+        m_unfolded += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void ByteHistogram::count(const unsigned char * data, size_t length)
+{
+    // Eight bytes are loaded at once and spread over the lanes; the byte
+    // order of the load does not matter for the counts.
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        m_lanes[0][word & 0xff]++;
+        m_lanes[1][(word >> 8) & 0xff]++;
+        m_lanes[2][(word >> 16) & 0xff]++;
+        m_lanes[3][(word >> 24) & 0xff]++;
+        m_lanes[0][(word >> 32) & 0xff]++;
+        m_lanes[1][(word >> 40) & 0xff]++;
+        m_lanes[2][(word >> 48) & 0xff]++;
+        m_lanes[3][word >> 56]++;
+        data += 8;
+        length -= 8;
+    }
+
+    while (length > 0) {
+        m_lanes[0][*data++]++;
+        length--;
+    }
+}
+
+void ByteHistogram::fold()
+{
+    for (size_t lane = 0; lane < LANES; lane++) {
+        for (size_t value = 0; value < 256; value++)
+            m_counts[value] += m_lanes[lane][value];
+    }
+    memset(m_lanes, 0, sizeof(m_lanes));
+    m_unfolded = 0;
+}
+
+void ByteHistogram::final(double& entropy, double& chiSquare, double& zeroRatio)
+{
+    fold();
+
+    uint64_t total = 0;
+    for (size_t value = 0; value < 256; value++)
+        total += m_counts[value];
+
+    entropy = 0;
+    chiSquare = 0;
+    zeroRatio = 0;
+    if (total == 0)
+        return;
+
+    const double expected = (double) total / 256;
+    for (size_t value = 0; value < 256; value++) {
+        double count = (double) m_counts[value];
+        if (count > 0) {
+            double p = count / total;
+            entropy -= p * log(p);
+        }
+        chiSquare += (count - expected) * (count - expected) / expected;
+    }
+    entropy /= log(2.0);
+    zeroRatio = (double) m_counts[0] / total;
+}
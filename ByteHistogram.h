@@ -0,0 +1,68 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ByteHistogram.h
+* Contains the interface of the byte histogram that gives the entropy,
+* chi-square and zero byte ratio of file content.
+*/
+
+#ifndef _BYTE_HISTOGRAM_H
+#define _BYTE_HISTOGRAM_H
+
+// System includes
+#include <cstddef>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* Counts the bytes of a stream of content. Consecutive bytes are counted in
+* separate lanes, so that runs of the same byte do not make every
+* increment wait for the store of the previous one; the lanes are added up
+* before their counters can overflow.
+*/
+class ByteHistogram
+{
+public:
+    ByteHistogram();
+
+    /**
+    * Clears the counts for a new stream.
+    */
+    void reset();
+
+    /**
+    * Counts the bytes of the next part of the stream.
+    */
+    void update(const unsigned char * data, size_t length);
+
+    /**
+    * Calculates the statistics of the bytes counted so far. All are 0 for
+    * an empty stream.
+    *
+    * @param entropy Receives the Shannon entropy in bits per byte, 0 to 8.
+    * @param chiSquare Receives the chi-square statistic of the counts
+    * against a uniform distribution of byte values.
+    * @param zeroRatio Receives the fraction of bytes that are zero.
+    */
+    void final(double& entropy, double& chiSquare, double& zeroRatio);
+
+private:
+    static const size_t LANES = 4;
+
+    void count(const unsigned char * data, size_t length);
+    void fold();
+
+    uint32_t m_lanes[LANES][256];
+    uint64_t m_counts[256];
+    uint64_t m_unfolded;
+};
+
+#endif
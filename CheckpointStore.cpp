@@ -0,0 +1,109 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file CheckpointStore.cpp
+* Contains the implementation of the checkpoint store.
+*/
+
+// System includes
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+// Module includes
+#include "CheckpointStore.h"
+#include "StoreFile.h"
+
+namespace
+{
+    const char CHECKPOINT_MAGIC[4] = { 'H', 'C', 'C', 'P' };
+    const uint32_t CHECKPOINT_VERSION = 2;
+    const size_t CASE_DIGEST_LENGTH = 16;
+    const size_t HEADER_SIZE = 40 + CASE_DIGEST_LENGTH + CONTENT_GUARD_LENGTH;
+
+    // Checkpoints hold a few hundred bytes of state; anything much larger
+    // is not a checkpoint.
+    const uint32_t MAX_STATE_LENGTH = 65536;
+}
+
+CheckpointStore::CheckpointStore(const std::string& directory, const std::string& caseIdentity)
+    : m_directory(directory), m_saved(0)
+{
+    TSK_MD5_CTX md5Ctx;
+    TSK_MD5_Init(&md5Ctx);
+    if (!caseIdentity.empty())
+        TSK_MD5_Update(&md5Ctx, (unsigned char *) caseIdentity.data(), (unsigned int) caseIdentity.size());
+    TSK_MD5_Final(m_caseDigest, &md5Ctx);
+}
+
+std::string CheckpointStore::path(uint64_t fileId) const
+{
+    std::stringstream path;
+    path << m_directory << "/" << fileId << ".hcp";
+    return path.str();
+}
+
+bool CheckpointStore::load(uint64_t fileId, uint64_t fileSize, const unsigned char * guard, uint64_t& offset,
+    std::vector<unsigned char>& state) const
+{
+    FILE * file = fopen(path(fileId).c_str(), "rb");
+    if (file == NULL)
+        return false;
+
+    unsigned char header[HEADER_SIZE];
+    bool valid = fread(header, HEADER_SIZE, 1, file) == 1 &&
+        memcmp(header, CHECKPOINT_MAGIC, 4) == 0 &&
+        getUInt32(header + 4) == CHECKPOINT_VERSION &&
+        getUInt32(header + 8) <= MAX_STATE_LENGTH &&
+        getUInt64(header + 12) == fileId &&
+        getUInt64(header + 20) == fileSize &&
+        getUInt64(header + 28) <= fileSize &&
+        memcmp(header + 40, m_caseDigest, CASE_DIGEST_LENGTH) == 0 &&
+        memcmp(header + 40 + CASE_DIGEST_LENGTH, guard, CONTENT_GUARD_LENGTH) == 0;
+
+    if (valid) {
+        state.resize(getUInt32(header + 8));
+        valid = (state.empty() || fread(&state[0], state.size(), 1, file) == 1) &&
+            storeChecksum(state) == getUInt32(header + 36);
+    }
+    fclose(file);
+
+    if (valid)
+        offset = getUInt64(header + 28);
+    return valid;
+}
+
+bool CheckpointStore::save(uint64_t fileId, uint64_t fileSize, const unsigned char * guard, uint64_t offset,
+    const std::vector<unsigned char>& state)
+{
+    unsigned char header[HEADER_SIZE];
+    memcpy(header, CHECKPOINT_MAGIC, 4);
+    putUInt32(header + 4, CHECKPOINT_VERSION);
+    putUInt32(header + 8, (uint32_t) state.size());
+    putUInt64(header + 12, fileId);
+    putUInt64(header + 20, fileSize);
+    putUInt64(header + 28, offset);
+    putUInt32(header + 36, storeChecksum(state));
+    memcpy(header + 40, m_caseDigest, CASE_DIGEST_LENGTH);
+    memcpy(header + 40 + CASE_DIGEST_LENGTH, guard, CONTENT_GUARD_LENGTH);
+
+    std::string target = path(fileId);
+    if (!replaceStoreFile(target, target + ".tmp", header, HEADER_SIZE,
+            state.empty() ? NULL : &state[0], state.size()))
+        return false;
+
+    m_saved++;
+    return true;
+}
+
+void CheckpointStore::remove(uint64_t fileId)
+{
+    ::remove(path(fileId).c_str());
+}
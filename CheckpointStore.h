@@ -0,0 +1,95 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file CheckpointStore.h
+* Contains the interface of the store for intermediate hash states of
+* files that are being hashed.
+*/
+
+#ifndef _CHECKPOINT_STORE_H
+#define _CHECKPOINT_STORE_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+// Module includes
+#include "StoreFile.h"
+
+/**
+* Keeps one checkpoint per file in a directory: the state of the file's
+* hash contexts after a number of bytes, so that hashing can continue from
+* there after the pipeline was interrupted. Each checkpoint is written to
+* a temporary file first and then renamed, so a crash while writing leaves
+* the previous checkpoint intact.
+*
+* A checkpoint file <fileId>.hcp holds the magic "HCCP", the format version
+* and the length of the state as 32 bit little endian integers, the file
+* id, the file size and the offset as 64 bit little endian integers, a 32
+* bit checksum of the state, the MD5 of the case identity, the content
+* guard and the state itself. File ids are only unique within a case, so
+* a checkpoint is only used by the case that wrote it and only while the
+* guard of the file's content still matches.
+*/
+class CheckpointStore
+{
+public:
+    /**
+    * @param directory Directory to keep the checkpoints in. Must exist.
+    * @param caseIdentity Text that identifies the case, such as the names
+    * of its image files. Checkpoints written for another identity are
+    * ignored.
+    */
+    CheckpointStore(const std::string& directory, const std::string& caseIdentity);
+
+    /**
+    * Loads the checkpoint of a file.
+    *
+    * @param fileId Id of the file.
+    * @param fileSize Size of the file. Checkpoints written for a different
+    * size are ignored.
+    * @param guard CONTENT_GUARD_LENGTH bytes that tell whether the content of the
+    * file is the one the checkpoint was written for. Checkpoints written
+    * with a different guard are ignored.
+    * @param offset Receives the number of bytes the state covers.
+    * @param state Receives the state.
+    * @returns false if there is no valid checkpoint for the file.
+    */
+    bool load(uint64_t fileId, uint64_t fileSize, const unsigned char * guard, uint64_t& offset,
+        std::vector<unsigned char>& state) const;
+
+    /**
+    * Saves the checkpoint of a file, replacing the previous one.
+    *
+    * @returns false if the checkpoint could not be written.
+    */
+    bool save(uint64_t fileId, uint64_t fileSize, const unsigned char * guard, uint64_t offset,
+        const std::vector<unsigned char>& state);
+
+    /**
+    * Removes the checkpoint of a file, if there is one.
+    */
+    void remove(uint64_t fileId);
+
+    /// Number of checkpoints written.
+    uint64_t saved() const { return m_saved; }
+
+private:
+    std::string path(uint64_t fileId) const;
+
+    std::string m_directory;
+    unsigned char m_caseDigest[16];
+    uint64_t m_saved;
+};
+
+#endif
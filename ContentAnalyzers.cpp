@@ -0,0 +1,459 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ContentAnalyzers.cpp
+* Contains the implementation of the built-in content analyzers.
+*/
+
+// System includes
+#include <vector>
+#include <sstream>
+
+// Module includes
+#include "ContentAnalyzers.h"
+#include "ByteHistogram.h"
+#include "ArchiveStream.h"
+#include "FileDigests.h"
+#include "Md5Sha1.h"
+
+namespace
+{
+    // Archive content is queued in chunks of this size, at most
+    // MAX_ARCHIVE_CHUNKS of them.
+    const size_t ARCHIVE_CHUNK_SIZE = 256 * 1024;
+    const size_t MAX_ARCHIVE_CHUNKS = 64;
+
+    /**
+    * Returns the id of a blackboard attribute type, adding the type to the
+    * blackboard if it does not exist yet.
+    */
+    int getAttributeType(const std::string& name, const std::string& displayName)
+    {
+        try {
+            return TskBlackboard::attrTypeNameToTypeID(name);
+        }
+        catch (TskException&) {
+            return TskBlackboard::addAttributeType(name, displayName);
+        }
+    }
+
+    class EntropyConsumer : public ContentConsumer
+    {
+    public:
+        EntropyConsumer(const std::string& moduleName, int chiSquareAttribute, int zeroRatioAttribute)
+            : m_moduleName(moduleName), m_chiSquareAttribute(chiSquareAttribute),
+              m_zeroRatioAttribute(zeroRatioAttribute)
+        {
+        }
+
+        virtual void reset()
+        {
+            m_histogram.reset();
+        }
+
+        virtual void update(const unsigned char * data, size_t length)
+        {
+            m_histogram.update(data, length);
+        }
+
+        virtual void end(uint64_t, TskFile * pFile)
+        {
+            double entropy, chiSquare, zeroRatio;
+            m_histogram.final(entropy, chiSquare, zeroRatio);
+
+            pFile->addGenInfoAttribute(TskBlackboardAttribute(TSK_ENTROPY, m_moduleName, "", entropy));
+            pFile->addGenInfoAttribute(TskBlackboardAttribute(m_chiSquareAttribute, m_moduleName, "", chiSquare));
+            pFile->addGenInfoAttribute(TskBlackboardAttribute(m_zeroRatioAttribute, m_moduleName, "", zeroRatio));
+        }
+
+    private:
+        std::string m_moduleName;
+        int m_chiSquareAttribute;
+        int m_zeroRatioAttribute;
+        ByteHistogram m_histogram;
+    };
+
+    /**
+    * Collects the head of a file, up to the window of the signatures, and
+    * matches it at the end; the head does not always arrive in one chunk.
+    */
+    class FileTypeConsumer : public ContentConsumer
+    {
+    public:
+        FileTypeConsumer(const std::string& moduleName, const SignatureMatcher& matcher)
+            : m_moduleName(moduleName), m_matcher(matcher)
+        {
+            m_head.reserve(matcher.window());
+        }
+
+        virtual void reset()
+        {
+            m_head.clear();
+        }
+
+        virtual void update(const unsigned char * data, size_t length)
+        {
+            size_t wanted = m_matcher.window() - m_head.size();
+            if (wanted > 0)
+                m_head.insert(m_head.end(), data, data + (length < wanted ? length : wanted));
+        }
+
+        virtual void end(uint64_t, TskFile * pFile)
+        {
+            if (m_head.empty())
+                return;
+
+            const std::string * type = m_matcher.match(&m_head[0], m_head.size());
+            if (type != NULL)
+                pFile->addGenInfoAttribute(TskBlackboardAttribute(TSK_FILE_TYPE_SIG, m_moduleName, "", *type));
+        }
+
+    private:
+        std::string m_moduleName;
+        const SignatureMatcher& m_matcher;
+        std::vector<unsigned char> m_head;
+    };
+}
+
+EntropyAnalyzer::EntropyAnalyzer(const std::string& moduleName)
+    : m_moduleName(moduleName),
+      m_chiSquareAttribute(getAttributeType("HASHCALC_CHI_SQUARE", "Chi-square of byte values")),
+      m_zeroRatioAttribute(getAttributeType("HASHCALC_ZERO_RATIO", "Fraction of zero bytes"))
+{
+}
+
+ContentConsumer * EntropyAnalyzer::createConsumer()
+{
+    return new EntropyConsumer(m_moduleName, m_chiSquareAttribute, m_zeroRatioAttribute);
+}
+
+FileTypeAnalyzer::FileTypeAnalyzer(const std::string& moduleName, SignatureMatcher * matcher)
+    : m_moduleName(moduleName), m_matcher(matcher)
+{
+}
+
+FileTypeAnalyzer::~FileTypeAnalyzer()
+{
+    delete m_matcher;
+}
+
+ContentConsumer * FileTypeAnalyzer::createConsumer()
+{
+    return new FileTypeConsumer(m_moduleName, *m_matcher);
+}
+
+/**
+* Detects archives from the first bytes of a file and passes their content
+* to the worker of the analyzer, which extracts and hashes the members.
+* The members of the archive being read are only touched by the worker
+* until finish() returns.
+*/
+class ArchiveConsumer : public ContentConsumer, public ArchiveMemberListener
+{
+public:
+    explicit ArchiveConsumer(ArchiveAnalyzer& analyzer)
+        : m_analyzer(analyzer), m_stream(*this), m_decided(false), m_active(false),
+          m_finished(false), m_members(0)
+    {
+        m_head.reserve(ArchiveStream::DETECT_LENGTH);
+    }
+
+    virtual ~ArchiveConsumer()
+    {
+        if (m_active)
+            m_analyzer.finish(this);
+    }
+
+    virtual void reset()
+    {
+        // Hashing can start a file over; the worker has to be done with
+        // the content it was given before.
+        if (m_active)
+            m_analyzer.finish(this);
+
+        m_decided = false;
+        m_active = false;
+        m_head.clear();
+        m_members = 0;
+    }
+
+    virtual void update(const unsigned char * data, size_t length)
+    {
+        if (!m_decided) {
+            size_t wanted = ArchiveStream::DETECT_LENGTH - m_head.size();
+            size_t n = length < wanted ? length : wanted;
+            m_head.insert(m_head.end(), data, data + n);
+            if (m_head.size() < ArchiveStream::DETECT_LENGTH)
+                return;
+
+            start();
+            data += n;
+            length -= n;
+        }
+
+        if (m_active && length > 0)
+            m_analyzer.submit(this, data, length);
+    }
+
+    virtual void end(uint64_t fileId, TskFile * pFile)
+    {
+        if (!m_decided)
+            start();
+        if (!m_active)
+            return;
+
+        m_analyzer.finish(this);
+        m_active = false;
+
+        if (m_stream.failed()) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Archive file id " << fileId << L" is corrupt or truncated, hashed "
+                << m_members << L" members up to the damage";
+            LOGWARN(msg.str());
+        }
+
+        for (size_t i = 0; i < m_members; i++) {
+            const Member& member = m_digests[i];
+            if (!member.complete)
+                continue;
+
+            // A GZIP stream without a recorded name holds the file named
+            // like the archive without its extension.
+            std::string name = member.name;
+            if (name.empty()) {
+                name = pFile->getName();
+                std::string::size_type dot = name.rfind('.');
+                if (dot != std::string::npos && dot > 0)
+                    name.erase(dot);
+            }
+
+            if (member.digests.hasMD5) {
+                char textBuff[2 * FileDigests::MD5_LENGTH + 1];
+                digestToHex(member.digests.md5, FileDigests::MD5_LENGTH, textBuff);
+                pFile->addGenInfoAttribute(TskBlackboardAttribute(TSK_HASH_MD5, m_analyzer.m_moduleName, name,
+                    std::string(textBuff)));
+            }
+            if (member.digests.hasSHA1) {
+                char textBuff[2 * FileDigests::SHA1_LENGTH + 1];
+                digestToHex(member.digests.sha1, FileDigests::SHA1_LENGTH, textBuff);
+                pFile->addGenInfoAttribute(TskBlackboardAttribute(TSK_HASH_SHA1, m_analyzer.m_moduleName, name,
+                    std::string(textBuff)));
+            }
+        }
+    }
+
+    virtual void beginMember(const std::string& name)
+    {
+        // The member records keep their memory between archives.
+        if (m_members == m_digests.size())
+            m_digests.resize(m_members + 1);
+        m_digests[m_members].name = name;
+        m_digests[m_members].complete = false;
+
+        if (m_analyzer.m_md5 && m_analyzer.m_sha1)
+            md5Sha1Init(&m_md5Sha1Ctx);
+        else if (m_analyzer.m_md5)
+            TSK_MD5_Init(&m_md5Ctx);
+        else
+            TSK_SHA_Init(&m_sha1Ctx);
+    }
+
+    virtual void memberData(const unsigned char * data, size_t length)
+    {
+        if (m_analyzer.m_md5 && m_analyzer.m_sha1)
+            md5Sha1Update(&m_md5Sha1Ctx, data, length);
+        else if (m_analyzer.m_md5)
+            TSK_MD5_Update(&m_md5Ctx, (unsigned char *) data, (unsigned int) length);
+        else
+            TSK_SHA_Update(&m_sha1Ctx, (unsigned char *) data, (unsigned int) length);
+    }
+
+    virtual void endMember(bool complete)
+    {
+        FileDigests& digests = m_digests[m_members].digests;
+        if (m_analyzer.m_md5 && m_analyzer.m_sha1)
+            md5Sha1Final(digests.md5, digests.sha1, &m_md5Sha1Ctx);
+        else if (m_analyzer.m_md5)
+            TSK_MD5_Final(digests.md5, &m_md5Ctx);
+        else
+            TSK_SHA_Final(digests.sha1, &m_sha1Ctx);
+
+        digests.hasMD5 = m_analyzer.m_md5;
+        digests.hasSHA1 = m_analyzer.m_sha1;
+        m_digests[m_members].complete = complete;
+        m_members++;
+    }
+
+private:
+    friend class ArchiveAnalyzer;
+
+    struct Member
+    {
+        std::string name;
+        FileDigests digests;
+        bool complete;
+    };
+
+    // Detects the format from the head and, for an archive, queues the
+    // head for the worker.
+    void start()
+    {
+        m_decided = true;
+
+        ArchiveStream::Format format = ArchiveStream::detect(m_head.empty() ? NULL : &m_head[0], m_head.size());
+        if (format == ArchiveStream::FORMAT_NONE)
+            return;
+
+        m_stream.begin(format);
+        m_active = true;
+        m_finished = false;
+        m_analyzer.submit(this, &m_head[0], m_head.size());
+    }
+
+    ArchiveAnalyzer& m_analyzer;
+    ArchiveStream m_stream;
+    std::vector<unsigned char> m_head;
+    bool m_decided;
+    bool m_active;
+    // Set by the worker, under the lock of the analyzer, once it has
+    // ended the stream.
+    bool m_finished;
+
+    std::vector<Member> m_digests;
+    size_t m_members;
+
+    TSK_MD5_CTX m_md5Ctx;
+    TSK_SHA_CTX m_sha1Ctx;
+    Md5Sha1Context m_md5Sha1Ctx;
+};
+
+ArchiveAnalyzer::ArchiveAnalyzer(const std::string& moduleName, bool md5, bool sha1)
+    : m_moduleName(moduleName), m_md5(md5 || !sha1), m_sha1(sha1), m_chunks(0), m_stopping(false),
+      m_thread("ArchiveMembers")
+{
+    m_thread.start(*this);
+}
+
+ArchiveAnalyzer::~ArchiveAnalyzer()
+{
+    {
+        Poco::FastMutex::ScopedLock guard(m_lock);
+        m_stopping = true;
+        m_work.signal();
+    }
+    m_thread.join();
+
+    for (size_t i = 0; i < m_free.size(); i++)
+        delete m_free[i];
+}
+
+ContentConsumer * ArchiveAnalyzer::createConsumer()
+{
+    return new ArchiveConsumer(*this);
+}
+
+ArchiveAnalyzer::Chunk * ArchiveAnalyzer::acquireChunk()
+{
+    while (m_free.empty() && m_chunks == MAX_ARCHIVE_CHUNKS)
+        m_space.wait(m_lock);
+
+    if (m_free.empty()) {
+        Chunk * chunk = new Chunk();
+        chunk->data.reserve(ARCHIVE_CHUNK_SIZE);
+        m_chunks++;
+        return chunk;
+    }
+
+    Chunk * chunk = m_free.back();
+    m_free.pop_back();
+    return chunk;
+}
+
+void ArchiveAnalyzer::submit(ArchiveConsumer * consumer, const unsigned char * data, size_t length)
+{
+    while (length > 0) {
+        size_t n = length < ARCHIVE_CHUNK_SIZE ? length : ARCHIVE_CHUNK_SIZE;
+
+        Chunk * chunk;
+        {
+            Poco::FastMutex::ScopedLock guard(m_lock);
+            chunk = acquireChunk();
+        }
+
+        // The read buffer is only valid during the call, so the content is
+        // copied, outside the lock.
+        chunk->consumer = consumer;
+        chunk->data.assign(data, data + n);
+        chunk->last = false;
+
+        {
+            Poco::FastMutex::ScopedLock guard(m_lock);
+            m_queue.push_back(chunk);
+            m_work.signal();
+        }
+
+        data += n;
+        length -= n;
+    }
+}
+
+void ArchiveAnalyzer::finish(ArchiveConsumer * consumer)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    Chunk * chunk = acquireChunk();
+    chunk->consumer = consumer;
+    chunk->data.clear();
+    chunk->last = true;
+    m_queue.push_back(chunk);
+    m_work.signal();
+
+    while (!consumer->m_finished)
+        m_done.wait(m_lock);
+}
+
+void ArchiveAnalyzer::run()
+{
+    m_lock.lock();
+    while (true) {
+        while (!m_stopping && m_queue.empty())
+            m_work.wait(m_lock);
+        if (m_queue.empty())
+            break;
+
+        Chunk * chunk = m_queue.front();
+        m_queue.pop_front();
+        ArchiveConsumer * consumer = chunk->consumer;
+
+        m_lock.unlock();
+        try
+        {
+            if (chunk->last)
+                consumer->m_stream.end();
+            else
+                consumer->m_stream.update(&chunk->data[0], chunk->data.size());
+        }
+        catch (std::exception& ex)
+        {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Error hashing archive members: " << ex.what();
+            LOGERROR(msg.str());
+        }
+        m_lock.lock();
+
+        if (chunk->last) {
+            consumer->m_finished = true;
+            m_done.broadcast();
+        }
+        m_free.push_back(chunk);
+        m_space.signal();
+    }
+    m_lock.unlock();
+}
@@ -0,0 +1,151 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ContentAnalyzers.h
+* Contains the content analyzers built into the module: byte statistics
+* (ENTROPY), file type detection (FILE_TYPE) and the hashing of archive
+* members (ARCHIVE_MEMBERS).
+*/
+
+#ifndef _CONTENT_ANALYZERS_H
+#define _CONTENT_ANALYZERS_H
+
+// System includes
+#include <string>
+#include <vector>
+#include <deque>
+
+// Poco includes
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+#include "Poco/Mutex.h"
+#include "Poco/Condition.h"
+
+// Module includes
+#include "ContentTap.h"
+#include "SignatureMatcher.h"
+
+/**
+* Posts the entropy, the chi-square of the byte values against a uniform
+* distribution and the fraction of zero bytes of each file as blackboard
+* attributes.
+*/
+class EntropyAnalyzer : public ContentAnalyzer
+{
+public:
+    /**
+    * Looks up the blackboard attribute types of the statistics, adding
+    * those the framework does not define.
+    *
+    * @param moduleName Name recorded with the attributes.
+    */
+    explicit EntropyAnalyzer(const std::string& moduleName);
+
+    virtual ContentConsumer * createConsumer();
+
+private:
+    std::string m_moduleName;
+    int m_chiSquareAttribute;
+    int m_zeroRatioAttribute;
+};
+
+/**
+* Posts the type of each file, recognized from signatures in its first
+* bytes, as a TSK_FILE_TYPE_SIG attribute.
+*/
+class FileTypeAnalyzer : public ContentAnalyzer
+{
+public:
+    /**
+    * @param moduleName Name recorded with the attributes.
+    * @param matcher Compiled matcher; owned by the analyzer.
+    */
+    FileTypeAnalyzer(const std::string& moduleName, SignatureMatcher * matcher);
+    virtual ~FileTypeAnalyzer();
+
+    virtual ContentConsumer * createConsumer();
+
+private:
+    FileTypeAnalyzer(const FileTypeAnalyzer&);
+    FileTypeAnalyzer& operator=(const FileTypeAnalyzer&);
+
+    std::string m_moduleName;
+    SignatureMatcher * m_matcher;
+};
+
+class ArchiveConsumer;
+
+/**
+* Hashes the members of ZIP, GZIP and TAR files without writing them out
+* and posts their digests as TSK_HASH_MD5 and TSK_HASH_SHA1 attributes of
+* the archive, with the path of each member as context. Members are
+* decompressed and hashed on a worker thread while the archive is read; a
+* bounded queue of content holds the read loop back when the worker falls
+* behind.
+*/
+class ArchiveAnalyzer : public ContentAnalyzer, public Poco::Runnable
+{
+public:
+    /**
+    * @param moduleName Name recorded with the attributes.
+    * @param md5 Hash the members with MD5.
+    * @param sha1 Hash the members with SHA-1.
+    */
+    ArchiveAnalyzer(const std::string& moduleName, bool md5, bool sha1);
+    virtual ~ArchiveAnalyzer();
+
+    virtual ContentConsumer * createConsumer();
+
+    virtual void run();
+
+private:
+    friend class ArchiveConsumer;
+
+    ArchiveAnalyzer(const ArchiveAnalyzer&);
+    ArchiveAnalyzer& operator=(const ArchiveAnalyzer&);
+
+    /**
+    * Content of an archive waiting for the worker. The last chunk of an
+    * archive carries no content and ends its stream.
+    */
+    struct Chunk
+    {
+        ArchiveConsumer * consumer;
+        std::vector<unsigned char> data;
+        bool last;
+    };
+
+    // Queues content for the worker; waits while the queue is full.
+    void submit(ArchiveConsumer * consumer, const unsigned char * data, size_t length);
+
+    // Ends the stream of a consumer and waits until the worker is done
+    // with it.
+    void finish(ArchiveConsumer * consumer);
+
+    // Returns an unused chunk; called with the lock held.
+    Chunk * acquireChunk();
+
+    std::string m_moduleName;
+    bool m_md5;
+    bool m_sha1;
+
+    std::deque<Chunk *> m_queue;
+    std::vector<Chunk *> m_free;
+    size_t m_chunks;
+    bool m_stopping;
+
+    Poco::Thread m_thread;
+    Poco::FastMutex m_lock;
+    Poco::Condition m_work;
+    Poco::Condition m_space;
+    Poco::Condition m_done;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ContentTap.h
+* Contains the interface through which other modules of the same process
+* receive the content of files as HashCalcModule reads it, so that content
+* is read once for all of them.
+*
+* A module implements ContentAnalyzer and registers it with the exported
+* registerContentAnalyzer() function of the loaded HashCalc module, which
+* it looks up by name like any other module function. From then on every
+* file HashCalc hashes is passed, chunk by chunk and in order, to a
+* ContentConsumer the analyzer created.
+*/
+
+#ifndef _CONTENT_TAP_H
+#define _CONTENT_TAP_H
+
+// System includes
+#include <cstddef>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* The state of an analysis for one file at a time. HashCalc keeps the
+* consumers it creates and reuses them for later files, so a consumer can
+* keep its buffers between files.
+*/
+class ContentConsumer
+{
+public:
+    virtual ~ContentConsumer() {}
+
+    /**
+    * Called before the content of a file is passed. Can be called again
+    * before end() if HashCalc has to start the file over.
+    */
+    virtual void reset() = 0;
+
+    /**
+    * Called with each chunk of the file's content, in order. The data is
+    * the buffer the content was read into and is only valid during the
+    * call; hashing waits until the call returns.
+    */
+    virtual void update(const unsigned char * data, size_t length) = 0;
+
+    /**
+    * Called once all content of the file has been passed.
+    *
+    * @param fileId Id of the file.
+    * @param pFile The file, for posting results.
+    */
+    virtual void end(uint64_t fileId, TskFile * pFile) = 0;
+};
+
+/**
+* An analysis that receives the content of every file HashCalc hashes.
+*/
+class ContentAnalyzer
+{
+public:
+    virtual ~ContentAnalyzer() {}
+
+    /**
+    * Creates a consumer for the content of one file at a time. HashCalc
+    * deletes it when the analyzer is unregistered or HashCalc is
+    * initialized again. Files can be hashed concurrently, each with a
+    * consumer of its own.
+    */
+    virtual ContentConsumer * createConsumer() = 0;
+};
+
+/**
+* Signature of the exported registerContentAnalyzer() and
+* unregisterContentAnalyzer() functions. Both must be called while no file
+* is being hashed, typically from the initialize() and finalize() functions
+* of the registering module. They return 0 on success and 1 if the
+* analyzer is NULL, already registered or not registered, respectively.
+*/
+typedef int (*ContentAnalyzerRegistration)(ContentAnalyzer * analyzer);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file DigestStore.cpp
+* Contains the implementation of the columnar sidecar store for binary
+* digests.
+*/
+
+// System includes
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Module includes
+#include "DigestStore.h"
+#include "StoreFile.h"
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+namespace
+{
+    const char STORE_MAGIC[4] = { 'H', 'C', 'D', 'S' };
+    const uint32_t STORE_VERSION = 1;
+    const uint64_t HEADER_SIZE = 16;
+
+    const char * const COLUMN_EXTENSIONS[] = { ".ids", ".md5", ".sha1" };
+    const uint32_t COLUMN_WIDTHS[] = { 8, FileDigests::MD5_LENGTH, FileDigests::SHA1_LENGTH };
+
+    /**
+    * Cuts a column file opened for appending down to the given size.
+    */
+    bool truncateColumn(FILE * file, uint64_t size)
+    {
+        fflush(file);
+#ifdef _WIN32
+        return _chsize_s(_fileno(file), (__int64) size) == 0;
+#else
+        return ftruncate(fileno(file), (off_t) size) == 0;
+#endif
+    }
+}
+
+DigestStore::DigestStore() : m_rows(0), m_writable(false), m_failed(false), m_reading(false), m_indexed(false)
+{
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        m_files[i] = NULL;
+        m_columnRows[i] = 0;
+    }
+}
+
+DigestStore::~DigestStore()
+{
+    close();
+}
+
+bool DigestStore::openColumn(Column column, const std::string& prefix, bool forAppend)
+{
+    std::string path = prefix + COLUMN_EXTENSIONS[column];
+    unsigned char header[HEADER_SIZE];
+
+    FILE * file = fopen(path.c_str(), forAppend ? "a+b" : "rb");
+    if (file == NULL)
+        return false;
+
+    fseek64(file, 0, SEEK_END);
+    uint64_t size = (uint64_t) ftell64(file);
+
+    if (size == 0 && forAppend) {
+        // New column: write the header.
+        memcpy(header, STORE_MAGIC, 4);
+        putUInt32(header + 4, STORE_VERSION);
+        putUInt32(header + 8, COLUMN_WIDTHS[column]);
+        putUInt32(header + 12, 0);
+        if (fwrite(header, HEADER_SIZE, 1, file) != 1) {
+            fclose(file);
+            return false;
+        }
+        size = HEADER_SIZE;
+    }
+    else {
+        fseek64(file, 0, SEEK_SET);
+        if (fread(header, HEADER_SIZE, 1, file) != 1 || memcmp(header, STORE_MAGIC, 4) != 0 ||
+            getUInt32(header + 4) != STORE_VERSION || getUInt32(header + 8) != COLUMN_WIDTHS[column]) {
+            std::wstringstream msg;
+            msg << L"DigestStore - " << path.c_str() << L" is not a digest column file";
+            LOGERROR(msg.str());
+            fclose(file);
+            return false;
+        }
+        fseek64(file, 0, SEEK_END);
+    }
+
+    m_columnRows[column] = (size - HEADER_SIZE) / COLUMN_WIDTHS[column];
+    m_files[column] = file;
+    return true;
+}
+
+void DigestStore::alignColumns(const std::string& prefix)
+{
+    m_rows = m_columnRows[IDS];
+    for (int i = MD5; i < COLUMN_COUNT; i++) {
+        if (m_files[i] != NULL && m_columnRows[i] < m_rows)
+            m_rows = m_columnRows[i];
+    }
+
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        if (m_files[i] == NULL || m_columnRows[i] == m_rows)
+            continue;
+
+        // A crash between the appends of one row leaves some columns a row
+        // ahead of the others; rows that are not complete are dropped.
+        std::wstringstream msg;
+        msg << L"DigestStore - " << prefix.c_str() << COLUMN_EXTENSIONS[i] << L" has "
+            << m_columnRows[i] << L" rows, using the " << m_rows << L" complete ones";
+        LOGWARN(msg.str());
+    }
+}
+
+bool DigestStore::create(const std::string& prefix, bool md5, bool sha1)
+{
+    close();
+
+    bool wanted[COLUMN_COUNT] = { true, md5, sha1 };
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        if (wanted[i]) {
+            if (!openColumn((Column) i, prefix, true)) {
+                close();
+                return false;
+            }
+        }
+        else {
+            // A column that is not written any more would no longer line up
+            // with the id column.
+            FILE * existing = fopen((prefix + COLUMN_EXTENSIONS[i]).c_str(), "rb");
+            if (existing != NULL) {
+                fclose(existing);
+                std::wstringstream msg;
+                msg << L"DigestStore - " << prefix.c_str() << L" already stores "
+                    << (COLUMN_EXTENSIONS[i] + 1) << L" digests, which are not being calculated";
+                LOGERROR(msg.str());
+                close();
+                return false;
+            }
+        }
+    }
+
+    // Also drops a partly written row at the end of a column.
+    alignColumns(prefix);
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        if (m_files[i] != NULL && !truncateColumn(m_files[i], HEADER_SIZE + m_rows * COLUMN_WIDTHS[i])) {
+            std::wstringstream msg;
+            msg << L"DigestStore - Unable to truncate " << prefix.c_str() << COLUMN_EXTENSIONS[i];
+            LOGERROR(msg.str());
+            close();
+            return false;
+        }
+    }
+
+    m_writable = true;
+    return true;
+}
+
+bool DigestStore::open(const std::string& prefix)
+{
+    close();
+
+    if (!openColumn(IDS, prefix, false)) {
+        close();
+        return false;
+    }
+
+    // Digest columns are optional.
+    openColumn(MD5, prefix, false);
+    openColumn(SHA1, prefix, false);
+    alignColumns(prefix);
+    return true;
+}
+
+void DigestStore::close()
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        if (m_files[i] != NULL) {
+            fclose(m_files[i]);
+            m_files[i] = NULL;
+        }
+        m_columnRows[i] = 0;
+    }
+    m_rows = 0;
+    m_writable = false;
+    m_failed = false;
+    m_reading = false;
+    m_index.clear();
+    m_indexed = false;
+}
+
+void DigestStore::append(uint64_t fileId, const FileDigests& digests)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    if (!m_writable)
+        return;
+
+    if (m_failed)
+        throw TskException("DigestStore: an earlier row could not be written, no more rows are appended");
+
+    // Switching from reading to writing requires a positioning call.
+    if (m_reading) {
+        for (int i = 0; i < COLUMN_COUNT; i++) {
+            if (m_files[i] != NULL)
+                fseek64(m_files[i], 0, SEEK_END);
+        }
+        m_reading = false;
+    }
+
+    unsigned char id[8];
+    putUInt64(id, fileId);
+    bool written = fwrite(id, sizeof(id), 1, m_files[IDS]) == 1;
+
+    if (m_files[MD5] != NULL)
+        written &= fwrite(digests.md5, FileDigests::MD5_LENGTH, 1, m_files[MD5]) == 1;
+    if (m_files[SHA1] != NULL)
+        written &= fwrite(digests.sha1, FileDigests::SHA1_LENGTH, 1, m_files[SHA1]) == 1;
+
+    // Appending after a row that is in some columns only would pair the
+    // ids with the digests of other files.
+    if (!written) {
+        m_failed = true;
+        throw TskException("DigestStore: error writing digest columns");
+    }
+
+    if (m_indexed) {
+        if (m_index.empty() || m_index.back().first <= fileId)
+            m_index.push_back(std::make_pair(fileId, m_rows));
+        else {
+            m_index.clear();
+            m_indexed = false;
+        }
+    }
+    m_rows++;
+}
+
+bool DigestStore::lookup(uint64_t fileId, FileDigests& digests)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    if (m_files[IDS] == NULL)
+        return false;
+
+    if (!m_reading) {
+        for (int i = 0; i < COLUMN_COUNT; i++) {
+            if (m_files[i] != NULL)
+                fflush(m_files[i]);
+        }
+        m_reading = true;
+    }
+
+    if (!m_indexed) {
+        m_index.clear();
+        m_index.reserve((size_t) m_rows);
+
+        static const size_t IDS_PER_READ = 4096;
+        unsigned char buf[IDS_PER_READ * 8];
+
+        fseek64(m_files[IDS], (int64_t) HEADER_SIZE, SEEK_SET);
+        uint64_t row = 0;
+        while (row < m_rows) {
+            size_t count = fread(buf, 8, IDS_PER_READ, m_files[IDS]);
+            if (count == 0)
+                break;
+            for (size_t i = 0; i < count && row < m_rows; i++, row++)
+                m_index.push_back(std::make_pair(getUInt64(buf + 8 * i), row));
+        }
+
+        // Sorting the pairs keeps rows of the same file in row order, so
+        // the last one is the most recent.
+        std::sort(m_index.begin(), m_index.end());
+        m_indexed = true;
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+        std::upper_bound(m_index.begin(), m_index.end(), std::make_pair(fileId, m_rows));
+    if (it == m_index.begin() || (it - 1)->first != fileId)
+        return false;
+    uint64_t row = (it - 1)->second;
+
+    digests.hasMD5 = false;
+    digests.hasSHA1 = false;
+
+    if (m_files[MD5] != NULL) {
+        fseek64(m_files[MD5], (int64_t) (HEADER_SIZE + row * FileDigests::MD5_LENGTH), SEEK_SET);
+        digests.hasMD5 = fread(digests.md5, FileDigests::MD5_LENGTH, 1, m_files[MD5]) == 1;
+    }
+    if (m_files[SHA1] != NULL) {
+        fseek64(m_files[SHA1], (int64_t) (HEADER_SIZE + row * FileDigests::SHA1_LENGTH), SEEK_SET);
+        digests.hasSHA1 = fread(digests.sha1, FileDigests::SHA1_LENGTH, 1, m_files[SHA1]) == 1;
+    }
+    return true;
+}
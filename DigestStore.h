@@ -0,0 +1,129 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file DigestStore.h
+* Contains the interface of the columnar sidecar store for binary digests.
+*/
+
+#ifndef _DIGEST_STORE_H
+#define _DIGEST_STORE_H
+
+// System includes
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdio>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+// Module includes
+#include "FileDigests.h"
+
+// Poco includes
+#include "Poco/Mutex.h"
+
+/**
+* Stores binary digests in fixed-width column files next to the image
+* database instead of as hexadecimal text. A store named <prefix> consists
+* of <prefix>.ids (8 byte little endian file ids) and one file per
+* algorithm, <prefix>.md5 (16 bytes per row) and <prefix>.sha1 (20 bytes
+* per row). Row n of every column belongs to the same file. Each column file
+* starts with a 16 byte header: the magic "HCDS", then the format version,
+* the row width and a reserved word as 32 bit little endian integers.
+*
+* Digests are only converted to text when they are looked up for display.
+*/
+class DigestStore
+{
+public:
+    DigestStore();
+    ~DigestStore();
+
+    /**
+    * Opens a store for appending, creating its column files if they do not
+    * exist. The columns of an existing store must match the requested ones.
+    * Columns with more rows than the others, left by a crash while a row
+    * was appended, are truncated to the rows complete in every column.
+    *
+    * @param prefix Path prefix of the column files.
+    * @param md5 true to store MD5 digests.
+    * @param sha1 true to store SHA-1 digests.
+    * @returns false if the store could not be opened.
+    */
+    bool create(const std::string& prefix, bool md5, bool sha1);
+
+    /**
+    * Opens an existing store for lookups. Only the rows complete in every
+    * column are used.
+    *
+    * @param prefix Path prefix of the column files.
+    * @returns false if the store could not be opened.
+    */
+    bool open(const std::string& prefix);
+
+    /**
+    * Writes pending rows and closes the column files.
+    */
+    void close();
+
+    /**
+    * Appends a row for a file. The digests of every column of the store must
+    * be present.
+    *
+    * Throws TskException if a column cannot be written. The row may then be
+    * in some columns only, so the store refuses every later append and the
+    * partial row is dropped when the store is next opened.
+    */
+    void append(uint64_t fileId, const FileDigests& digests);
+
+    /**
+    * Finds the digests of a file. The id column is indexed on the first
+    * lookup.
+    *
+    * @returns false if the store has no row for the file.
+    */
+    bool lookup(uint64_t fileId, FileDigests& digests);
+
+    /**
+    * @returns The number of rows in the store.
+    */
+    uint64_t rows() const { return m_rows; }
+
+private:
+    enum Column { IDS = 0, MD5, SHA1, COLUMN_COUNT };
+
+    DigestStore(const DigestStore&);
+    DigestStore& operator=(const DigestStore&);
+
+    bool openColumn(Column column, const std::string& prefix, bool forAppend);
+
+    // Sets the number of rows to the fewest of any open column.
+    void alignColumns(const std::string& prefix);
+
+    FILE * m_files[COLUMN_COUNT];
+    uint64_t m_columnRows[COLUMN_COUNT];
+    uint64_t m_rows;
+    bool m_writable;
+
+    // Set when an append failed; the columns may no longer line up.
+    bool m_failed;
+
+    // true after a lookup, until the next append.
+    bool m_reading;
+
+    // (file id, row) pairs sorted by file id, built on the first lookup.
+    std::vector<std::pair<uint64_t, uint64_t> > m_index;
+    bool m_indexed;
+
+    Poco::FastMutex m_lock;
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file DigestVerifier.cpp
+* Contains the implementation of the digest verifier.
+*/
+
+// System includes
+#include <cstring>
+
+// Module includes
+#include "DigestVerifier.h"
+
+DigestVerifier::DigestVerifier(size_t stopAfter)
+    : m_stopAfter(stopAfter), m_report(NULL),
+      m_matched(0), m_mismatched(0), m_unverified(0), m_skipped(0)
+{
+}
+
+DigestVerifier::~DigestVerifier()
+{
+    if (m_report != NULL)
+        fclose(m_report);
+}
+
+bool DigestVerifier::openReport(const std::string& path)
+{
+    if (m_report != NULL)
+        fclose(m_report);
+
+    m_report = fopen(path.c_str(), "w");
+    if (m_report == NULL)
+        return false;
+
+    fprintf(m_report, "file_id\tpath\thash\tstored\tcalculated\n");
+    return true;
+}
+
+DigestVerifier::Result DigestVerifier::check(uint64_t fileId, const std::string& path, const FileDigests& digests,
+    const std::string& storedMD5, const std::string& storedSHA1)
+{
+    bool compared = false;
+    bool matches = true;
+
+    if (digests.hasMD5)
+        matches = compare(fileId, path, "MD5", digests.md5, FileDigests::MD5_LENGTH, storedMD5, compared) && matches;
+
+    if (digests.hasSHA1)
+        matches = compare(fileId, path, "SHA1", digests.sha1, FileDigests::SHA1_LENGTH, storedSHA1, compared) && matches;
+
+    if (!matches) {
+        m_mismatched++;
+        return MISMATCHED;
+    }
+    if (!compared) {
+        m_unverified++;
+        return UNVERIFIED;
+    }
+    m_matched++;
+    return MATCHED;
+}
+
+bool DigestVerifier::compare(uint64_t fileId, const std::string& path, const char * name,
+    const unsigned char * digest, size_t length, const std::string& stored, bool& compared)
+{
+    if (stored.empty())
+        return true;
+    compared = true;
+
+    // A stored value that is not a digest of the right length counts as
+    // a mismatch; it cannot vouch for the content.
+    unsigned char storedDigest[FileDigests::SHA1_LENGTH];
+    if (hexToDigest(stored, storedDigest, length) && memcmp(storedDigest, digest, length) == 0)
+        return true;
+
+    if (m_report != NULL) {
+        char text[2 * FileDigests::SHA1_LENGTH + 1];
+        digestToHex(digest, length, text);
+        fprintf(m_report, "%llu\t%s\t%s\t%s\t%s\n", (unsigned long long) fileId, path.c_str(), name,
+            stored.c_str(), text);
+
+        // Mismatches are rare; flush each so the report survives a crash.
+        fflush(m_report);
+    }
+    return false;
+}
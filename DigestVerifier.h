@@ -0,0 +1,97 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file DigestVerifier.h
+* Contains the interface of the verifier that compares newly calculated
+* digests with the hash values stored for files earlier.
+*/
+
+#ifndef _DIGEST_VERIFIER_H
+#define _DIGEST_VERIFIER_H
+
+// System includes
+#include <cstdio>
+#include <string>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+// Module includes
+#include "FileDigests.h"
+
+/**
+* Compares calculated digests with stored hash values, counts the
+* outcomes and records every mismatch in an optional report file. The
+* report is tab separated text with one line per mismatching hash: file
+* id, path, hash name, stored value and calculated value.
+*/
+class DigestVerifier
+{
+public:
+    enum Result
+    {
+        MATCHED,        ///< Every stored hash matches.
+        MISMATCHED,     ///< At least one stored hash differs.
+        UNVERIFIED      ///< No hash was stored for the calculated digests.
+    };
+
+    /**
+    * @param stopAfter Number of mismatching files after which stopped()
+    * becomes true; 0 to never stop.
+    */
+    explicit DigestVerifier(size_t stopAfter);
+    ~DigestVerifier();
+
+    /**
+    * Creates the report file, replacing an existing one.
+    *
+    * @returns false if the file cannot be created.
+    */
+    bool openReport(const std::string& path);
+
+    /**
+    * Compares the digests of one file with its stored hash values.
+    *
+    * @param fileId Id of the file.
+    * @param path Path of the file, for the report.
+    * @param digests The calculated digests.
+    * @param storedMD5 Stored MD5 as text, empty if there is none.
+    * @param storedSHA1 Stored SHA-1 as text, empty if there is none.
+    */
+    Result check(uint64_t fileId, const std::string& path, const FileDigests& digests,
+        const std::string& storedMD5, const std::string& storedSHA1);
+
+    /**
+    * Counts a file that was not hashed because verification stopped.
+    */
+    void skip() { m_skipped++; }
+
+    /// true once the configured number of mismatching files was found.
+    bool stopped() const { return m_stopAfter > 0 && m_mismatched >= m_stopAfter; }
+
+    uint64_t matched() const { return m_matched; }
+    uint64_t mismatched() const { return m_mismatched; }
+    uint64_t unverified() const { return m_unverified; }
+    uint64_t skipped() const { return m_skipped; }
+
+private:
+    // Compares one hash; returns false if it is stored and differs.
+    bool compare(uint64_t fileId, const std::string& path, const char * name,
+        const unsigned char * digest, size_t length, const std::string& stored, bool& compared);
+
+    size_t m_stopAfter;
+    FILE * m_report;
+    uint64_t m_matched;
+    uint64_t m_mismatched;
+    uint64_t m_unverified;
+    uint64_t m_skipped;
+};
+
+#endif
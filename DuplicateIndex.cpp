@@ -0,0 +1,349 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file DuplicateIndex.cpp
+* Contains the implementation of the duplicate file index.
+*/
+
+// System includes
+#include <cstring>
+
+// Module includes
+#include "DuplicateIndex.h"
+#include "FileDigests.h"
+#include "StoreFile.h"
+
+namespace
+{
+    const size_t INITIAL_SLOTS = 4096;
+    const uint32_t NO_FILE = 0xffffffff;
+
+    // Spill records: the digest followed by the file id.
+    const size_t ID_LENGTH = 8;
+
+    /**
+    * Returns the position of a digest in the table. Digests are uniformly
+    * distributed, so their bytes serve as the hash; the first byte selects
+    * the spill partition and is not used.
+    */
+    size_t probeStart(const unsigned char * digest)
+    {
+        uint64_t value = 0;
+        for (int i = 8; i >= 1; i--)
+            value = (value << 8) | digest[i];
+        return (size_t) value;
+    }
+
+    /**
+    * Returns the spill partition of a digest at a level of splitting.
+    * Level 0 is the low half of the first byte. Deeper levels take the high
+    * half of the first byte and then the halves of the last bytes, which
+    * probeStart() does not use, so the files of a split partition still
+    * spread over the table.
+    */
+    size_t partitionOf(const unsigned char * digest, size_t keyLength, size_t level)
+    {
+        if (level == 0)
+            return digest[0] & 0xf;
+        if (level == 1)
+            return digest[0] >> 4;
+        unsigned char value = digest[keyLength - 1 - (level - 2) / 2];
+        return (level % 2 == 0 ? value : value >> 4) & 0xf;
+    }
+
+    /**
+    * Returns the number of levels partitionOf() can split by.
+    */
+    size_t partitionLevels(size_t keyLength)
+    {
+        return keyLength > 9 ? 2 + 2 * (keyLength - 9) : 2;
+    }
+}
+
+DuplicateIndex::DuplicateIndex(size_t keyLength, size_t memoryLimit)
+    : m_keyLength(keyLength), m_slotSize(keyLength + 8), m_memoryLimit(memoryLimit),
+      m_capacity(INITIAL_SLOTS), m_used(0), m_hasIgnored(false), m_report(NULL), m_failed(false),
+      m_files(0), m_spilled(0), m_spills(0), m_splits(0), m_oversized(0), m_peakMemory(0), m_groups(0), m_duplicates(0)
+{
+    m_slots.assign(m_capacity * m_slotSize, 0);
+    for (size_t i = 0; i < PARTITIONS; i++)
+        m_partitions[i] = NULL;
+}
+
+DuplicateIndex::~DuplicateIndex()
+{
+    for (size_t i = 0; i < PARTITIONS; i++) {
+        if (m_partitions[i] != NULL)
+            fclose(m_partitions[i]);
+    }
+    if (m_report != NULL)
+        fclose(m_report);
+}
+
+bool DuplicateIndex::openReport(const std::string& path)
+{
+    if (m_report != NULL)
+        fclose(m_report);
+    m_report = fopen(path.c_str(), "w");
+    return m_report != NULL;
+}
+
+void DuplicateIndex::ignore(const unsigned char * digest)
+{
+    memcpy(m_ignored, digest, m_keyLength);
+    m_hasIgnored = true;
+}
+
+void DuplicateIndex::add(const unsigned char * digest, uint64_t fileId)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    m_files++;
+    if (m_hasIgnored && memcmp(digest, m_ignored, m_keyLength) == 0)
+        return;
+
+    insert(digest, fileId);
+    size_t used = memoryUsed();
+    if (used > m_peakMemory)
+        m_peakMemory = used;
+    if (used > m_memoryLimit) {
+        spill();
+        m_spills++;
+    }
+}
+
+unsigned char * DuplicateIndex::findSlot(const unsigned char * digest)
+{
+    size_t mask = m_capacity - 1;
+    size_t i = probeStart(digest) & mask;
+    while (true) {
+        unsigned char * slot = &m_slots[i * m_slotSize];
+        if (getUInt32(slot + m_keyLength) == 0 || memcmp(slot, digest, m_keyLength) == 0)
+            return slot;
+        i = (i + 1) & mask;
+    }
+}
+
+void DuplicateIndex::insert(const unsigned char * digest, uint64_t fileId)
+{
+    // Linear probing stays short below a load of 70%.
+    if ((m_used + 1) * 10 > m_capacity * 7)
+        grow();
+
+    unsigned char * slot = findSlot(digest);
+    uint32_t count = getUInt32(slot + m_keyLength);
+    if (count == 0) {
+        memcpy(slot, digest, m_keyLength);
+        m_used++;
+    }
+
+    m_previous.push_back(count == 0 ? NO_FILE : getUInt32(slot + m_keyLength + 4));
+    putUInt32(slot + m_keyLength, count + 1);
+    putUInt32(slot + m_keyLength + 4, (uint32_t) m_fileIds.size());
+    m_fileIds.push_back(fileId);
+}
+
+void DuplicateIndex::grow()
+{
+    std::vector<unsigned char> old;
+    old.swap(m_slots);
+    size_t oldCapacity = m_capacity;
+
+    m_capacity *= 2;
+    m_slots.assign(m_capacity * m_slotSize, 0);
+    for (size_t i = 0; i < oldCapacity; i++) {
+        const unsigned char * slot = &old[i * m_slotSize];
+        if (getUInt32(slot + m_keyLength) != 0)
+            memcpy(findSlot(slot), slot, m_slotSize);
+    }
+}
+
+void DuplicateIndex::clearTable()
+{
+    // The memory is kept for the next part of the files.
+    memset(&m_slots[0], 0, m_slots.size());
+    m_used = 0;
+    m_fileIds.clear();
+    m_previous.clear();
+}
+
+size_t DuplicateIndex::memoryUsed() const
+{
+    // Only what the table holds counts: clearTable() keeps the capacity of
+    // the vectors, which would otherwise stay above the limit after the
+    // first spill and make every later add() spill again.
+    return m_used * m_slotSize + m_fileIds.size() * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+void DuplicateIndex::spill()
+{
+    unsigned char record[MAX_KEY_LENGTH + ID_LENGTH];
+
+    for (size_t i = 0; i < m_capacity; i++) {
+        const unsigned char * slot = &m_slots[i * m_slotSize];
+        if (getUInt32(slot + m_keyLength) == 0)
+            continue;
+
+        // Files of the same digest always land in the same partition.
+        size_t partition = partitionOf(slot, m_keyLength, 0);
+        if (m_partitions[partition] == NULL) {
+            m_partitions[partition] = tmpfile();
+            if (m_partitions[partition] == NULL) {
+                m_failed = true;
+                continue;
+            }
+        }
+
+        memcpy(record, slot, m_keyLength);
+        for (uint32_t file = getUInt32(slot + m_keyLength + 4); file != NO_FILE; file = m_previous[file]) {
+            uint64_t fileId = m_fileIds[file];
+            for (size_t b = 0; b < ID_LENGTH; b++)
+                record[m_keyLength + b] = (unsigned char) (fileId >> (8 * b));
+            if (fwrite(record, m_keyLength + ID_LENGTH, 1, m_partitions[partition]) != 1)
+                m_failed = true;
+        }
+    }
+
+    m_spilled += m_fileIds.size();
+    clearTable();
+}
+
+void DuplicateIndex::writeGroups()
+{
+    char textBuff[2 * MAX_KEY_LENGTH + 1];
+
+    for (size_t i = 0; i < m_capacity; i++) {
+        const unsigned char * slot = &m_slots[i * m_slotSize];
+        uint32_t count = getUInt32(slot + m_keyLength);
+        if (count < 2)
+            continue;
+
+        m_groups++;
+        m_duplicates += count - 1;
+        if (m_report == NULL)
+            continue;
+
+        // The chain runs from the last file to the first.
+        m_group.clear();
+        for (uint32_t file = getUInt32(slot + m_keyLength + 4); file != NO_FILE; file = m_previous[file])
+            m_group.push_back(m_fileIds[file]);
+
+        digestToHex(slot, m_keyLength, textBuff);
+        fprintf(m_report, "%s\t%u\t", textBuff, count);
+        for (size_t g = m_group.size(); g > 0; g--)
+            fprintf(m_report, g == m_group.size() ? "%llu" : " %llu", (unsigned long long) m_group[g - 1]);
+        fputc('\n', m_report);
+    }
+}
+
+void DuplicateIndex::groupPartition(FILE * partition, size_t level)
+{
+    unsigned char record[MAX_KEY_LENGTH + ID_LENGTH];
+    size_t recordLength = m_keyLength + ID_LENGTH;
+    bool split = false;
+    bool oversized = false;
+
+    rewind(partition);
+    while (fread(record, recordLength, 1, partition) == 1) {
+        uint64_t fileId = 0;
+        for (size_t b = ID_LENGTH; b > 0; b--)
+            fileId = (fileId << 8) | record[m_keyLength + b - 1];
+        insert(record, fileId);
+
+        size_t used = memoryUsed();
+        if (used > m_peakMemory)
+            m_peakMemory = used;
+        if (used > m_memoryLimit) {
+            if (level < partitionLevels(m_keyLength)) {
+                split = true;
+                break;
+            }
+
+            // Only files of a few digests are left, and splitting does
+            // not separate files of the same digest.
+            oversized = true;
+        }
+    }
+    if (ferror(partition))
+        m_failed = true;
+    if (oversized && !split)
+        m_oversized++;
+
+    if (!split) {
+        writeGroups();
+        clearTable();
+        fclose(partition);
+        return;
+    }
+
+    // A sixteenth of the files is more than the table may hold; split the
+    // partition by the next bits of the digests and group each part.
+    clearTable();
+    m_splits++;
+    FILE * parts[PARTITIONS];
+    for (size_t p = 0; p < PARTITIONS; p++)
+        parts[p] = NULL;
+
+    rewind(partition);
+    while (fread(record, recordLength, 1, partition) == 1) {
+        size_t p = partitionOf(record, m_keyLength, level);
+        if (parts[p] == NULL) {
+            parts[p] = tmpfile();
+            if (parts[p] == NULL) {
+                m_failed = true;
+                continue;
+            }
+        }
+        if (fwrite(record, recordLength, 1, parts[p]) != 1)
+            m_failed = true;
+    }
+    if (ferror(partition))
+        m_failed = true;
+    fclose(partition);
+
+    for (size_t p = 0; p < PARTITIONS; p++) {
+        if (parts[p] != NULL)
+            groupPartition(parts[p], level + 1);
+    }
+}
+
+bool DuplicateIndex::report()
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    m_groups = 0;
+    m_duplicates = 0;
+
+    if (m_spilled == 0) {
+        writeGroups();
+    }
+    else {
+        // Group each partition on its own.
+        spill();
+        for (size_t p = 0; p < PARTITIONS; p++) {
+            if (m_partitions[p] != NULL) {
+                groupPartition(m_partitions[p], 1);
+                m_partitions[p] = NULL;
+            }
+        }
+    }
+    clearTable();
+
+    if (m_report != NULL) {
+        if (fclose(m_report) != 0)
+            m_failed = true;
+        m_report = NULL;
+    }
+
+    bool succeeded = !m_failed;
+    m_failed = false;
+    m_spilled = 0;
+    return succeeded;
+}
@@ -0,0 +1,169 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file DuplicateIndex.h
+* Contains the interface of the index that groups files with the same
+* digest as they are hashed, to report duplicate files.
+*/
+
+#ifndef _DUPLICATE_INDEX_H
+#define _DUPLICATE_INDEX_H
+
+// System includes
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+// Poco includes
+#include "Poco/Mutex.h"
+
+/**
+* Groups files by their binary digest in an open addressing hash table.
+* Each slot holds a digest, the number of files with it and the last of
+* them; the files of a slot are chained through a compact array, so a file
+* costs 12 bytes plus its share of the table. When the digests and files
+* in the table grow beyond the memory limit, they are spilled to
+* temporary files partitioned by digest and the table starts over in the
+* memory it already has; each partition is then grouped on its own when
+* the report is written. A partition that does not fit the limit either
+* is split again by further bits of the digest.
+*
+* The report is tab separated text with one line per digest shared by
+* more than one file: the digest in hexadecimal, the number of files and
+* their ids separated by spaces, in the order they were added.
+*/
+class DuplicateIndex
+{
+public:
+    /// Longest digest the index can hold.
+    static const size_t MAX_KEY_LENGTH = 20;
+
+    /**
+    * @param keyLength Length of the digests in bytes.
+    * @param memoryLimit Number of bytes the digests and files in the table
+    * may use before they are spilled.
+    */
+    DuplicateIndex(size_t keyLength, size_t memoryLimit);
+    ~DuplicateIndex();
+
+    /**
+    * Creates the report file, replacing an existing one.
+    *
+    * @returns false if the file cannot be created.
+    */
+    bool openReport(const std::string& path);
+
+    /**
+    * Sets a digest whose files are counted but not grouped, typically that
+    * of empty content.
+    */
+    void ignore(const unsigned char * digest);
+
+    /**
+    * Adds a file to the group of its digest.
+    */
+    void add(const unsigned char * digest, uint64_t fileId);
+
+    /**
+    * Writes every group of more than one file to the report and empties
+    * the index.
+    *
+    * @returns false if the report or a spill file could not be written or
+    * read.
+    */
+    bool report();
+
+    /// Number of files added.
+    uint64_t files() const { return m_files; }
+    /// Number of files that were spilled to temporary files.
+    uint64_t spilled() const { return m_spilled; }
+    /// Number of times add() spilled the table.
+    uint64_t spills() const { return m_spills; }
+    /// Number of spill partitions report() split because they did not fit
+    /// the memory limit.
+    uint64_t splits() const { return m_splits; }
+    /// Number of spill partitions grouped beyond the memory limit because
+    /// the files of a few digests fill it and cannot be split apart.
+    uint64_t oversized() const { return m_oversized; }
+    /// Most memory the digests and files in the table used at a time.
+    size_t peakMemory() const { return m_peakMemory; }
+    /// Number of digests shared by more than one file; set by report().
+    uint64_t groups() const { return m_groups; }
+    /// Number of files in groups beyond the first of each; set by report().
+    uint64_t duplicates() const { return m_duplicates; }
+
+private:
+    static const size_t PARTITIONS = 16;
+
+    DuplicateIndex(const DuplicateIndex&);
+    DuplicateIndex& operator=(const DuplicateIndex&);
+
+    // Returns the slot of a digest: the one holding it or the empty slot
+    // where it belongs.
+    unsigned char * findSlot(const unsigned char * digest);
+    void insert(const unsigned char * digest, uint64_t fileId);
+    void grow();
+    void clearTable();
+    size_t memoryUsed() const;
+
+    // Writes every file in the table to its partition and clears the
+    // table.
+    void spill();
+
+    // Writes the groups in the table to the report.
+    void writeGroups();
+
+    // Writes the groups of the files in a spill partition to the report and
+    // closes it. A partition that does not fit the memory limit is split by
+    // the digest bits of the given level first.
+    void groupPartition(FILE * partition, size_t level);
+
+    size_t m_keyLength;
+    size_t m_slotSize;
+    size_t m_memoryLimit;
+
+    // m_capacity slots of m_slotSize bytes: the digest, the number of files
+    // and the index of the last file in m_fileIds. A count of 0 marks an
+    // empty slot.
+    std::vector<unsigned char> m_slots;
+    size_t m_capacity;
+    size_t m_used;
+
+    // Ids of the files in the table and, for each, the index of the
+    // previous file of the same digest.
+    std::vector<uint64_t> m_fileIds;
+    std::vector<uint32_t> m_previous;
+
+    unsigned char m_ignored[MAX_KEY_LENGTH];
+    bool m_hasIgnored;
+
+    FILE * m_partitions[PARTITIONS];
+    FILE * m_report;
+    bool m_failed;
+
+    // Ids of one group, in the order they were added.
+    std::vector<uint64_t> m_group;
+
+    uint64_t m_files;
+    uint64_t m_spilled;
+    uint64_t m_spills;
+    uint64_t m_splits;
+    uint64_t m_oversized;
+    size_t m_peakMemory;
+    uint64_t m_groups;
+    uint64_t m_duplicates;
+
+    Poco::FastMutex m_lock;
+};
+
+#endif
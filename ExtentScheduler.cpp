@@ -0,0 +1,72 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ExtentScheduler.cpp
+* Contains the implementation of the extent ordered file scheduler.
+*/
+
+// Module includes
+#include "ExtentScheduler.h"
+
+void ExtentScheduler::SeekCounter::read(const std::vector<ImageExtent>& extents)
+{
+    for (std::vector<ImageExtent>::const_iterator it = extents.begin(); it != extents.end(); ++it) {
+        if (it->offset != position) {
+            count++;
+            distance += it->offset > position ? it->offset - position : position - it->offset;
+        }
+        position = it->offset + it->length;
+    }
+}
+
+ExtentScheduler::ExtentScheduler(size_t window)
+    : m_window(window > 0 ? window : 1), m_sequence(0), m_files(0)
+{
+}
+
+void ExtentScheduler::add(uint64_t fileId, const std::vector<ImageExtent>& extents)
+{
+    Entry entry;
+    entry.fileId = fileId;
+    entry.sequence = m_sequence++;
+    entry.extents = extents;
+
+    uint64_t offset = extents.empty() ? 0 : extents.front().offset;
+    Queue::iterator it = m_queue.insert(std::make_pair(offset, entry));
+    m_bySequence[it->second.sequence] = it;
+
+    m_unscheduledSeeks.read(extents);
+}
+
+uint64_t ExtentScheduler::next()
+{
+    Queue::iterator it;
+
+    // The oldest file goes first once it has waited too long; otherwise
+    // the first file at or after the sweep position, wrapping around to
+    // the start of the image.
+    std::map<uint64_t, Queue::iterator>::iterator oldest = m_bySequence.begin();
+    if (m_sequence - oldest->first > 4 * (uint64_t) m_window) {
+        it = oldest->second;
+    }
+    else {
+        it = m_queue.lower_bound(m_seeks.position);
+        if (it == m_queue.end())
+            it = m_queue.begin();
+    }
+
+    uint64_t fileId = it->second.fileId;
+    m_seeks.read(it->second.extents);
+    m_files++;
+
+    m_bySequence.erase(it->second.sequence);
+    m_queue.erase(it);
+    return fileId;
+}
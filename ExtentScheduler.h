@@ -0,0 +1,122 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ExtentScheduler.h
+* Contains the interface of the scheduler that reorders files by the
+* position of their content in the image.
+*/
+
+#ifndef _EXTENT_SCHEDULER_H
+#define _EXTENT_SCHEDULER_H
+
+// System includes
+#include <map>
+#include <vector>
+
+// Module includes
+#include "RawImage.h"
+
+/**
+* Holds back a bounded window of files and releases them in the order of
+* their first extent, sweeping through the image from low to high offsets
+* and starting over at the lowest offset when nothing is left ahead. Reads
+* of the released files then move mostly forward through the image instead
+* of seeking back and forth in database order.
+*
+* A file is released at the latest once 4 * window files have been added
+* after it, so files behind the sweep position are not held back forever.
+*
+* The scheduler also counts the seeks of the released order and of the
+* order the files were added in, for comparison.
+*/
+class ExtentScheduler
+{
+public:
+    /**
+    * @param window Number of files held back before one is released.
+    */
+    explicit ExtentScheduler(size_t window);
+
+    /**
+    * Adds a file.
+    *
+    * @param fileId Id of the file.
+    * @param extents Image extents of the file's content, in file order.
+    */
+    void add(uint64_t fileId, const std::vector<ImageExtent>& extents);
+
+    /**
+    * @returns true if the window is full and a file has to be released.
+    */
+    bool full() const { return m_queue.size() >= m_window; }
+
+    bool empty() const { return m_queue.empty(); }
+
+    /**
+    * Releases the next file. The scheduler must not be empty.
+    *
+    * @returns The id of the file.
+    */
+    uint64_t next();
+
+    /// Number of files released.
+    uint64_t files() const { return m_files; }
+
+    /// Number of times reading the released files in order has to move
+    /// to an offset other than the end of the previous extent.
+    uint64_t seeks() const { return m_seeks.count; }
+
+    /// Total distance of those seeks in bytes.
+    uint64_t seekDistance() const { return m_seeks.distance; }
+
+    /// Number of seeks reading the files in the order they were added
+    /// would have taken.
+    uint64_t unscheduledSeeks() const { return m_unscheduledSeeks.count; }
+
+    /// Total distance of those seeks in bytes.
+    uint64_t unscheduledSeekDistance() const { return m_unscheduledSeeks.distance; }
+
+private:
+    struct Entry
+    {
+        uint64_t fileId;
+        uint64_t sequence;
+        std::vector<ImageExtent> extents;
+    };
+
+    struct SeekCounter
+    {
+        SeekCounter() : position(0), count(0), distance(0) {}
+
+        /// Counts the seeks of reading the extents from the current position.
+        void read(const std::vector<ImageExtent>& extents);
+
+        uint64_t position;
+        uint64_t count;
+        uint64_t distance;
+    };
+
+    // Files by offset of their first extent.
+    typedef std::multimap<uint64_t, Entry> Queue;
+    Queue m_queue;
+
+    // The same files by the order they were added in.
+    std::map<uint64_t, Queue::iterator> m_bySequence;
+
+    size_t m_window;
+    uint64_t m_sequence;
+    uint64_t m_files;
+
+    // Seeks in released order; its position is the sweep position.
+    SeekCounter m_seeks;
+    SeekCounter m_unscheduledSeeks;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file FileDigests.h
+* Contains the definition of the structure that holds the binary digests
+* calculated for one file.
+*/
+
+#ifndef _FILE_DIGESTS_H
+#define _FILE_DIGESTS_H
+
+// System includes
+#include <cstddef>
+#include <string>
+
+/**
+* Binary digests of a file. Only the digests whose flag is set are valid.
+*/
+struct FileDigests
+{
+    static const size_t MD5_LENGTH = 16;
+    static const size_t SHA1_LENGTH = 20;
+
+    FileDigests() : hasMD5(false), hasSHA1(false) {}
+
+    bool hasMD5;
+    bool hasSHA1;
+    unsigned char md5[MD5_LENGTH];
+    unsigned char sha1[SHA1_LENGTH];
+};
+
+/**
+* Converts a binary digest to lower case hexadecimal text.
+*
+* @param digest The digest bytes.
+* @param length Number of digest bytes.
+* @param text Receives 2 * length characters and a terminating null.
+*/
+inline void digestToHex(const unsigned char * digest, size_t length, char * text)
+{
+    static const char hexMap[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < length; i++) {
+        text[2 * i] = hexMap[(digest[i] >> 4) & 0xf];
+        text[2 * i + 1] = hexMap[digest[i] & 0xf];
+    }
+    text[2 * length] = '\0';
+}
+
+/**
+* Converts hexadecimal text in upper or lower case to a binary digest.
+*
+* @param text The text; must have exactly 2 * length digits.
+* @param digest Receives length bytes.
+* @param length Number of digest bytes.
+* @returns false if the text is not a digest of that length.
+*/
+inline bool hexToDigest(const std::string& text, unsigned char * digest, size_t length)
+{
+    if (text.size() != 2 * length)
+        return false;
+
+    for (size_t i = 0; i < 2 * length; i++) {
+        char c = text[i];
+        int value;
+        if (c >= '0' && c <= '9')
+            value = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value = c - 'A' + 10;
+        else
+            return false;
+
+        if (i % 2 == 0)
+            digest[i / 2] = (unsigned char) (value << 4);
+        else
+            digest[i / 2] |= (unsigned char) value;
+    }
+    return true;
+}
+
+#endif
@@ -15,18 +15,2238 @@
 // System includes
 #include <string>
 #include <sstream>
+#include <vector>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 // Framework includes
 #include "TskModuleDev.h"
 
-// strings for command line arguments
-static const std::string MD5_NAME("MD5");
-static const std::string SHA1_NAME("SHA1");
+// Module includes
+#include "HashCalcTrace.h"
+#include "HashResultWriter.h"
+#include "DigestStore.h"
+#include "FileDigests.h"
+#include "RawImage.h"
+#include "BatchReader.h"
+#include "AlignedBufferPool.h"
+#include "ExtentScheduler.h"
+#include "DuplicateIndex.h"
+#include "SizeCollisionFilter.h"
+#include "SharedExtentIndex.h"
+#include "ImageSweep.h"
+#include "AcquisitionDigests.h"
+#include "CheckpointStore.h"
+#include "MidstateStore.h"
+#include "MerkleTree.h"
+#include "DigestVerifier.h"
+#include "ObjectPool.h"
+#include "Md5Sha1.h"
+#include "ContentTap.h"
+#include "ContentAnalyzers.h"
+
+// Poco includes
+#include "Poco/Timestamp.h"
+#include "Poco/Environment.h"
+
+// Name of the module, also recorded with its blackboard attributes.
+static const std::string MODULE_NAME("HashCalc");
+
+// strings for command line arguments
+static const std::string MD5_NAME("MD5");
+static const std::string SHA1_NAME("SHA1");
+static const std::string MERKLE_NAME("MERKLE");
+static const std::string TRACE_NAME("TRACE");
+static const std::string TRACE_EVENTS_NAME("TRACE_EVENTS");
+static const std::string DB_BATCH_NAME("DB_BATCH");
+static const std::string DIGEST_STORE_NAME("DIGEST_STORE");
+static const std::string DIGEST_TEXT_NAME("DIGEST_TEXT");
+static const std::string MMAP_NAME("MMAP");
+static const std::string BATCH_READ_NAME("BATCH_READ");
+static const std::string READ_ENGINE_NAME("READ_ENGINE");
+static const std::string READ_DEPTH_NAME("READ_DEPTH");
+static const std::string DIRECT_IO_NAME("DIRECT_IO");
+static const std::string SCHEDULE_WINDOW_NAME("SCHEDULE_WINDOW");
+static const std::string SINGLE_PASS_NAME("SINGLE_PASS");
+static const std::string SINGLE_PASS_STASH_NAME("SINGLE_PASS_STASH");
+static const std::string IMAGE_HASH_NAME("IMAGE_HASH");
+static const std::string IMAGE_MD5_NAME("IMAGE_MD5");
+static const std::string IMAGE_SHA1_NAME("IMAGE_SHA1");
+static const std::string CHECKPOINT_DIR_NAME("CHECKPOINT_DIR");
+static const std::string CHECKPOINT_INTERVAL_NAME("CHECKPOINT_INTERVAL");
+static const std::string MIDSTATE_DIR_NAME("MIDSTATE_DIR");
+static const std::string MIDSTATE_MIN_NAME("MIDSTATE_MIN");
+static const std::string MIDSTATE_PATHS_NAME("MIDSTATE_PATHS");
+static const std::string MERKLE_DIR_NAME("MERKLE_DIR");
+static const std::string MERKLE_LEAF_NAME("MERKLE_LEAF");
+static const std::string MERKLE_THREADS_NAME("MERKLE_THREADS");
+static const std::string VERIFY_NAME("VERIFY");
+static const std::string VERIFY_REPORT_NAME("VERIFY_REPORT");
+static const std::string VERIFY_STOP_NAME("VERIFY_STOP");
+static const std::string ENTROPY_NAME("ENTROPY");
+static const std::string FILE_TYPE_NAME("FILE_TYPE");
+static const std::string FILE_TYPE_SIGNATURES_NAME("FILE_TYPE_SIGNATURES");
+static const std::string ARCHIVE_MEMBERS_NAME("ARCHIVE_MEMBERS");
+static const std::string DUPLICATE_REPORT_NAME("DUPLICATE_REPORT");
+static const std::string DUPLICATE_MEMORY_NAME("DUPLICATE_MEMORY");
+static const std::string DEDUP_ONLY_NAME("DEDUP_ONLY");
+static const std::string DEDUP_HEAD_NAME("DEDUP_HEAD");
+static const std::string SHARED_EXTENTS_NAME("SHARED_EXTENTS");
+static const std::string SHARED_EXTENTS_MEMORY_NAME("SHARED_EXTENTS_MEMORY");
+
+static bool calculateMD5 = true;
+static bool calculateSHA1 = false;
+static bool calculateMerkle = false;
+static bool calculateEntropy = false;
+
+// Number of spans each thread buffers before writing them to the trace file.
+static const size_t DEFAULT_TRACE_EVENTS = 65536;
+
+// Posts hash values in batched transactions when DB_BATCH is given.
+static HashResultWriter * resultWriter = NULL;
+
+// Receives binary digests when a digest store is configured.
+static DigestStore * digestStore = NULL;
+
+// Prefix of the configured digest store and the read-only view of it that
+// lookupDigests() opens once the module is finalized.
+static std::string digestStorePrefix;
+static DigestStore * digestReader = NULL;
+
+// Groups files with the same digest; set when DUPLICATE_REPORT is given.
+static DuplicateIndex * duplicateIndex = NULL;
+
+// Default memory, in MiB, the duplicate index may use before it spills.
+static const size_t DEFAULT_DUPLICATE_MEMORY = 256;
+
+// Digests of empty content, which are not reported as duplicates.
+static const char EMPTY_MD5[] = "d41d8cd98f00b204e9800998ecf8427e";
+static const char EMPTY_SHA1[] = "da39a3ee5e6b4b0d3255bfef95601890afd80709";
+
+// Collects file sizes in dedup-only mode; only files that can have a
+// duplicate are hashed, when the module is finalized.
+static SizeCollisionFilter * dedupFilter = NULL;
+
+// Number of bytes at the start of files of the same size that are compared
+// before they are hashed in dedup-only mode; 0 to hash them right away.
+static size_t dedupHeadLength = 0;
+
+// Recognizes files stored in the same extents as a hashed file; set when
+// SHARED_EXTENTS is enabled.
+static SharedExtentIndex * sharedExtents = NULL;
+
+// Default memory, in MiB, the shared extent index may keep hashed layouts in.
+static const size_t DEFAULT_SHARED_EXTENTS_MEMORY = 64;
+
+// Whether hash values are posted to the database as text.
+static bool postDigestText = true;
+
+// Raw case image. Used to hash file content in place when MMAP is enabled,
+// to read past the page cache when DIRECT_IO is enabled and to read small
+// files in batches when BATCH_READ is enabled.
+static RawImage * rawImage = NULL;
+static bool hashFromMappedImage = false;
+
+// Buffers for direct reads; set when DIRECT_IO is enabled.
+static AlignedBufferPool * directBuffers = NULL;
+
+// Length of each direct read. Large requests keep the device streaming
+// without read-ahead from the page cache.
+static const size_t DIRECT_READ_LENGTH = 1024 * 1024;
+
+// Files up to this size are read in batches when BATCH_READ is enabled.
+static const uint64_t SMALL_FILE_LIMIT = 65536;
+
+// Default number of batch reads in flight.
+static const size_t DEFAULT_READ_DEPTH = 64;
+
+/**
+* A small file whose hashing has been deferred until enough files have been
+* collected for a batch read.
+*/
+struct PendingFile
+{
+    uint64_t fileId;
+    uint64_t size;
+    std::vector<ImageExtent> extents;
+};
+
+static BatchReader * batchReader = NULL;
+static size_t batchFiles = 0;
+
+// Holds batchFiles entries that are reused from batch to batch, so their
+// extent lists keep their memory; the first pendingCount are in use.
+static std::vector<PendingFile> pendingFiles;
+static size_t pendingCount = 0;
+
+// Reads of the current batch and their completion state, reused between
+// batches.
+static std::vector<BatchReadRequest> batchRequests;
+static std::vector<size_t> outstandingReads;
+static std::vector<bool> failedReads;
+
+// Every pending file is read into its own SMALL_FILE_LIMIT slot.
+static std::vector<unsigned char> batchBuffers;
+
+// Reorders files by the position of their content in the image; set when
+// SCHEDULE_WINDOW is enabled.
+static ExtentScheduler * scheduler = NULL;
+
+// Collects files to hash in a single pass over the image at the end; set
+// when SINGLE_PASS is enabled.
+static ImageSweep * imageSweep = NULL;
+
+// Whether files are added to the single pass. The pass may also run just
+// to hash the whole image.
+static bool sweepFiles = false;
+
+// Whether the pass hashes the whole image, and the acquisition hashes of
+// the image to compare the result with.
+static bool hashImage = false;
+static FileDigests expectedImageDigests;
+
+// Default number of MiB of out of order content the single pass keeps in
+// memory before it stashes it in a temporary file.
+static const uint64_t DEFAULT_SINGLE_PASS_STASH = 256;
+
+// Number of deferred files that could not be hashed.
+static size_t deferredFailures = 0;
+
+// Checkpoints of the contexts of large files; set when CHECKPOINT_DIR is
+// given. Files are checkpointed every checkpointInterval bytes.
+static CheckpointStore * checkpointStore = NULL;
+static uint64_t checkpointInterval = 0;
+
+// Default checkpoint interval in MiB.
+static const uint64_t DEFAULT_CHECKPOINT_INTERVAL = 1024;
+
+// Hash state of files by path, kept across images; set when MIDSTATE_DIR
+// is given. Only files of at least midstateMinimum bytes are kept.
+static MidstateStore * midstateStore = NULL;
+static uint64_t midstateMinimum = 0;
+
+// Patterns of the paths of files that are only appended to; only these
+// files continue from their midstate.
+static std::vector<std::string> midstatePatterns;
+
+// Default minimum size in MiB of files whose midstate is kept.
+static const uint64_t DEFAULT_MIDSTATE_MIN = 16;
+
+// Bytes at the start and at the end of a midstate's content that are
+// read again to tell whether the content changed.
+static const size_t MIDSTATE_GUARD_SAMPLE = 65536;
+
+// Bytes at the start of a file whose MD5 guards its checkpoints.
+static const size_t CHECKPOINT_GUARD_SAMPLE = 65536;
+
+// Number of files continued from their midstate and the bytes skipped.
+static uint64_t midstateFiles = 0;
+static uint64_t midstateBytes = 0;
+
+// Keeps the Merkle trees of files and hashes their leaves; set when MERKLE
+// is enabled.
+static MerkleStore * merkleStore = NULL;
+static MerkleHashPool * merklePool = NULL;
+
+// Default Merkle tree leaf size in KiB.
+static const uint32_t DEFAULT_MERKLE_LEAF = 1024;
+
+// Analyses that receive the content of every file hashed, in the order of
+// their registration.
+static std::vector<ContentAnalyzer *> contentAnalyzers;
+
+// The built-in analyzers; registered when ENTROPY, FILE_TYPE and
+// ARCHIVE_MEMBERS are enabled.
+static EntropyAnalyzer * entropyAnalyzer = NULL;
+static FileTypeAnalyzer * fileTypeAnalyzer = NULL;
+static ArchiveAnalyzer * archiveAnalyzer = NULL;
+
+// Compares calculated digests with the stored hash values instead of
+// posting them; set when VERIFY is enabled.
+static DigestVerifier * digestVerifier = NULL;
+
+// Number of content bytes hashed straight from the mapped image, through
+// TskFile::read(), from batch reads and from direct reads respectively.
+static uint64_t mappedBytes = 0;
+static uint64_t readBytes = 0;
+static uint64_t batchReadBytes = 0;
+static uint64_t directBytes = 0;
+
+// Size of a cache line on the processors the module runs on.
+static const size_t CACHE_LINE_SIZE = 64;
+
+#ifdef _MSC_VER
+#define HASHCALC_CACHE_ALIGNED __declspec(align(64))
+#else
+#define HASHCALC_CACHE_ALIGNED __attribute__((aligned(64)))
+#endif
+
+// The hashes a set of contexts calculates, as bits of an index into the
+// tables of functions specialized for each combination of hashes.
+enum
+{
+    WITH_MD5 = 1,
+    WITH_SHA1 = 2,
+    WITH_MERKLE = 4,
+    WITH_CONTENT = 8,
+    HASH_COMBINATIONS = 16
+};
+
+// Lists the instantiations of a function template for every combination
+// of hashes, in the order of their bits.
+#define HASHCALC_VARIANTS(function) { \
+    &function<0>, &function<1>, &function<2>, &function<3>, \
+    &function<4>, &function<5>, &function<6>, &function<7>, \
+    &function<8>, &function<9>, &function<10>, &function<11>, \
+    &function<12>, &function<13>, &function<14>, &function<15> }
+
+/**
+* Digest contexts of the hashes being calculated for one file. The block
+* starts on a cache line and each context starts on a cache line of its
+* own, so blocks hashed on different threads never share a line and each
+* algorithm touches only the lines of its own state.
+*/
+struct HASHCALC_CACHE_ALIGNED HashContexts
+{
+    HashContexts() : hashes(0), merkle(NULL) {}
+
+    ~HashContexts()
+    {
+        delete merkle;
+        for (size_t i = 0; i < consumers.size(); i++)
+            delete consumers[i];
+    }
+
+    // new does not honor the alignment of the type before C++17.
+    static void * operator new(size_t size)
+    {
+        void * block = NULL;
+#ifdef _WIN32
+        block = _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+        if (posix_memalign(&block, CACHE_LINE_SIZE, size) != 0)
+            block = NULL;
+#endif
+        if (block == NULL)
+            throw std::bad_alloc();
+        return block;
+    }
+
+    static void operator delete(void * block)
+    {
+#ifdef _WIN32
+        _aligned_free(block);
+#else
+        free(block);
+#endif
+    }
+
+    HASHCALC_CACHE_ALIGNED TSK_MD5_CTX md5Ctx;
+    HASHCALC_CACHE_ALIGNED TSK_SHA_CTX sha1Ctx;
+    /// Used instead of md5Ctx and sha1Ctx when both hashes are enabled.
+    HASHCALC_CACHE_ALIGNED Md5Sha1Context md5Sha1Ctx;
+
+    /// Bits of the hashes the contexts calculate; set by initContexts().
+    unsigned int hashes;
+    /// Set by initContexts() if MERKLE is enabled for the contexts.
+    MerkleTreeBuilder * merkle;
+    /// One consumer per registered content analyzer, created by
+    /// initContexts() the first time the contexts hash a file.
+    std::vector<ContentConsumer *> consumers;
+
+private:
+    HashContexts(const HashContexts&);
+    HashContexts& operator=(const HashContexts&);
+};
+
+/**
+* Passes content to the consumers of the registered content analyzers.
+*/
+static void analyzeContent(HashContexts& contexts, const unsigned char * data, size_t length)
+{
+    for (size_t i = 0; i < contexts.consumers.size(); i++)
+        contexts.consumers[i]->update(data, length);
+}
+
+/**
+* Tells the consumers of the registered content analyzers that the content
+* of a file is complete.
+*
+* @param fileId Id of the file.
+* @param pFile The file, or NULL if it is no longer open.
+*/
+static void finalContent(HashContexts& contexts, uint64_t fileId, TskFile * pFile)
+{
+    HASHCALC_TRACE_SPAN(contentSpan, "finalContent", fileId);
+
+    std::auto_ptr<TskFile> storedFile;
+    if (pFile == NULL) {
+        storedFile.reset(TskServices::Instance().getFileManager().getFile(fileId));
+        pFile = storedFile.get();
+    }
+
+    for (size_t i = 0; i < contexts.consumers.size(); i++)
+        contexts.consumers[i]->end(fileId, pFile);
+}
+
+/**
+* Updates the contexts of the hashes given as template argument. Each
+* instantiation contains the update calls of its hashes only, with no
+* test of the configuration per chunk.
+*/
+template <unsigned int Hashes>
+static void updateHashes(HashContexts& contexts, const unsigned char * data, size_t length)
+{
+    // MD5 and SHA-1 together go through the stitched kernel, which reads
+    // each block once for both.
+    if ((Hashes & (WITH_MD5 | WITH_SHA1)) == (WITH_MD5 | WITH_SHA1))
+        md5Sha1Update(&contexts.md5Sha1Ctx, data, length);
+    else if (Hashes & WITH_MD5)
+        TSK_MD5_Update(&contexts.md5Ctx, (unsigned char *) data, (unsigned int) length);
+    else if (Hashes & WITH_SHA1)
+        TSK_SHA_Update(&contexts.sha1Ctx, (unsigned char *) data, (unsigned int) length);
+
+    if (Hashes & WITH_MERKLE)
+        contexts.merkle->update(data, length);
+
+    if (Hashes & WITH_CONTENT)
+        analyzeContent(contexts, data, length);
+}
+
+/**
+* Finalizes the contexts of the hashes given as template argument.
+*/
+template <unsigned int Hashes>
+static void finalHashes(HashContexts& contexts, FileDigests& digests, uint64_t fileId, TskFile * pFile)
+{
+    if ((Hashes & (WITH_MD5 | WITH_SHA1)) == (WITH_MD5 | WITH_SHA1))
+        md5Sha1Final(digests.md5, digests.sha1, &contexts.md5Sha1Ctx);
+    else if (Hashes & WITH_MD5)
+        TSK_MD5_Final(digests.md5, &contexts.md5Ctx);
+    else if (Hashes & WITH_SHA1)
+        TSK_SHA_Final(digests.sha1, &contexts.sha1Ctx);
+
+    digests.hasMD5 = (Hashes & WITH_MD5) != 0;
+    digests.hasSHA1 = (Hashes & WITH_SHA1) != 0;
+
+    if (Hashes & WITH_CONTENT)
+        finalContent(contexts, fileId, pFile);
+
+    // The root is not the SHA-256 of the content, so it is kept with its
+    // leaves in the Merkle store rather than posted as a hash value.
+    if (Hashes & WITH_MERKLE) {
+        // The builder and the tree swap their leaf lists, so both keep
+        // their memory for the next file.
+        static MerkleTree tree;
+        contexts.merkle->final(tree);
+        if (!merkleStore->save(fileId, tree)) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Unable to write the Merkle tree of file id " << fileId;
+            LOGERROR(msg.str());
+        }
+    }
+}
+
+typedef void (*UpdateFunction)(HashContexts& contexts, const unsigned char * data, size_t length);
+typedef void (*FinalFunction)(HashContexts& contexts, FileDigests& digests, uint64_t fileId, TskFile * pFile);
+
+static const UpdateFunction UPDATE_FUNCTIONS[HASH_COMBINATIONS] = HASHCALC_VARIANTS(updateHashes);
+static const FinalFunction FINAL_FUNCTIONS[HASH_COMBINATIONS] = HASHCALC_VARIANTS(finalHashes);
+
+/**
+* @returns The bits of the hashes the module is configured for.
+*
+* @param perFile false for contexts of the whole image, which get neither a
+* Merkle tree nor content analysis.
+*/
+static unsigned int enabledHashes(bool perFile)
+{
+    return (calculateMD5 ? WITH_MD5 : 0) | (calculateSHA1 ? WITH_SHA1 : 0) |
+        (calculateMerkle && perFile ? WITH_MERKLE : 0) |
+        (!contentAnalyzers.empty() && perFile ? WITH_CONTENT : 0);
+}
+
+/**
+* Prepares the contexts for a new calculation.
+*
+* @param perFile false for contexts of the whole image, which get neither a
+* Merkle tree nor content analysis.
+*/
+static void initContexts(HashContexts& contexts, bool perFile = true)
+{
+    if (calculateMD5 && calculateSHA1)
+        md5Sha1Init(&contexts.md5Sha1Ctx);
+    else if (calculateMD5)
+        TSK_MD5_Init(&contexts.md5Ctx);
+    else if (calculateSHA1)
+        TSK_SHA_Init(&contexts.sha1Ctx);
+
+    if (calculateMerkle && perFile) {
+        if (contexts.merkle == NULL)
+            contexts.merkle = new MerkleTreeBuilder(*merklePool);
+        else
+            contexts.merkle->reset();
+    }
+
+    // The pool is cleared whenever the analyzers change, so contexts either
+    // have no consumers yet or one for each analyzer.
+    if (perFile) {
+        if (contexts.consumers.empty()) {
+            for (size_t i = 0; i < contentAnalyzers.size(); i++)
+                contexts.consumers.push_back(contentAnalyzers[i]->createConsumer());
+        }
+        for (size_t i = 0; i < contexts.consumers.size(); i++)
+            contexts.consumers[i]->reset();
+    }
+
+    contexts.hashes = enabledHashes(perFile);
+}
+
+/**
+* Updates contexts known to calculate the hashes given as template
+* argument; used by the read loops of the specialized file hashing.
+*/
+template <unsigned int Hashes>
+static void updateContexts(HashContexts& contexts, const unsigned char * data, size_t length, uint64_t fileId)
+{
+    HASHCALC_TRACE_SPAN(updateSpan, "update", fileId);
+    updateHashes<Hashes>(contexts, data, length);
+}
+
+static void updateContexts(HashContexts& contexts, const unsigned char * data, size_t length, uint64_t fileId)
+{
+    HASHCALC_TRACE_SPAN(updateSpan, "update", fileId);
+    UPDATE_FUNCTIONS[contexts.hashes](contexts, data, length);
+}
+
+/**
+* Finalizes contexts known to calculate the hashes given as template
+* argument.
+*
+* @param pFile The file, or NULL if it is no longer open; content analyzers
+* post their results to it.
+*/
+template <unsigned int Hashes>
+static void finalContexts(HashContexts& contexts, FileDigests& digests, uint64_t fileId, TskFile * pFile)
+{
+    HASHCALC_TRACE_SPAN(finalSpan, "finalize", fileId);
+    finalHashes<Hashes>(contexts, digests, fileId, pFile);
+}
+
+static void finalContexts(HashContexts& contexts, FileDigests& digests, uint64_t fileId, TskFile * pFile)
+{
+    HASHCALC_TRACE_SPAN(finalSpan, "finalize", fileId);
+    FINAL_FUNCTIONS[contexts.hashes](contexts, digests, fileId, pFile);
+}
+
+// Contexts are taken from a pool and kept between files, with the leaf
+// digest lists of their Merkle tree builders, so hashing a file does not
+// allocate.
+static ObjectPool<HashContexts> contextPool;
+
+// Extents of the file being hashed from the raw image; reused so that their
+// list keeps its memory.
+static std::vector<ImageExtent> fileExtents;
+
+/**
+* Reads up to length bytes of a file at an offset.
+*
+* @returns false if fewer bytes could be read.
+*/
+static bool readFileRange(TskFile * pFile, uint64_t offset, char * buffer, size_t length)
+{
+    pFile->seek((TSK_OFF_T) offset, std::ios::beg);
+
+    size_t total = 0;
+    while (total < length) {
+        ssize_t bytesRead = pFile->read(buffer + total, length - total);
+        if (bytesRead <= 0)
+            return false;
+        total += (size_t) bytesRead;
+    }
+    readBytes += total;
+    return true;
+}
+
+/**
+* Calculates the guard digest of the first length bytes of a file: an MD5
+* of the length and of the first and last MIDSTATE_GUARD_SAMPLE bytes of
+* that range. A file that was only appended to since keeps its guard; one
+* that was replaced or rewritten almost always changes at its start or
+* near the old end. The file is positioned at its start afterwards.
+*
+* @returns false if the range cannot be read.
+*/
+static bool guardDigest(TskFile * pFile, uint64_t length, unsigned char * guard)
+{
+    size_t sample = length < MIDSTATE_GUARD_SAMPLE ? (size_t) length : MIDSTATE_GUARD_SAMPLE;
+    std::vector<char> buffer(sample);
+
+    unsigned char lengthBytes[8];
+    for (int i = 0; i < 8; i++)
+        lengthBytes[i] = (unsigned char) (length >> (8 * i));
+
+    TSK_MD5_CTX md5Ctx;
+    TSK_MD5_Init(&md5Ctx);
+    TSK_MD5_Update(&md5Ctx, lengthBytes, sizeof(lengthBytes));
+
+    bool read = readFileRange(pFile, 0, &buffer[0], sample);
+    if (read) {
+        TSK_MD5_Update(&md5Ctx, (unsigned char *) &buffer[0], (unsigned int) sample);
+        read = readFileRange(pFile, length - sample, &buffer[0], sample);
+    }
+    if (read) {
+        TSK_MD5_Update(&md5Ctx, (unsigned char *) &buffer[0], (unsigned int) sample);
+        TSK_MD5_Final(guard, &md5Ctx);
+    }
+
+    pFile->seek(0, std::ios::beg);
+    return read;
+}
+
+/**
+* Matches a path against a pattern in which '*' stands for any run of
+* characters and '?' for one character, ignoring the case of ASCII
+* letters.
+*/
+static bool matchesPathPattern(const std::string& path, const std::string& pattern)
+{
+    size_t p = 0;
+    size_t s = 0;
+    size_t starPattern = std::string::npos;
+    size_t starPath = 0;
+
+    while (p < path.size()) {
+        if (s < pattern.size() && (pattern[s] == '?' || tolower((unsigned char) pattern[s]) == tolower((unsigned char) path[p]))) {
+            p++;
+            s++;
+        }
+        else if (s < pattern.size() && pattern[s] == '*') {
+            // Let the star match nothing first and more on a mismatch.
+            starPattern = s++;
+            starPath = p;
+        }
+        else if (starPattern != std::string::npos) {
+            s = starPattern + 1;
+            p = ++starPath;
+        }
+        else
+            return false;
+    }
+
+    while (s < pattern.size() && pattern[s] == '*')
+        s++;
+    return s == pattern.size();
+}
+
+/**
+* Tells whether a file of the given path may continue from its midstate.
+*/
+static bool isAppendOnlyPath(const std::string& path)
+{
+    for (size_t i = 0; i < midstatePatterns.size(); i++) {
+        if (matchesPathPattern(path, midstatePatterns[i]))
+            return true;
+    }
+    return false;
+}
+
+/**
+* Calculates the guard of a file's checkpoints: an MD5 of its first
+* CHECKPOINT_GUARD_SAMPLE bytes. The file is positioned at its start
+* afterwards.
+*
+* @returns false if those bytes cannot be read.
+*/
+static bool checkpointGuard(TskFile * pFile, uint64_t fileSize, unsigned char * guard)
+{
+    size_t sample = fileSize < CHECKPOINT_GUARD_SAMPLE ? (size_t) fileSize : CHECKPOINT_GUARD_SAMPLE;
+    std::vector<char> buffer(sample);
+
+    bool read = readFileRange(pFile, 0, &buffer[0], sample);
+    if (read) {
+        TSK_MD5_CTX md5Ctx;
+        TSK_MD5_Init(&md5Ctx);
+        TSK_MD5_Update(&md5Ctx, (unsigned char *) &buffer[0], (unsigned int) sample);
+        TSK_MD5_Final(guard, &md5Ctx);
+    }
+
+    pFile->seek(0, std::ios::beg);
+    return read;
+}
+
+/**
+* Tracks how much of a file has been hashed and, for files of at least the
+* checkpoint interval, writes checkpoints of the contexts so that hashing
+* can resume after an interruption. For files of at least the midstate
+* minimum, hashing continues from the midstate of the same path if the
+* content it covers is unchanged, and the final state becomes the new
+* midstate.
+*/
+class FileProgress
+{
+public:
+    explicit FileProgress(TskFile * pFile)
+        : m_pFile(pFile), m_fileId(pFile->getId()), m_fileSize((uint64_t) pFile->getSize()),
+          m_start(0), m_position(0), m_nextCheckpoint(0),
+          m_checkpointed(checkpointStore != NULL && m_fileSize >= checkpointInterval && contentAnalyzers.empty()),
+          m_guarded(false),
+          m_continued(midstateStore != NULL && m_fileSize >= midstateMinimum && contentAnalyzers.empty())
+    {
+        if (m_continued) {
+            m_path = pFile->getFullPath();
+            m_continued = !m_path.empty() && isAppendOnlyPath(m_path);
+        }
+    }
+
+    /**
+    * Prepares the contexts for hashing the file: restores them from the
+    * file's checkpoint if there is one and initializes them otherwise.
+    */
+    void begin(HashContexts& contexts)
+    {
+        m_start = 0;
+        initContexts(contexts);
+
+        // A file whose start cannot be read is not checkpointed.
+        if (m_checkpointed && !m_guarded) {
+            m_checkpointed = checkpointGuard(m_pFile, m_fileSize, m_guard);
+            m_guarded = true;
+        }
+
+        std::vector<unsigned char> state;
+        uint64_t offset = 0;
+        if (m_checkpointed && checkpointStore->load(m_fileId, m_fileSize, m_guard, offset, state) &&
+            restore(contexts, state)) {
+            m_start = offset;
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Resuming file id " << m_fileId << L" at byte " << offset
+                << L" from its checkpoint";
+            LOGINFO(msg.str());
+        }
+        else if (m_continued) {
+            resumeMidstate(contexts);
+        }
+
+        m_position = m_start;
+        m_nextCheckpoint = m_start + checkpointInterval;
+    }
+
+    /**
+    * Records that more bytes of the file have been hashed.
+    */
+    void advance(const HashContexts& contexts, uint64_t bytes)
+    {
+        m_position += bytes;
+        if (!m_checkpointed || m_position < m_nextCheckpoint || m_position >= m_fileSize)
+            return;
+
+        HASHCALC_TRACE_SPAN(checkpointSpan, "checkpoint", m_fileId);
+        if (!checkpointStore->save(m_fileId, m_fileSize, m_guard, m_position, save(contexts))) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Unable to write checkpoint of file id " << m_fileId;
+            LOGWARN(msg.str());
+        }
+        m_nextCheckpoint = m_position + checkpointInterval;
+    }
+
+    /**
+    * Saves the contexts as the midstate of the file's path, once all of its
+    * content has been hashed and before the digests are finalized.
+    */
+    void keep(const HashContexts& contexts)
+    {
+        if (!m_continued || m_position != m_fileSize || m_start == m_fileSize)
+            return;
+
+        Midstate midstate;
+        midstate.length = m_fileSize;
+        midstate.state = save(contexts);
+        if (!guardDigest(m_pFile, m_fileSize, midstate.guard) || !midstateStore->save(m_path, midstate)) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Unable to write midstate of file id " << m_fileId;
+            LOGWARN(msg.str());
+        }
+    }
+
+    /**
+    * Removes the checkpoint of the file once its digests are posted.
+    */
+    void end()
+    {
+        if (m_checkpointed)
+            checkpointStore->remove(m_fileId);
+    }
+
+    /// Offset hashing starts at; bytes before it are covered by the
+    /// restored contexts.
+    uint64_t start() const { return m_start; }
+
+private:
+    // The state is a byte with the configured hashes followed by the raw
+    // contexts; a checkpoint is only valid for the build that wrote it.
+    static std::vector<unsigned char> save(const HashContexts& contexts)
+    {
+        std::vector<unsigned char> state(1, (unsigned char) ((calculateMD5 ? 1 : 0) | (calculateSHA1 ? 2 : 0)));
+        if (calculateMD5 && calculateSHA1) {
+            const unsigned char * ctx = (const unsigned char *) &contexts.md5Sha1Ctx;
+            state.insert(state.end(), ctx, ctx + sizeof(contexts.md5Sha1Ctx));
+        }
+        else if (calculateMD5) {
+            const unsigned char * ctx = (const unsigned char *) &contexts.md5Ctx;
+            state.insert(state.end(), ctx, ctx + sizeof(contexts.md5Ctx));
+        }
+        else if (calculateSHA1) {
+            const unsigned char * ctx = (const unsigned char *) &contexts.sha1Ctx;
+            state.insert(state.end(), ctx, ctx + sizeof(contexts.sha1Ctx));
+        }
+        return state;
+    }
+
+    static bool restore(HashContexts& contexts, const std::vector<unsigned char>& state)
+    {
+        void * ctx = NULL;
+        size_t length = 0;
+        if (calculateMD5 && calculateSHA1) {
+            ctx = &contexts.md5Sha1Ctx;
+            length = sizeof(contexts.md5Sha1Ctx);
+        }
+        else if (calculateMD5) {
+            ctx = &contexts.md5Ctx;
+            length = sizeof(contexts.md5Ctx);
+        }
+        else if (calculateSHA1) {
+            ctx = &contexts.sha1Ctx;
+            length = sizeof(contexts.sha1Ctx);
+        }
+
+        if (state.size() != 1 + length || state[0] != ((calculateMD5 ? 1 : 0) | (calculateSHA1 ? 2 : 0)))
+            return false;
+
+        if (length > 0)
+            memcpy(ctx, &state[1], length);
+        return true;
+    }
+
+    /**
+    * Restores the contexts from the midstate of the file's path if the file
+    * has grown and the content the midstate covers has not changed.
+    */
+    void resumeMidstate(HashContexts& contexts)
+    {
+        // A file of the same length may have been rewritten in place, which
+        // the guard cannot tell; it is hashed in full.
+        Midstate midstate;
+        if (!midstateStore->load(m_path, midstate) || midstate.length == 0 || midstate.length >= m_fileSize)
+            return;
+
+        unsigned char guard[CONTENT_GUARD_LENGTH];
+        if (!guardDigest(m_pFile, midstate.length, guard) ||
+            memcmp(guard, midstate.guard, CONTENT_GUARD_LENGTH) != 0) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: File id " << m_fileId << L" changed since its midstate, hashing it in full";
+            LOGINFO(msg.str());
+            return;
+        }
+
+        if (!restore(contexts, midstate.state))
+            return;
+
+        m_start = midstate.length;
+        midstateFiles++;
+        midstateBytes += m_start;
+    }
+
+    TskFile * m_pFile;
+    uint64_t m_fileId;
+    uint64_t m_fileSize;
+    uint64_t m_start;
+    uint64_t m_position;
+    uint64_t m_nextCheckpoint;
+    bool m_checkpointed;
+    bool m_guarded;
+    unsigned char m_guard[CONTENT_GUARD_LENGTH];
+    bool m_continued;
+    std::string m_path;
+};
+
+/**
+* Removes the first bytes of content from a list of extents.
+*/
+static void skipExtents(std::vector<ImageExtent>& extents, uint64_t bytes)
+{
+    std::vector<ImageExtent>::iterator it = extents.begin();
+    while (it != extents.end() && bytes >= it->length) {
+        bytes -= it->length;
+        ++it;
+    }
+    extents.erase(extents.begin(), it);
+
+    if (bytes > 0 && !extents.empty()) {
+        extents.front().offset += bytes;
+        extents.front().length -= bytes;
+    }
+}
+
+/**
+* Hashes the content of a file by reading it through the TskFile interface.
+*/
+template <unsigned int Hashes>
+static void hashFileContent(TskFile * pFile, HashContexts& contexts, FileProgress& progress)
+{
+    // file buffer
+    static const uint32_t FILE_BUFFER_SIZE = 32768;
+    char buffer[FILE_BUFFER_SIZE];
+
+    ssize_t bytesRead = 0;
+    const uint64_t fileId = pFile->getId();
+
+    if (progress.start() > 0)
+        pFile->seek((TSK_OFF_T) progress.start(), std::ios::beg);
+
+    // Read file content into buffer and write it to the DigestOutputStream.
+    do 
+    {
+        {
+            HASHCALC_TRACE_SPAN(readSpan, "read", fileId);
+            bytesRead = pFile->read(buffer, FILE_BUFFER_SIZE);
+        }
+        if (bytesRead > 0) {
+            updateContexts<Hashes>(contexts, (unsigned char *) buffer, (size_t) bytesRead, fileId);
+            progress.advance(contexts, (uint64_t) bytesRead);
+            readBytes += bytesRead;
+        }
+    } while (bytesRead > 0);
+}
+
+// Files up to this size are read with a single read of their whole content.
+static const uint64_t SMALL_FILE_SIZE = 16384;
+
+/**
+* Hashes the content of a small file with one read of exactly its size, so
+* that no second read is needed to find the end of the file and the digests
+* are updated once with the whole content.
+*
+* @returns false if the read returned less than the file's size. The file
+* is positioned at its start again and the contexts are unchanged.
+*/
+template <unsigned int Hashes>
+static bool hashSmallContent(TskFile * pFile, HashContexts& contexts)
+{
+    char buffer[SMALL_FILE_SIZE];
+    const size_t size = (size_t) pFile->getSize();
+    const uint64_t fileId = pFile->getId();
+
+    if (size > 0) {
+        ssize_t bytesRead;
+        {
+            HASHCALC_TRACE_SPAN(readSpan, "read", fileId);
+            bytesRead = pFile->read(buffer, size);
+        }
+        if (bytesRead != (ssize_t) size) {
+            pFile->seek(0, std::ios::beg);
+            return false;
+        }
+    }
+
+    updateContexts<Hashes>(contexts, (unsigned char *) buffer, size, fileId);
+    readBytes += size;
+    return true;
+}
+
+/**
+* Hashes the content of a file directly from the memory mapped image, if
+* the file's content is stored in plain runs of sectors inside the image.
+*
+* @returns false if the file has to be read through the TskFile interface
+* instead. The contexts have to be prepared again in that case.
+*/
+template <unsigned int Hashes>
+static bool hashMappedContent(TskFile * pFile, HashContexts& contexts, FileProgress& progress)
+{
+    const uint64_t fileId = pFile->getId();
+
+    std::vector<ImageExtent>& extents = fileExtents;
+    if (!getFileExtents(fileId, (uint64_t) pFile->getSize(), extents) || !rawImage->contains(extents))
+        return false;
+    skipExtents(extents, progress.start());
+
+    for (std::vector<ImageExtent>::const_iterator it = extents.begin(); it != extents.end(); ++it) {
+        uint64_t offset = it->offset;
+        uint64_t remaining = it->length;
+
+        while (remaining > 0) {
+            size_t length = remaining < RawImage::MAX_MAP_LENGTH ? (size_t) remaining : RawImage::MAX_MAP_LENGTH;
+            const unsigned char * data;
+            {
+                HASHCALC_TRACE_SPAN(mapSpan, "map", fileId);
+                data = rawImage->map(offset, length);
+            }
+            if (data == NULL)
+                return false;
+
+            updateContexts<Hashes>(contexts, data, length, fileId);
+            progress.advance(contexts, length);
+            offset += length;
+            remaining -= length;
+        }
+    }
+
+    mappedBytes += (uint64_t) pFile->getSize() - progress.start();
+    return true;
+}
+
+/**
+* Hashes the content of a file with direct reads of the image that bypass
+* the page cache, if the file's content is stored in plain runs of sectors
+* inside the image. Reads start and end on DIRECT_IO_ALIGNMENT boundaries;
+* the bytes before and after the file's content in the first and last
+* block of a run are skipped.
+*
+* @returns false if the file has to be read through the TskFile interface
+* instead. The contexts have to be prepared again in that case.
+*/
+template <unsigned int Hashes>
+static bool hashDirectContent(TskFile * pFile, HashContexts& contexts, FileProgress& progress)
+{
+    const uint64_t fileId = pFile->getId();
+    const uint64_t alignment = RawImage::DIRECT_IO_ALIGNMENT;
+
+    std::vector<ImageExtent>& extents = fileExtents;
+    if (!getFileExtents(fileId, (uint64_t) pFile->getSize(), extents) || !rawImage->contains(extents))
+        return false;
+    skipExtents(extents, progress.start());
+
+    PooledBuffer buffer(*directBuffers);
+    if (buffer.get() == NULL)
+        return false;
+
+    for (std::vector<ImageExtent>::const_iterator it = extents.begin(); it != extents.end(); ++it) {
+        uint64_t offset = it->offset;
+        uint64_t remaining = it->length;
+
+        while (remaining > 0) {
+            uint64_t alignedOffset = offset - offset % alignment;
+            size_t head = (size_t) (offset - alignedOffset);
+
+            // Round the read up to whole blocks; the tail past the end of
+            // the run is read but not hashed.
+            uint64_t wanted = (head + remaining + alignment - 1) / alignment * alignment;
+            size_t length = wanted < DIRECT_READ_LENGTH ? (size_t) wanted : DIRECT_READ_LENGTH;
+
+            size_t bytesRead = 0;
+            bool success;
+            {
+                HASHCALC_TRACE_SPAN(readSpan, "readDirect", fileId);
+                success = rawImage->readDirect(alignedOffset, buffer.get(), length, bytesRead);
+            }
+            if (!success || bytesRead <= head)
+                return false;
+
+            size_t usable = bytesRead - head;
+            if (usable > remaining)
+                usable = (size_t) remaining;
+
+            updateContexts<Hashes>(contexts, buffer.get() + head, usable, fileId);
+            progress.advance(contexts, usable);
+            offset += usable;
+            remaining -= usable;
+        }
+    }
+
+    directBytes += (uint64_t) pFile->getSize() - progress.start();
+    return true;
+}
+
+/**
+* Closes the raw image and logs how much content was hashed in place.
+*/
+static void closeRawImage()
+{
+    if (rawImage == NULL)
+        return;
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Hashed " << mappedBytes << L" bytes from the mapped image, "
+        << directBytes << L" bytes in direct reads, " << batchReadBytes << L" bytes in batch reads and "
+        << readBytes << L" bytes through file reads";
+    LOGINFO(msg.str());
+
+    delete directBuffers;
+    directBuffers = NULL;
+    delete rawImage;
+    rawImage = NULL;
+}
+
+/**
+* Splits the module argument string into tokens separated by spaces or commas.
+*/
+static std::vector<std::string> tokenizeArguments(const std::string& args)
+{
+    std::vector<std::string> tokens;
+    std::string::size_type start = args.find_first_not_of(" ,");
+    while (start != std::string::npos) {
+        std::string::size_type end = args.find_first_of(" ,", start);
+        tokens.push_back(args.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        start = args.find_first_not_of(" ,", end);
+    }
+    return tokens;
+}
+
+/**
+* Splits a "NAME=value" argument token into its name and value.
+*
+* @returns false if the token does not contain a value.
+*/
+static bool splitOption(const std::string& token, std::string& name, std::string& value)
+{
+    std::string::size_type pos = token.find('=');
+    if (pos == std::string::npos)
+        return false;
+    name = token.substr(0, pos);
+    value = token.substr(pos + 1);
+    return true;
+}
+
+/**
+* Posts a hash value of a file to the image database, either directly or
+* through the batched writer if one is configured.
+*
+* @param fileId Id of the file.
+* @param pFile The file, or NULL if it is no longer open.
+*/
+static void postHash(uint64_t fileId, TskFile * pFile, TskImgDB::HASH_TYPE hashType, const char * hash)
+{
+    if (resultWriter != NULL) {
+        resultWriter->post(fileId, hashType, hash);
+        return;
+    }
+
+    HASHCALC_TRACE_SPAN(setHashSpan, "setHash", fileId);
+    if (pFile != NULL)
+        pFile->setHash(hashType, hash);
+    else
+        TskServices::Instance().getImgDB().setHash(fileId, hashType, hash);
+}
+
+/**
+* Compares the digests calculated for a file with the hash values stored
+* for it and logs a mismatch.
+*
+* @param fileId Id of the file.
+* @param pFile The file, or NULL if it is no longer open.
+*/
+static void verifyDigests(uint64_t fileId, TskFile * pFile, const FileDigests& digests)
+{
+    HASHCALC_TRACE_SPAN(verifySpan, "verify", fileId);
+
+    std::auto_ptr<TskFile> storedFile;
+    if (pFile == NULL) {
+        storedFile.reset(TskServices::Instance().getFileManager().getFile(fileId));
+        pFile = storedFile.get();
+    }
+
+    std::string storedMD5 = digests.hasMD5 ? pFile->getHash(TskImgDB::MD5) : std::string();
+    std::string storedSHA1 = digests.hasSHA1 ? pFile->getHash(TskImgDB::SHA1) : std::string();
+
+    bool stopped = digestVerifier->stopped();
+    if (digestVerifier->check(fileId, pFile->getFullPath(), digests, storedMD5, storedSHA1) == DigestVerifier::MISMATCHED) {
+        std::wstringstream msg;
+        msg << L"HashCalcModule: File id " << fileId << L" (" << pFile->getFullPath().c_str()
+            << L") does not match its stored hash values";
+        LOGWARN(msg.str());
+
+        if (!stopped && digestVerifier->stopped())
+            LOGWARN("HashCalcModule: Mismatch limit reached, remaining files are not verified");
+    }
+}
+
+/**
+* Posts the digests calculated for a file: as text to the image database
+* and, if configured, in binary form to the digest store. In verify mode
+* the digests are compared with the stored hash values instead. Either
+* way the file joins its group in the duplicate index, if there is one,
+* and files waiting for a file stored in the same extents get the same
+* digests.
+*
+* @param fileId Id of the file.
+* @param pFile The file, or NULL if it is no longer open.
+*/
+static void postDigests(uint64_t fileId, TskFile * pFile, const FileDigests& digests)
+{
+    if (sharedExtents != NULL) {
+        std::vector<SharedExtentIndex::Waiter> waiters;
+        sharedExtents->complete(fileId, digests, waiters);
+        for (std::vector<SharedExtentIndex::Waiter>::const_iterator it = waiters.begin(); it != waiters.end(); ++it)
+            postDigests(it->fileId, NULL, digests);
+    }
+
+    if (duplicateIndex != NULL)
+        duplicateIndex->add(digests.hasSHA1 ? digests.sha1 : digests.md5, fileId);
+
+    if (digestVerifier != NULL) {
+        verifyDigests(fileId, pFile, digests);
+        return;
+    }
+
+    if (digestStore != NULL)
+        digestStore->append(fileId, digests);
+
+    if (!postDigestText)
+        return;
+
+    if (digests.hasMD5) {
+        char md5TextBuff[2 * FileDigests::MD5_LENGTH + 1];
+        digestToHex(digests.md5, FileDigests::MD5_LENGTH, md5TextBuff);
+        postHash(fileId, pFile, TskImgDB::MD5, md5TextBuff);
+    }
+
+    if (digests.hasSHA1) {
+        char textBuff[2 * FileDigests::SHA1_LENGTH + 1];
+        digestToHex(digests.sha1, FileDigests::SHA1_LENGTH, textBuff);
+        postHash(fileId, pFile, TskImgDB::SHA1, textBuff);
+    }
+}
+
+/**
+* Calculates and posts the digests of a file. Instantiated for each
+* combination of hashes so that the read loops and the finalization call
+* the digest functions directly.
+*/
+template <unsigned int Hashes>
+static void hashFileWith(TskFile * pFile)
+{
+    const uint64_t fileId = pFile->getId();
+
+    PooledObject<HashContexts> pooledContexts(contextPool);
+    HashContexts& contexts = *pooledContexts;
+    FileProgress progress(pFile);
+    progress.begin(contexts);
+
+    bool hashed = false;
+    if (hashFromMappedImage)
+        hashed = hashMappedContent<Hashes>(pFile, contexts, progress);
+    else if (directBuffers != NULL)
+        hashed = hashDirectContent<Hashes>(pFile, contexts, progress);
+
+    if (!hashed) {
+        // Start over, from the checkpoint if the failed path wrote one.
+        if (hashFromMappedImage || directBuffers != NULL)
+            progress.begin(contexts);
+
+        if (progress.start() > 0 || (uint64_t) pFile->getSize() > SMALL_FILE_SIZE ||
+            !hashSmallContent<Hashes>(pFile, contexts))
+            hashFileContent<Hashes>(pFile, contexts, progress);
+    }
+
+    progress.keep(contexts);
+
+    FileDigests digests;
+    finalContexts<Hashes>(contexts, digests, fileId, pFile);
+
+    postDigests(fileId, pFile, digests);
+    progress.end();
+}
+
+typedef void (*HashFileFunction)(TskFile * pFile);
+
+static const HashFileFunction HASH_FILE_FUNCTIONS[HASH_COMBINATIONS] = HASHCALC_VARIANTS(hashFileWith);
+
+// The variant of hashFileWith() for the configured hashes; chosen when the
+// module is initialized.
+static HashFileFunction hashFileVariant = HASH_FILE_FUNCTIONS[WITH_MD5];
+
+/**
+* Calculates and posts the digests of a file.
+*/
+static void hashFile(TskFile * pFile)
+{
+    hashFileVariant(pFile);
+}
+
+/**
+* Adds an analyzer to those that receive the content of every file.
+*
+* @returns false if the analyzer is NULL or already registered.
+*/
+static bool addContentAnalyzer(ContentAnalyzer * analyzer)
+{
+    if (analyzer == NULL ||
+        std::find(contentAnalyzers.begin(), contentAnalyzers.end(), analyzer) != contentAnalyzers.end())
+        return false;
+
+    // Pooled contexts get consumers for all analyzers when they are used
+    // next.
+    contextPool.clear();
+    contentAnalyzers.push_back(analyzer);
+    hashFileVariant = HASH_FILE_FUNCTIONS[enabledHashes(true)];
+    return true;
+}
+
+/**
+* Removes an analyzer and deletes the consumers it created.
+*
+* @returns false if the analyzer is not registered.
+*/
+static bool removeContentAnalyzer(ContentAnalyzer * analyzer)
+{
+    std::vector<ContentAnalyzer *>::iterator it =
+        std::find(contentAnalyzers.begin(), contentAnalyzers.end(), analyzer);
+    if (it == contentAnalyzers.end())
+        return false;
+
+    contextPool.clear();
+    contentAnalyzers.erase(it);
+    hashFileVariant = HASH_FILE_FUNCTIONS[enabledHashes(true)];
+    return true;
+}
+
+/**
+* Unregisters and deletes the built-in content analyzers.
+*/
+static void stopContentAnalyzers()
+{
+    removeContentAnalyzer(entropyAnalyzer);
+    delete entropyAnalyzer;
+    entropyAnalyzer = NULL;
+
+    removeContentAnalyzer(fileTypeAnalyzer);
+    delete fileTypeAnalyzer;
+    fileTypeAnalyzer = NULL;
+
+    removeContentAnalyzer(archiveAnalyzer);
+    delete archiveAnalyzer;
+    archiveAnalyzer = NULL;
+}
+
+/**
+* Calculates and posts the digests of a file the module no longer holds an
+* open TskFile for.
+*
+* @returns false if the file could not be hashed.
+*/
+static bool hashStoredFile(uint64_t fileId)
+{
+    try
+    {
+        std::auto_ptr<TskFile> pFile(TskServices::Instance().getFileManager().getFile(fileId));
+        pFile->open();
+        hashFile(pFile.get());
+        pFile->close();
+    }
+    catch (std::exception& ex)
+    {
+        std::wstringstream msg;
+        msg << L"HashCalcModule - Error processing file id " << fileId << L": " << ex.what();
+        LOGERROR(msg.str());
+        return false;
+    }
+    return true;
+}
+
+/**
+* Hashes pending files as soon as all reads of their content completed.
+*/
+class PendingFileHasher : public BatchReadListener
+{
+public:
+    PendingFileHasher(std::vector<size_t>& outstanding, std::vector<bool>& failed)
+        : m_outstandingReads(outstanding), m_failed(failed) {}
+
+    virtual void readCompleted(const BatchReadRequest& request, bool success)
+    {
+        size_t index = request.tag;
+        if (!success)
+            m_failed[index] = true;
+
+        if (--m_outstandingReads[index] > 0 || m_failed[index])
+            return;
+
+        const PendingFile& file = pendingFiles[index];
+        try
+        {
+            PooledObject<HashContexts> pooledContexts(contextPool);
+            HashContexts& contexts = *pooledContexts;
+            initContexts(contexts);
+            updateContexts(contexts, &batchBuffers[index * SMALL_FILE_LIMIT], (size_t) file.size, file.fileId);
+
+            FileDigests digests;
+            finalContexts(contexts, digests, file.fileId, NULL);
+            postDigests(file.fileId, NULL, digests);
+            batchReadBytes += file.size;
+        }
+        catch (std::exception& ex)
+        {
+            std::wstringstream msg;
+            msg << L"HashCalcModule - Error processing file id " << file.fileId << L": " << ex.what();
+            LOGERROR(msg.str());
+            deferredFailures++;
+        }
+    }
+
+private:
+    std::vector<size_t>& m_outstandingReads;
+    std::vector<bool>& m_failed;
+};
+
+/**
+* Orders batch reads by image offset.
+*/
+static bool compareReadOffsets(const BatchReadRequest& a, const BatchReadRequest& b)
+{
+    return a.offset < b.offset;
+}
+
+/**
+* Reads the content of all pending files in one batch and hashes them.
+* Files whose reads fail are hashed through TskFile instead.
+*/
+static void hashPendingFiles()
+{
+    if (pendingCount == 0)
+        return;
+
+    std::vector<BatchReadRequest>& requests = batchRequests;
+    requests.clear();
+    outstandingReads.assign(pendingCount, 0);
+    failedReads.assign(pendingCount, false);
+
+    for (size_t i = 0; i < pendingCount; i++) {
+        unsigned char * slot = &batchBuffers[i * SMALL_FILE_LIMIT];
+        const std::vector<ImageExtent>& extents = pendingFiles[i].extents;
+
+        for (std::vector<ImageExtent>::const_iterator it = extents.begin(); it != extents.end(); ++it) {
+            BatchReadRequest request;
+            request.offset = it->offset;
+            request.length = (uint32_t) it->length;
+            request.buffer = slot;
+            request.tag = i;
+            requests.push_back(request);
+            slot += it->length;
+        }
+        outstandingReads[i] = extents.size();
+    }
+
+    // Issue the reads in image order so the device can stream through them.
+    std::sort(requests.begin(), requests.end(), compareReadOffsets);
+
+    {
+        HASHCALC_TRACE_SPAN(batchSpan, "batchRead", pendingFiles[0].fileId);
+        PendingFileHasher hasher(outstandingReads, failedReads);
+        batchReader->readAll(requests, hasher);
+    }
+
+    // Hashing a failed file may defer nothing new, but take the count
+    // first so the entries are free again either way.
+    size_t count = pendingCount;
+    pendingCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (failedReads[i] && !hashStoredFile(pendingFiles[i].fileId))
+            deferredFailures++;
+    }
+}
+
+/**
+* Defers hashing of a small file stored in plain sector runs of the raw
+* image until a batch of such files has been collected.
+*
+* @returns false if the file has to be hashed right away.
+*/
+static bool deferSmallFile(TskFile * pFile)
+{
+    uint64_t size = (uint64_t) pFile->getSize();
+    if (size == 0 || size > SMALL_FILE_LIMIT)
+        return false;
+
+    PendingFile& file = pendingFiles[pendingCount];
+    file.fileId = pFile->getId();
+    file.size = size;
+    if (!getFileExtents(file.fileId, size, file.extents) || !rawImage->contains(file.extents))
+        return false;
+
+    if (++pendingCount >= batchFiles)
+        hashPendingFiles();
+    return true;
+}
+
+/**
+* Hashes the remaining pending files and stops the batch reader.
+*/
+static void stopBatchReader()
+{
+    if (batchReader == NULL)
+        return;
+
+    hashPendingFiles();
+    delete batchReader;
+    batchReader = NULL;
+    batchBuffers.clear();
+}
+
+/**
+* Hashes the files the scheduler releases.
+*
+* @param drain true to release all files, false to release files only
+* while the window is full.
+*/
+static void hashScheduledFiles(bool drain)
+{
+    while (scheduler->full() || (drain && !scheduler->empty())) {
+        if (!hashStoredFile(scheduler->next()))
+            deferredFailures++;
+    }
+}
+
+/**
+* Hands a file to the scheduler. Files without a sector map are not
+* scheduled.
+*
+* @returns false if the file has to be hashed right away.
+*/
+static bool scheduleFile(TskFile * pFile)
+{
+    std::vector<ImageExtent> extents;
+    if (!getFileExtents(pFile->getId(), (uint64_t) pFile->getSize(), extents))
+        return false;
+
+    scheduler->add(pFile->getId(), extents);
+    hashScheduledFiles(false);
+    return true;
+}
+
+/**
+* Hashes the remaining scheduled files, logs the seeks that scheduling
+* saved and stops the scheduler.
+*/
+static void stopScheduler()
+{
+    if (scheduler == NULL)
+        return;
+
+    hashScheduledFiles(true);
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Scheduled " << scheduler->files() << L" files: "
+        << scheduler->seeks() << L" seeks over " << scheduler->seekDistance() << L" bytes, against "
+        << scheduler->unscheduledSeeks() << L" seeks over " << scheduler->unscheduledSeekDistance()
+        << L" bytes in database order";
+    LOGINFO(msg.str());
+
+    delete scheduler;
+    scheduler = NULL;
+}
+
+/**
+* Hashes the files of the single pass as their content streams by.
+*/
+class SweepHasher : public ImageSweepListener
+{
+public:
+    SweepHasher()
+        : m_contexts(imageSweep->files(), (HashContexts *) NULL)
+    {
+        initContexts(m_imageContexts, false);
+    }
+
+    ~SweepHasher()
+    {
+        for (size_t i = 0; i < m_contexts.size(); i++) {
+            if (m_contexts[i] != NULL)
+                contextPool.release(m_contexts[i]);
+        }
+    }
+
+    virtual void fileData(size_t file, const unsigned char * data, size_t length)
+    {
+        if (m_contexts[file] == NULL) {
+            m_contexts[file] = contextPool.acquire();
+            initContexts(*m_contexts[file]);
+        }
+        updateContexts(*m_contexts[file], data, length, imageSweep->fileId(file));
+    }
+
+    virtual void fileCompleted(size_t file)
+    {
+        const uint64_t fileId = imageSweep->fileId(file);
+        HashContexts * contexts = m_contexts[file];
+        m_contexts[file] = NULL;
+
+        try
+        {
+            FileDigests digests;
+            finalContexts(*contexts, digests, fileId, NULL);
+            postDigests(fileId, NULL, digests);
+        }
+        catch (std::exception& ex)
+        {
+            std::wstringstream msg;
+            msg << L"HashCalcModule - Error processing file id " << fileId << L": " << ex.what();
+            LOGERROR(msg.str());
+            deferredFailures++;
+        }
+        contextPool.release(contexts);
+    }
+
+    virtual void fileFailed(size_t file)
+    {
+        if (m_contexts[file] != NULL) {
+            contextPool.release(m_contexts[file]);
+            m_contexts[file] = NULL;
+        }
+        m_failed.push_back(imageSweep->fileId(file));
+    }
+
+    virtual void imageData(const unsigned char * data, size_t length)
+    {
+        updateContexts(m_imageContexts, data, length, 0);
+    }
+
+    /// Ids of the files that could not be read in the pass.
+    const std::vector<uint64_t>& failed() const { return m_failed; }
+
+    /// Contexts of the whole image hash.
+    HashContexts& imageContexts() { return m_imageContexts; }
+
+private:
+    HashContexts m_imageContexts;
+
+    // Contexts of the files whose content is being passed on, by file
+    // index; NULL for files that have not started or are done.
+    std::vector<HashContexts *> m_contexts;
+    std::vector<uint64_t> m_failed;
+};
+
+/**
+* Adds a file to the single pass. Files without a sector map are not
+* added.
+*
+* @returns false if the file has to be hashed right away.
+*/
+static bool sweepFile(TskFile * pFile)
+{
+    std::vector<ImageExtent> extents;
+    if (!getFileExtents(pFile->getId(), (uint64_t) pFile->getSize(), extents))
+        return false;
+
+    imageSweep->addFile(pFile->getId(), extents);
+    return true;
+}
+
+/**
+* Compares one digest of the whole image with its acquisition hash.
+*
+* @returns false if they differ.
+*/
+static bool compareImageDigest(const char * name, bool calculated, const unsigned char * digest,
+    bool expected, const unsigned char * expectedDigest, size_t length)
+{
+    if (!expected)
+        return true;
+
+    std::wstringstream msg;
+    if (!calculated) {
+        msg << L"HashCalcModule: The image " << name << L" is not calculated and cannot be verified";
+        LOGWARN(msg.str());
+        return true;
+    }
+
+    char text[FileDigests::SHA1_LENGTH * 2 + 1];
+    char expectedText[FileDigests::SHA1_LENGTH * 2 + 1];
+    digestToHex(digest, length, text);
+    digestToHex(expectedDigest, length, expectedText);
+
+    if (memcmp(digest, expectedDigest, length) != 0) {
+        msg << L"HashCalcModule: Image " << name << L" mismatch: calculated " << text
+            << L", acquisition hash " << expectedText;
+        LOGERROR(msg.str());
+        return false;
+    }
+
+    msg << L"HashCalcModule: Image " << name << L" verified: " << text;
+    LOGINFO(msg.str());
+    return true;
+}
+
+/**
+* Finishes the whole image hash, logs it with the throughput of the pass
+* and compares it with the acquisition hashes.
+*
+* @returns false if the image could not be read completely or a digest
+* does not match.
+*/
+static bool verifyImageDigests(HashContexts& contexts, Poco::Timestamp::TimeDiff elapsed)
+{
+    if (!imageSweep->imageComplete()) {
+        std::wstringstream msg;
+        msg << L"HashCalcModule: The image could not be read completely; hashed "
+            << imageSweep->imageBytes() << L" bytes";
+        LOGERROR(msg.str());
+        return false;
+    }
+
+    FileDigests digests;
+    finalContexts(contexts, digests, 0, NULL);
+
+    double seconds = (double) elapsed / Poco::Timestamp::resolution();
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Hashed the image (" << imageSweep->imageBytes() << L" bytes) in "
+        << seconds << L" s";
+    if (seconds > 0)
+        msg << L" (" << (imageSweep->imageBytes() / seconds / (1024 * 1024)) << L" MiB/s)";
+    LOGINFO(msg.str());
+
+    if (!expectedImageDigests.hasMD5 && !expectedImageDigests.hasSHA1) {
+        LOGWARN("HashCalcModule: No acquisition hash to verify the image hash against");
+        return true;
+    }
+
+    bool md5Matches = compareImageDigest("MD5", digests.hasMD5, digests.md5,
+        expectedImageDigests.hasMD5, expectedImageDigests.md5, FileDigests::MD5_LENGTH);
+    bool sha1Matches = compareImageDigest("SHA-1", digests.hasSHA1, digests.sha1,
+        expectedImageDigests.hasSHA1, expectedImageDigests.sha1, FileDigests::SHA1_LENGTH);
+    return md5Matches && sha1Matches;
+}
+
+/**
+* Runs the single pass over the image, hashing the files collected for it
+* and, if requested, the whole image, and stops the pass. Files that could
+* not be read in the pass are hashed through TskFile.
+*
+* @returns false if the whole image hash could not be verified.
+*/
+static bool runImageSweep()
+{
+    if (imageSweep == NULL)
+        return true;
+
+    SweepHasher hasher;
+    Poco::Timestamp started;
+    {
+        HASHCALC_TRACE_SPAN(sweepSpan, "imageSweep", 0);
+        imageSweep->run(hasher);
+    }
+    Poco::Timestamp::TimeDiff elapsed = started.elapsed();
+
+    const std::vector<uint64_t>& failed = hasher.failed();
+    for (std::vector<uint64_t>::const_iterator it = failed.begin(); it != failed.end(); ++it) {
+        if (!hashStoredFile(*it))
+            deferredFailures++;
+    }
+
+    if (sweepFiles) {
+        std::wstringstream msg;
+        msg << L"HashCalcModule: Hashed " << imageSweep->files() << L" files in a single pass, reading "
+            << imageSweep->bytesRead() << L" bytes; " << imageSweep->bytesStashed()
+            << L" bytes were read out of order and stashed, " << imageSweep->bytesSpilled()
+            << L" of them in a temporary file";
+        LOGINFO(msg.str());
+    }
+
+    bool verified = !hashImage || verifyImageDigests(hasher.imageContexts(), elapsed);
+
+    delete imageSweep;
+    imageSweep = NULL;
+    return verified;
+}
+
+/**
+* Logs and resets the number of deferred files that could not be hashed.
+*
+* @returns false if there were any.
+*/
+static bool reportDeferredFailures()
+{
+    if (deferredFailures == 0)
+        return true;
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: " << deferredFailures << L" deferred files could not be hashed";
+    LOGERROR(msg.str());
+    deferredFailures = 0;
+    return false;
+}
+
+/**
+* Looks up the layout of a file in the shared extent index and posts the
+* digests of the file stored in the same extents if it was hashed.
+*
+* @returns false if the file has to be hashed, true if it got the digests
+* or waits for them.
+*/
+static bool copySharedDigests(TskFile * pFile)
+{
+    // Analyzers need the content of every file.
+    if (!contentAnalyzers.empty())
+        return false;
+
+    const uint64_t fileId = pFile->getId();
+    const uint64_t size = (uint64_t) pFile->getSize();
+
+    std::vector<ImageExtent> extents;
+    if (!getFileExtents(fileId, size, extents))
+        return false;
+
+    FileDigests digests;
+    switch (sharedExtents->lookup(fileId, size, extents, digests)) {
+    case SharedExtentIndex::LOOKUP_HASHED:
+        postDigests(fileId, pFile, digests);
+        return true;
+    case SharedExtentIndex::LOOKUP_PENDING:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+* Hashes a file the way run() does: with the digests of a file in the same
+* extents, in the single pass, a batch read or the scheduler window if one
+* takes it, right away otherwise.
+*/
+static void dispatchFile(TskFile * pFile)
+{
+    if (sharedExtents != NULL && copySharedDigests(pFile))
+        return;
+
+    if (sweepFiles && sweepFile(pFile))
+        return;
+
+    if (batchReader != NULL && deferSmallFile(pFile))
+        return;
+
+    if (scheduler != NULL && scheduleFile(pFile))
+        return;
+
+    hashFile(pFile);
+}
+
+/**
+* Reads the first dedupHeadLength bytes of a file and sets its head digest.
+*
+* @returns false if the file is shorter than that or cannot be read.
+*/
+static bool readHeadDigest(DedupCandidate& candidate, std::vector<char>& buffer)
+{
+    std::auto_ptr<TskFile> pFile(TskServices::Instance().getFileManager().getFile(candidate.fileId));
+    pFile->open();
+
+    size_t length = 0;
+    while (length < dedupHeadLength) {
+        ssize_t bytesRead = pFile->read(&buffer[length], dedupHeadLength - length);
+        if (bytesRead <= 0)
+            break;
+        length += (size_t) bytesRead;
+    }
+    pFile->close();
+    readBytes += length;
+
+    if (length < dedupHeadLength)
+        return false;
+
+    TSK_MD5_CTX md5Ctx;
+    TSK_MD5_Init(&md5Ctx);
+    TSK_MD5_Update(&md5Ctx, (unsigned char *) &buffer[0], (unsigned int) length);
+    TSK_MD5_Final(candidate.head, &md5Ctx);
+    return true;
+}
+
+/**
+* Sets the head digests of the candidates larger than the head, one group
+* of equal size at a time. If a head of a group cannot be read, the whole
+* group keeps empty heads so that none of its files is ruled out.
+*/
+static void checkHeads(std::vector<DedupCandidate>& candidates)
+{
+    std::vector<char> buffer(dedupHeadLength);
+
+    size_t start = 0;
+    while (start < candidates.size()) {
+        size_t end = start + 1;
+        while (end < candidates.size() && candidates[end].size == candidates[start].size)
+            end++;
+
+        // For smaller files the head is the whole content.
+        if (candidates[start].size > dedupHeadLength) {
+            for (size_t i = start; i < end; i++) {
+                bool read = false;
+                try
+                {
+                    read = readHeadDigest(candidates[i], buffer);
+                }
+                catch (std::exception& ex)
+                {
+                    std::wstringstream msg;
+                    msg << L"HashCalcModule - Error reading the head of file id " << candidates[i].fileId << L": " << ex.what();
+                    LOGWARN(msg.str());
+                }
+
+                if (!read) {
+                    for (size_t j = start; j < end; j++)
+                        memset(candidates[j].head, 0, DedupCandidate::HEAD_DIGEST_LENGTH);
+                    break;
+                }
+            }
+        }
+        start = end;
+    }
+}
+
+/**
+* Drops the files collected in dedup-only mode that cannot have a
+* duplicate and hashes the others. Files that cannot be hashed are counted
+* as deferred failures.
+*/
+static void hashDedupCandidates()
+{
+    if (dedupFilter == NULL)
+        return;
+
+    dedupFilter->keepCollisions();
+    uint64_t sizeDroppedFiles = dedupFilter->droppedFiles();
+    uint64_t sizeDroppedBytes = dedupFilter->droppedBytes();
+
+    std::vector<DedupCandidate>& candidates = dedupFilter->candidates();
+    if (dedupHeadLength > 0) {
+        checkHeads(candidates);
+        dedupFilter->keepCollisions();
+    }
+
+    uint64_t candidateBytes = 0;
+    for (size_t i = 0; i < candidates.size(); i++)
+        candidateBytes += candidates[i].size;
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Dedup-only: " << sizeDroppedFiles << L" of " << dedupFilter->files()
+        << L" files are empty or have a unique size (" << sizeDroppedBytes << L" bytes not read)";
+    if (dedupHeadLength > 0)
+        msg << L", " << dedupFilter->droppedFiles() - sizeDroppedFiles << L" have a unique head ("
+            << dedupFilter->droppedBytes() - sizeDroppedBytes << L" bytes not hashed)";
+    msg << L"; hashing " << candidates.size() << L" files (" << candidateBytes << L" bytes)";
+    LOGINFO(msg.str());
+
+    for (size_t i = 0; i < candidates.size(); i++) {
+        uint64_t fileId = candidates[i].fileId;
+        try
+        {
+            std::auto_ptr<TskFile> pFile(TskServices::Instance().getFileManager().getFile(fileId));
+            pFile->open();
+            dispatchFile(pFile.get());
+            pFile->close();
+        }
+        catch (std::exception& ex)
+        {
+            std::wstringstream msg;
+            msg << L"HashCalcModule - Error processing file id " << fileId << L": " << ex.what();
+            LOGERROR(msg.str());
+            deferredFailures++;
+        }
+    }
+
+    delete dedupFilter;
+    dedupFilter = NULL;
+}
+
+/**
+* Hashes the files still waiting for a file in the same extents that was
+* not hashed, logs how much reading the index avoided and drops it.
+*/
+static void stopSharedExtents()
+{
+    if (sharedExtents == NULL)
+        return;
+
+    std::vector<SharedExtentIndex::Waiter> waiters;
+    sharedExtents->abandon(waiters);
+    for (std::vector<SharedExtentIndex::Waiter>::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+        if (!hashStoredFile(it->fileId))
+            deferredFailures++;
+    }
+
+    std::vector<std::string> images = TskServices::Instance().getImgDB().getImageNames();
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Copied the digests of " << sharedExtents->copiedFiles()
+        << L" files stored in the same extents as a hashed file, avoiding " << sharedExtents->copiedBytes()
+        << L" bytes of reads";
+    if (!images.empty())
+        msg << L" in " << images[0].c_str();
+    if (sharedExtents->forgotten() > 0)
+        msg << L"; " << sharedExtents->forgotten() << L" layouts were forgotten to stay within SHARED_EXTENTS_MEMORY";
+    LOGINFO(msg.str());
+
+    delete sharedExtents;
+    sharedExtents = NULL;
+}
+
+/**
+* Writes the groups of duplicate files to the report, logs how many there
+* are and drops the index.
+*
+* @returns false if the report could not be written.
+*/
+static bool reportDuplicates()
+{
+    if (duplicateIndex == NULL)
+        return true;
+
+    bool written = duplicateIndex->report();
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Found " << duplicateIndex->groups() << L" groups of duplicate files among "
+        << duplicateIndex->files() << L" files; " << duplicateIndex->duplicates() << L" files are extra copies";
+    if (duplicateIndex->spills() > 0) {
+        msg << L" (the index was spilled " << duplicateIndex->spills() << L" times";
+        if (duplicateIndex->splits() > 0)
+            msg << L" and " << duplicateIndex->splits() << L" spill partitions were split again";
+        msg << L")";
+    }
+    LOGINFO(msg.str());
+    if (duplicateIndex->oversized() > 0) {
+        std::wstringstream warning;
+        warning << L"HashCalcModule: The files of a few digests exceeded DUPLICATE_MEMORY in "
+            << duplicateIndex->oversized() << L" spill partitions, which were grouped beyond it";
+        LOGWARN(warning.str());
+    }
+    if (!written)
+        LOGERROR("HashCalcModule: Unable to write the duplicate file report");
+
+    delete duplicateIndex;
+    duplicateIndex = NULL;
+    return written;
+}
+
+/**
+* Logs how many files continued from their midstate and closes the
+* midstate store.
+*/
+static void closeMidstateStore()
+{
+    if (midstateStore == NULL)
+        return;
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Continued " << midstateFiles << L" files from their midstate, skipping "
+        << midstateBytes << L" bytes; saved " << midstateStore->saved() << L" midstates";
+    LOGINFO(msg.str());
 
-static bool calculateMD5 = true;
-static bool calculateSHA1 = false;
-
-static const char hexMap[] = "0123456789abcdef";
+    delete midstateStore;
+    midstateStore = NULL;
+}
+
+/**
+* Closes the digest store and the read-only view of it, if they are open.
+*/
+static void closeDigestStore()
+{
+    delete digestStore;
+    digestStore = NULL;
+    delete digestReader;
+    digestReader = NULL;
+}
+
+/**
+* Looks up the digests of a file in the digest store and converts them to
+* text. While the module hashes files the store it appends to is used;
+* afterwards the store is opened for reading on the first lookup.
+*
+* @returns 1 if the file has a row, 0 if it has none and -1 if no digest
+* store is configured or it cannot be opened.
+*/
+static int lookupStoredDigests(uint64_t fileId, char * md5Text, char * sha1Text)
+{
+    DigestStore * store = digestStore;
+    if (store == NULL) {
+        if (digestStorePrefix.empty())
+            return -1;
+
+        if (digestReader == NULL) {
+            digestReader = new DigestStore();
+            if (!digestReader->open(digestStorePrefix)) {
+                delete digestReader;
+                digestReader = NULL;
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Unable to open digest store " << digestStorePrefix.c_str();
+                LOGERROR(msg.str());
+                return -1;
+            }
+        }
+        store = digestReader;
+    }
+
+    FileDigests digests;
+    if (!store->lookup(fileId, digests))
+        return 0;
+
+    if (md5Text != NULL) {
+        if (digests.hasMD5)
+            digestToHex(digests.md5, FileDigests::MD5_LENGTH, md5Text);
+        else
+            md5Text[0] = '\0';
+    }
+    if (sha1Text != NULL) {
+        if (digests.hasSHA1)
+            digestToHex(digests.sha1, FileDigests::SHA1_LENGTH, sha1Text);
+        else
+            sha1Text[0] = '\0';
+    }
+    return 1;
+}
+
+/**
+* Writes the hash values still waiting for a batch and drops the writer.
+*
+* @returns false if some hash values could not be written.
+*/
+static bool stopResultWriter()
+{
+    if (resultWriter == NULL)
+        return true;
+
+    size_t failures = resultWriter->stop();
+    delete resultWriter;
+    resultWriter = NULL;
+
+    if (failures > 0) {
+        std::wstringstream msg;
+        msg << L"HashCalcModule: " << failures << L" hash values could not be written to the database";
+        LOGERROR(msg.str());
+        return false;
+    }
+    return true;
+}
+
+/**
+* Logs the outcome of verify mode and stops it.
+*
+* @returns false if any file does not match its stored hash values.
+*/
+static bool reportVerification()
+{
+    if (digestVerifier == NULL)
+        return true;
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Verified " << digestVerifier->matched() + digestVerifier->mismatched()
+        << L" files: " << digestVerifier->matched() << L" match, " << digestVerifier->mismatched()
+        << L" do not match; " << digestVerifier->unverified() << L" files had no stored hash values";
+    if (digestVerifier->skipped() > 0)
+        msg << L" and " << digestVerifier->skipped() << L" were skipped after the mismatch limit";
+    if (digestVerifier->mismatched() > 0)
+        LOGERROR(msg.str());
+    else
+        LOGINFO(msg.str());
+
+    bool matched = digestVerifier->mismatched() == 0;
+    delete digestVerifier;
+    digestVerifier = NULL;
+    return matched;
+}
+
+/**
+* Stops the threads hashing Merkle tree leaves. The store stays open so
+* that ranges can still be verified after the module is finalized.
+*/
+static void stopMerklePool()
+{
+    if (merklePool == NULL)
+        return;
+
+    std::wstringstream msg;
+    msg << L"HashCalcModule: Wrote " << merkleStore->saved() << L" Merkle trees";
+    LOGINFO(msg.str());
+
+    // Pooled contexts hold tree builders that use the leaf threads.
+    contextPool.clear();
+    delete merklePool;
+    merklePool = NULL;
+}
+
+/**
+* Checks a byte range of a file against its stored Merkle tree, rereading
+* only the leaves the range covers.
+*
+* @returns 1 if the range matches, 0 if it does not and -1 if it cannot be
+* checked.
+*/
+static int verifyFileRange(uint64_t fileId, uint64_t offset, uint64_t length)
+{
+    MerkleTree tree;
+    if (merkleStore == NULL || !merkleStore->load(fileId, tree)) {
+        std::wstringstream msg;
+        msg << L"HashCalcModule: No valid Merkle tree for file id " << fileId;
+        LOGERROR(msg.str());
+        return -1;
+    }
+
+    if (length == 0 || offset > tree.fileSize || length > tree.fileSize - offset) {
+        std::wstringstream msg;
+        msg << L"HashCalcModule: Range " << offset << L"+" << length << L" is outside of file id " << fileId;
+        LOGERROR(msg.str());
+        return -1;
+    }
+
+    try
+    {
+        std::auto_ptr<TskFile> pFile(TskServices::Instance().getFileManager().getFile(fileId));
+        if ((uint64_t) pFile->getSize() != tree.fileSize) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: File id " << fileId << L" has changed size since its Merkle tree was computed";
+            LOGWARN(msg.str());
+            return 0;
+        }
+
+        uint64_t first = offset / tree.leafSize;
+        uint64_t last = (offset + length - 1) / tree.leafSize;
+
+        pFile->open();
+        pFile->seek((TSK_OFF_T) (first * tree.leafSize), std::ios::beg);
+
+        std::vector<char> leaf(tree.leafSize);
+        for (uint64_t i = first; i <= last; i++) {
+            // The last leaf may be short; read it completely in any case.
+            size_t leafLength = (size_t) (tree.fileSize - i * tree.leafSize < tree.leafSize ?
+                tree.fileSize - i * tree.leafSize : tree.leafSize);
+            size_t filled = 0;
+            while (filled < leafLength) {
+                ssize_t bytesRead = pFile->read(&leaf[filled], leafLength - filled);
+                if (bytesRead <= 0)
+                    break;
+                filled += (size_t) bytesRead;
+            }
+
+            unsigned char digest[SHA256_LENGTH];
+            hashMerkleLeaf((const unsigned char *) &leaf[0], filled, digest);
+            if (filled != leafLength || memcmp(digest, &tree.leaves[(size_t) i * SHA256_LENGTH], SHA256_LENGTH) != 0) {
+                pFile->close();
+
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Leaf " << i << L" of file id " << fileId
+                    << L" does not match its Merkle tree";
+                LOGWARN(msg.str());
+                return 0;
+            }
+        }
+        pFile->close();
+    }
+    catch (std::exception& ex)
+    {
+        std::wstringstream msg;
+        msg << L"HashCalcModule - Error verifying file id " << fileId << L": " << ex.what();
+        LOGERROR(msg.str());
+        return -1;
+    }
+    return 1;
+}
 
 extern "C" 
 {
@@ -37,7 +2257,7 @@ extern "C"
     */
     TSK_MODULE_EXPORT const char *name()
     {
-        return "HashCalc";
+        return MODULE_NAME.c_str();
     }
 
     /**
@@ -57,7 +2277,7 @@ extern "C"
     */
     TSK_MODULE_EXPORT const char *version()
     {
-        return "1.0.1";
+        return "1.1.0";
     }
 
     /**
@@ -65,37 +2285,210 @@ extern "C"
     * caller from a pipeline configuration file, that determine what hashes the 
     * module calculates for a given file.
     *
-    * @param args Valid values are "MD5", "SHA1" or the empty string which will 
-    * result in just "MD5" being calculated. Hash names can be in any order,
-    * separated by spaces or commas. 
+    * @param args Valid values are "MD5", "SHA1" or the empty string which
+    * will result in just "MD5" being calculated. Hash names can be in any
+    * order, separated by spaces or commas. "TRACE=<path>" additionally
+    * records a Chrome trace-event timeline of reads, digest updates and
+    * database writes to the given file; "TRACE_EVENTS=<n>" sets how many
+    * events each thread buffers before writing them out. "DB_BATCH=<n>" posts
+    * hash values in transactions of n values. "DIGEST_STORE=<prefix>" also
+    * stores binary digests in column files with the given path prefix and
+    * "DIGEST_TEXT=0" stops posting the text form to the database. "MMAP=1"
+    * hashes files stored in plain sector runs of a raw image directly from a
+    * memory mapped view of the image file. "BATCH_READ=<n>" collects n small
+    * files of a raw image and reads them together with "READ_DEPTH=<n>" reads
+    * in flight, using "READ_ENGINE=URING" or "READ_ENGINE=THREADS".
+    * "DIRECT_IO=1" reads such files past the page cache instead.
+    * "SCHEDULE_WINDOW=<n>" holds back up to n files and hashes them in the
+    * order of their content in the image. "SINGLE_PASS=1" collects all files
+    * and hashes them in one pass over the image when the module is finalized.
+    * "IMAGE_HASH=1" also hashes the whole image in that pass, or in a second
+    * read of the image without "SINGLE_PASS=1", and compares it with the
+    * acquisition hash stored in an E01 image or given as "IMAGE_MD5=<hex>"
+    * and "IMAGE_SHA1=<hex>". "CHECKPOINT_DIR=<path>" saves the hash state of
+    * large files every "CHECKPOINT_INTERVAL=<MiB>" so hashing can resume
+    * after a crash. Checkpoints are not written with MERKLE or any content
+    * analysis. "MIDSTATE_DIR=<path>" keeps the hash state of files of at
+    * least "MIDSTATE_MIN=<MiB>" whose path matches one of the ';' separated
+    * patterns of "MIDSTATE_PATHS=<patterns>" and, in a later image, continues
+    * from it if the file grew and the start and the old end of the file are
+    * unchanged. "MERKLE" calculates a Merkle tree of SHA-256 digests over
+    * leaves of "MERKLE_LEAF=<KiB>" with "MERKLE_THREADS=<n>" threads and
+    * keeps it in "MERKLE_DIR=<path>". "VERIFY=1" compares the digests with
+    * the hash values stored in the database instead of posting them, records
+    * mismatches in "VERIFY_REPORT=<path>" and stops hashing after
+    * "VERIFY_STOP=<n>" mismatching files. "ENTROPY=1" also posts the entropy,
+    * chi-square and zero byte ratio of each file's content as blackboard
+    * attributes. "FILE_TYPE=1" posts the type of each file recognized from
+    * signatures in its first bytes, adding those of
+    * "FILE_TYPE_SIGNATURES=<path>" to the built-in ones. "ARCHIVE_MEMBERS=1"
+    * hashes the members of ZIP, GZIP and TAR files on a worker thread and
+    * posts their digests as attributes of the archive.
+    * "DUPLICATE_REPORT=<path>" groups files with the same digest as they are
+    * hashed and writes the groups to the given file when the module is
+    * finalized, spilling to temporary files beyond "DUPLICATE_MEMORY=<MiB>".
+    * "DEDUP_ONLY=1" only records the size of each file and, when the module
+    * is finalized, hashes just the files that share their size with another
+    * file and, with "DEDUP_HEAD=<KiB>", the digest of that many bytes at
+    * their start. "SHARED_EXTENTS=1" gives files stored in exactly the same
+    * extents as a file that was hashed the digests of that file instead of
+    * reading them again, remembering the layouts of hashed files in up to
+    * "SHARED_EXTENTS_MEMORY=<MiB>".
     * @return TskModule::OK if initialization arguments are valid, otherwise 
     * TskModule::FAIL.
     */
     TskModule::Status TSK_MODULE_EXPORT initialize(const char* arguments)
     {
         std::string args(arguments);
+        std::vector<std::string> tokens = tokenizeArguments(args);
 
-        // If the argument string is empty we calculate both hashes.
-        if (args.empty()) {
-            calculateMD5 = true;
-            calculateSHA1 = false;
-        }
-        else {
-            calculateMD5 = false;
-            calculateSHA1 = false;
+        std::string tracePath;
+        size_t traceEvents = DEFAULT_TRACE_EVENTS;
+        size_t dbBatch = 0;
+        std::string digestStorePath;
+        postDigestText = true;
+        bool useMappedImage = false;
+        bool useDirectIO = false;
+        size_t scheduleWindow = 0;
+        bool useSinglePass = false;
+        uint64_t singlePassStash = DEFAULT_SINGLE_PASS_STASH;
+        bool useImageHash = false;
+        FileDigests imageDigestArgs;
+        std::string checkpointDir;
+        uint64_t checkpointMiB = DEFAULT_CHECKPOINT_INTERVAL;
+        std::string midstateDir;
+        uint64_t midstateMiB = DEFAULT_MIDSTATE_MIN;
+        std::string midstatePaths;
+        std::string merkleDir;
+        uint32_t merkleLeafKiB = DEFAULT_MERKLE_LEAF;
+        size_t merkleThreads = Poco::Environment::processorCount();
+        bool useVerify = false;
+        std::string verifyReport;
+        std::string duplicateReport;
+        size_t duplicateMiB = DEFAULT_DUPLICATE_MEMORY;
+        bool useDedupOnly = false;
+        bool useSharedExtents = false;
+        size_t sharedExtentsMiB = DEFAULT_SHARED_EXTENTS_MEMORY;
+        dedupHeadLength = 0;
+        size_t verifyStop = 0;
+        bool detectFileType = false;
+        std::string signaturePath;
+        bool hashArchiveMembers = false;
+        size_t batchReadFiles = 0;
+        bool preferUring = true;
+        size_t readDepth = DEFAULT_READ_DEPTH;
+
+        calculateMD5 = false;
+        calculateSHA1 = false;
+        calculateMerkle = false;
+        calculateEntropy = false;
 
-            // If the argument string contains "MD5" we calculate an MD5 hash.
-            if (args.find(MD5_NAME) != std::string::npos) 
-                calculateMD5 = true;
+        for (std::vector<std::string>::const_iterator it = tokens.begin(); it != tokens.end(); ++it) {
+            std::string name, value;
+            bool valid = true;
 
-            // If the argument string contains "SHA1" we calculate a SHA1 hash.
-            if (args.find(SHA1_NAME) != std::string::npos) 
-                calculateSHA1 = true;
+            if (splitOption(*it, name, value)) {
+                if (name == TRACE_NAME && !value.empty())
+                    tracePath = value;
+                else if (name == TRACE_EVENTS_NAME && atol(value.c_str()) > 0)
+                    traceEvents = (size_t) atol(value.c_str());
+                else if (name == DB_BATCH_NAME && atol(value.c_str()) > 0)
+                    dbBatch = (size_t) atol(value.c_str());
+                else if (name == DIGEST_STORE_NAME && !value.empty())
+                    digestStorePath = value;
+                else if (name == DIGEST_TEXT_NAME && (value == "0" || value == "1"))
+                    postDigestText = value == "1";
+                else if (name == MMAP_NAME && (value == "0" || value == "1"))
+                    useMappedImage = value == "1";
+                else if (name == DIRECT_IO_NAME && (value == "0" || value == "1"))
+                    useDirectIO = value == "1";
+                else if (name == SCHEDULE_WINDOW_NAME && atol(value.c_str()) >= 0)
+                    scheduleWindow = (size_t) atol(value.c_str());
+                else if (name == SINGLE_PASS_NAME && (value == "0" || value == "1"))
+                    useSinglePass = value == "1";
+                else if (name == SINGLE_PASS_STASH_NAME && atol(value.c_str()) >= 0)
+                    singlePassStash = (uint64_t) atol(value.c_str());
+                else if (name == IMAGE_HASH_NAME && (value == "0" || value == "1"))
+                    useImageHash = value == "1";
+                else if (name == IMAGE_MD5_NAME && hexToDigest(value, imageDigestArgs.md5, FileDigests::MD5_LENGTH))
+                    imageDigestArgs.hasMD5 = true;
+                else if (name == IMAGE_SHA1_NAME && hexToDigest(value, imageDigestArgs.sha1, FileDigests::SHA1_LENGTH))
+                    imageDigestArgs.hasSHA1 = true;
+                else if (name == CHECKPOINT_DIR_NAME && !value.empty())
+                    checkpointDir = value;
+                else if (name == CHECKPOINT_INTERVAL_NAME && atol(value.c_str()) > 0)
+                    checkpointMiB = (uint64_t) atol(value.c_str());
+                else if (name == MIDSTATE_DIR_NAME && !value.empty())
+                    midstateDir = value;
+                else if (name == MIDSTATE_MIN_NAME && atol(value.c_str()) >= 0)
+                    midstateMiB = (uint64_t) atol(value.c_str());
+                else if (name == MIDSTATE_PATHS_NAME && !value.empty())
+                    midstatePaths = value;
+                else if (name == MERKLE_DIR_NAME && !value.empty())
+                    merkleDir = value;
+                else if (name == MERKLE_LEAF_NAME && atol(value.c_str()) > 0 && atol(value.c_str()) <= 1048576)
+                    merkleLeafKiB = (uint32_t) atol(value.c_str());
+                else if (name == MERKLE_THREADS_NAME && atol(value.c_str()) > 0)
+                    merkleThreads = (size_t) atol(value.c_str());
+                else if (name == VERIFY_NAME && (value == "0" || value == "1"))
+                    useVerify = value == "1";
+                else if (name == VERIFY_REPORT_NAME && !value.empty())
+                    verifyReport = value;
+                else if (name == DUPLICATE_REPORT_NAME && !value.empty())
+                    duplicateReport = value;
+                else if (name == DUPLICATE_MEMORY_NAME && atol(value.c_str()) > 0)
+                    duplicateMiB = (size_t) atol(value.c_str());
+                else if (name == SHARED_EXTENTS_NAME && (value == "0" || value == "1"))
+                    useSharedExtents = value == "1";
+                else if (name == SHARED_EXTENTS_MEMORY_NAME && atol(value.c_str()) > 0)
+                    sharedExtentsMiB = (size_t) atol(value.c_str());
+                else if (name == DEDUP_ONLY_NAME && (value == "0" || value == "1"))
+                    useDedupOnly = value == "1";
+                else if (name == DEDUP_HEAD_NAME && atol(value.c_str()) >= 0 && atol(value.c_str()) <= 1048576)
+                    dedupHeadLength = (size_t) atol(value.c_str()) * 1024;
+                else if (name == VERIFY_STOP_NAME && atol(value.c_str()) >= 0)
+                    verifyStop = (size_t) atol(value.c_str());
+                else if (name == ENTROPY_NAME && (value == "0" || value == "1"))
+                    calculateEntropy = value == "1";
+                else if (name == FILE_TYPE_NAME && (value == "0" || value == "1"))
+                    detectFileType = value == "1";
+                else if (name == ARCHIVE_MEMBERS_NAME && (value == "0" || value == "1"))
+                    hashArchiveMembers = value == "1";
+                else if (name == FILE_TYPE_SIGNATURES_NAME && !value.empty())
+                    signaturePath = value;
+                else if (name == BATCH_READ_NAME && atol(value.c_str()) >= 0)
+                    batchReadFiles = (size_t) atol(value.c_str());
+                else if (name == READ_ENGINE_NAME && (value == "URING" || value == "THREADS"))
+                    preferUring = value == "URING";
+                else if (name == READ_DEPTH_NAME && atol(value.c_str()) > 0)
+                    readDepth = (size_t) atol(value.c_str());
+                else
+                    valid = false;
+            }
+            // "MERKLE" calculates a Merkle tree digest.
+            else if (*it == MERKLE_NAME)
+                calculateMerkle = true;
+
+            // Other words are searched for the hash names, as they always
+            // were, so that arguments such as "MD5;SHA1" keep working.
+            else {
+                // If the argument string contains "MD5" we calculate an MD5 hash.
+                if (it->find(MD5_NAME) != std::string::npos)
+                    calculateMD5 = true;
+                else
+                    valid = false;
+
+                // If the argument string contains "SHA1" we calculate a SHA1 hash.
+                if (it->find(SHA1_NAME) != std::string::npos) {
+                    calculateSHA1 = true;
+                    valid = true;
+                }
+            }
 
-            // If neither hash is to be calculated it means that the arguments
-            // passed to the module were incorrect. We log an error message
-            // through the framework logging facility.
-            if (!calculateMD5 && !calculateSHA1) {
+            // Anything else means that the arguments passed to the module
+            // were incorrect. We log an error message through the framework
+            // logging facility.
+            if (!valid) {
                 std::wstringstream msg;
                 msg << L"Invalid arguments passed to hash module: " << args.c_str();
                 LOGERROR(msg.str());
@@ -103,12 +2496,398 @@ extern "C"
             }
         }
 
+        // If no hash was named we calculate just the MD5 hash.
+        if (!calculateMD5 && !calculateSHA1 && !calculateMerkle)
+            calculateMD5 = true;
+
         if (calculateMD5)
             LOGINFO("HashCalcModule: Configured to calculate MD5 hashes");
 
         if (calculateSHA1)
             LOGINFO("HashCalcModule: Configured to calculate SHA-1 hashes");
 
+        if (calculateMerkle && merkleDir.empty()) {
+            LOGERROR("HashCalcModule: MERKLE requires a MERKLE_DIR");
+            return TskModule::FAIL;
+        }
+
+        if (useVerify && (calculateMerkle || !digestStorePath.empty())) {
+            LOGERROR("HashCalcModule: VERIFY compares with the database and cannot be combined with MERKLE or DIGEST_STORE");
+            return TskModule::FAIL;
+        }
+
+        if (!postDigestText && digestStorePath.empty()) {
+            LOGERROR("HashCalcModule: DIGEST_TEXT=0 requires a DIGEST_STORE");
+            return TskModule::FAIL;
+        }
+
+        if (useMappedImage && useDirectIO) {
+            LOGERROR("HashCalcModule: MMAP and DIRECT_IO cannot be used together");
+            return TskModule::FAIL;
+        }
+
+        if (useSinglePass && (batchReadFiles > 0 || scheduleWindow > 0)) {
+            LOGERROR("HashCalcModule: SINGLE_PASS cannot be combined with BATCH_READ or SCHEDULE_WINDOW");
+            return TskModule::FAIL;
+        }
+
+        if (useDedupOnly && (duplicateReport.empty() || useVerify)) {
+            LOGERROR("HashCalcModule: DEDUP_ONLY needs DUPLICATE_REPORT and cannot be combined with VERIFY");
+            return TskModule::FAIL;
+        }
+
+        if (!midstateDir.empty() && midstatePaths.empty()) {
+            LOGERROR("HashCalcModule: MIDSTATE_DIR needs MIDSTATE_PATHS, the paths of files that are only appended to");
+            return TskModule::FAIL;
+        }
+
+        if (!duplicateReport.empty() && !calculateMD5 && !calculateSHA1) {
+            LOGERROR("HashCalcModule: DUPLICATE_REPORT needs MD5 or SHA1");
+            return TskModule::FAIL;
+        }
+
+        // The signature file is read and the report files are created
+        // before any state is changed, so that an unreadable or unwritable
+        // one leaves the module as it was.
+        std::auto_ptr<SignatureMatcher> matcher;
+        if (detectFileType) {
+            matcher.reset(new SignatureMatcher());
+            matcher->addDefaults();
+            if (!signaturePath.empty() && !matcher->load(signaturePath)) {
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Unable to read file signatures from " << signaturePath.c_str();
+                LOGERROR(msg.str());
+                return TskModule::FAIL;
+            }
+            matcher->compile();
+        }
+
+        std::auto_ptr<DuplicateIndex> newDuplicateIndex;
+        if (!duplicateReport.empty()) {
+            // Group by SHA-1 when it is calculated; files that share both
+            // digests are the same in any case.
+            size_t keyLength = calculateSHA1 ? FileDigests::SHA1_LENGTH : FileDigests::MD5_LENGTH;
+            newDuplicateIndex.reset(new DuplicateIndex(keyLength, duplicateMiB * 1024 * 1024));
+            if (!newDuplicateIndex->openReport(duplicateReport)) {
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Unable to create duplicate file report " << duplicateReport.c_str();
+                LOGERROR(msg.str());
+                return TskModule::FAIL;
+            }
+
+            unsigned char emptyDigest[DuplicateIndex::MAX_KEY_LENGTH];
+            hexToDigest(calculateSHA1 ? EMPTY_SHA1 : EMPTY_MD5, emptyDigest, keyLength);
+            newDuplicateIndex->ignore(emptyDigest);
+        }
+
+        std::auto_ptr<DigestVerifier> newDigestVerifier;
+        if (useVerify) {
+            newDigestVerifier.reset(new DigestVerifier(verifyStop));
+            if (!verifyReport.empty() && !newDigestVerifier->openReport(verifyReport)) {
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Unable to create verification report " << verifyReport.c_str();
+                LOGERROR(msg.str());
+                return TskModule::FAIL;
+            }
+        }
+
+#ifndef HASHCALC_NO_TRACE
+        // The trace being recorded is only closed once the threads that
+        // record into it are stopped, so the new trace file is just checked
+        // here, without truncating it.
+        if (!tracePath.empty()) {
+            FILE * traceFile = fopen(tracePath.c_str(), "a");
+            if (traceFile == NULL) {
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Unable to create trace file " << tracePath.c_str();
+                LOGERROR(msg.str());
+                return TskModule::FAIL;
+            }
+            fclose(traceFile);
+        }
+#endif
+
+        closeDigestStore();
+        digestStorePrefix = digestStorePath;
+        if (!digestStorePath.empty()) {
+            digestStore = new DigestStore();
+            if (!digestStore->create(digestStorePath, calculateMD5, calculateSHA1)) {
+                closeDigestStore();
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Unable to open digest store " << digestStorePath.c_str();
+                LOGERROR(msg.str());
+                return TskModule::FAIL;
+            }
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Storing binary digests in " << digestStorePath.c_str()
+                << L" (" << digestStore->rows() << L" existing rows)";
+            LOGINFO(msg.str());
+        }
+
+        stopBatchReader();
+        stopScheduler();
+        runImageSweep();
+        deferredFailures = 0;
+        closeRawImage();
+        mappedBytes = 0;
+        readBytes = 0;
+        batchReadBytes = 0;
+        directBytes = 0;
+        hashFromMappedImage = false;
+        if (useMappedImage || useDirectIO || batchReadFiles > 0 || useSinglePass || useImageHash) {
+            rawImage = new RawImage();
+            if (rawImage->openCaseImage()) {
+                hashFromMappedImage = useMappedImage;
+                if (useMappedImage) {
+                    std::wstringstream msg;
+                    msg << L"HashCalcModule: Hashing file content from the memory mapped image ("
+                        << rawImage->size() << L" bytes)";
+                    LOGINFO(msg.str());
+                }
+            }
+            else {
+                // Not an error: the module works on any image, just without
+                // direct access to it. The single pass reads other images
+                // through the framework.
+                if (useMappedImage || useDirectIO || batchReadFiles > 0)
+                    LOGWARN("HashCalcModule: The case image is not a single raw image file, MMAP, DIRECT_IO and BATCH_READ are ignored");
+                delete rawImage;
+                rawImage = NULL;
+            }
+        }
+
+        if (rawImage != NULL && useDirectIO) {
+            if (rawImage->openDirect()) {
+                directBuffers = new AlignedBufferPool(DIRECT_READ_LENGTH, RawImage::DIRECT_IO_ALIGNMENT);
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Hashing file content with direct reads of " << DIRECT_READ_LENGTH
+                    << L" bytes that bypass the page cache";
+                LOGINFO(msg.str());
+            }
+            else
+                LOGWARN("HashCalcModule: The case image cannot be opened for direct I/O, DIRECT_IO is ignored");
+        }
+
+        if (rawImage != NULL && batchReadFiles > 0) {
+            batchFiles = batchReadFiles;
+            batchBuffers.resize(batchFiles * SMALL_FILE_LIMIT);
+            pendingFiles.resize(batchFiles);
+            batchReader = BatchReader::create(*rawImage, preferUring, readDepth, &batchBuffers[0], batchBuffers.size());
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Reading files of up to " << SMALL_FILE_LIMIT << L" bytes in batches of "
+                << batchFiles << L" with " << batchReader->name() << L", " << readDepth << L" reads in flight";
+            LOGINFO(msg.str());
+        }
+
+        sweepFiles = useSinglePass;
+        hashImage = useImageHash;
+        if (useSinglePass || useImageHash)
+            imageSweep = new ImageSweep(rawImage, singlePassStash * 1024 * 1024);
+
+        if (useSinglePass) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Hashing files in a single pass over the image when the module is finalized"
+                << L" (stashing up to " << singlePassStash << L" MiB of out of order content in memory)";
+            LOGINFO(msg.str());
+        }
+
+        if (useImageHash) {
+            // Hashes given as arguments take precedence over those stored
+            // in the image.
+            FileDigests storedDigests;
+            uint64_t imageSize = rawImage != NULL ? rawImage->size() : 0;
+            uint64_t mediaSize = 0;
+            if (rawImage == NULL &&
+                readAcquisitionDigests(TskServices::Instance().getImgDB().getImageNames(), storedDigests, mediaSize))
+                imageSize = mediaSize;
+
+            expectedImageDigests = imageDigestArgs;
+            if (!expectedImageDigests.hasMD5 && storedDigests.hasMD5) {
+                expectedImageDigests.hasMD5 = true;
+                memcpy(expectedImageDigests.md5, storedDigests.md5, FileDigests::MD5_LENGTH);
+            }
+            if (!expectedImageDigests.hasSHA1 && storedDigests.hasSHA1) {
+                expectedImageDigests.hasSHA1 = true;
+                memcpy(expectedImageDigests.sha1, storedDigests.sha1, FileDigests::SHA1_LENGTH);
+            }
+
+            imageSweep->readWholeImage(imageSize);
+            LOGINFO(useSinglePass ?
+                "HashCalcModule: Hashing the whole image in the single pass" :
+                "HashCalcModule: Hashing the whole image in a second read when the module is finalized");
+        }
+
+        if (scheduleWindow > 0) {
+            scheduler = new ExtentScheduler(scheduleWindow);
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Hashing files in image order within a window of " << scheduleWindow << L" files";
+            LOGINFO(msg.str());
+        }
+
+        delete dedupFilter;
+        dedupFilter = NULL;
+
+        delete duplicateIndex;
+        duplicateIndex = newDuplicateIndex.release();
+        if (duplicateIndex != NULL) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Grouping duplicate files in " << duplicateReport.c_str()
+                << L" using up to " << duplicateMiB << L" MiB";
+            LOGINFO(msg.str());
+        }
+
+        if (useDedupOnly) {
+            dedupFilter = new SizeCollisionFilter();
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Dedup-only, hashing only files that share their size";
+            if (dedupHeadLength > 0)
+                msg << L" and their first " << dedupHeadLength / 1024 << L" KiB";
+            msg << L" with another file";
+            LOGINFO(msg.str());
+        }
+
+        delete digestVerifier;
+        digestVerifier = newDigestVerifier.release();
+        if (digestVerifier != NULL) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Verifying files against their stored hash values";
+            if (verifyStop > 0)
+                msg << L", stopping after " << verifyStop << L" mismatching files";
+            LOGINFO(msg.str());
+        }
+
+        stopMerklePool();
+        delete merkleStore;
+        merkleStore = NULL;
+        if (calculateMerkle) {
+            merkleStore = new MerkleStore(merkleDir);
+            merklePool = new MerkleHashPool(merkleThreads, merkleLeafKiB * 1024);
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Configured to calculate Merkle trees over " << merkleLeafKiB
+                << L" KiB leaves with " << merklePool->threads() << L" threads, kept in " << merkleDir.c_str();
+            LOGINFO(msg.str());
+        }
+
+        // Analyzers registered by other modules stay registered.
+        stopContentAnalyzers();
+        if (calculateEntropy) {
+            entropyAnalyzer = new EntropyAnalyzer(MODULE_NAME);
+            addContentAnalyzer(entropyAnalyzer);
+            LOGINFO("HashCalcModule: Configured to calculate the entropy of file content");
+        }
+
+        if (detectFileType) {
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Configured to detect file types with " << matcher->size()
+                << L" signatures in the first " << matcher->window() << L" bytes";
+            LOGINFO(msg.str());
+
+            fileTypeAnalyzer = new FileTypeAnalyzer(MODULE_NAME, matcher.release());
+            addContentAnalyzer(fileTypeAnalyzer);
+        }
+
+        if (hashArchiveMembers) {
+            archiveAnalyzer = new ArchiveAnalyzer(MODULE_NAME, calculateMD5, calculateSHA1);
+            addContentAnalyzer(archiveAnalyzer);
+#ifdef HAVE_LIBZ
+            LOGINFO("HashCalcModule: Configured to hash the members of ZIP, GZIP and TAR files");
+#else
+            LOGWARN("HashCalcModule: Built without zlib, ARCHIVE_MEMBERS only hashes the members of TAR files");
+#endif
+        }
+
+        hashFileVariant = HASH_FILE_FUNCTIONS[enabledHashes(true)];
+
+        delete checkpointStore;
+        checkpointStore = NULL;
+        checkpointInterval = checkpointMiB * 1024 * 1024;
+        if (!checkpointDir.empty() && (calculateMerkle || !contentAnalyzers.empty()))
+            LOGWARN("HashCalcModule: Merkle trees and content analysis cannot be checkpointed, CHECKPOINT_DIR is ignored");
+        else if (!checkpointDir.empty()) {
+            // The names of the image files tell cases apart, since file
+            // ids start over in every case.
+            std::vector<std::string> imageNames = TskServices::Instance().getImgDB().getImageNames();
+            std::string caseIdentity;
+            for (size_t i = 0; i < imageNames.size(); i++)
+                caseIdentity += imageNames[i] + "\n";
+            checkpointStore = new CheckpointStore(checkpointDir, caseIdentity);
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Checkpointing files every " << checkpointMiB << L" MiB in "
+                << checkpointDir.c_str();
+            LOGINFO(msg.str());
+        }
+
+        closeMidstateStore();
+        midstateFiles = 0;
+        midstateBytes = 0;
+        midstateMinimum = midstateMiB * 1024 * 1024;
+        if (!midstateDir.empty() && (calculateMerkle || !contentAnalyzers.empty()))
+            LOGWARN("HashCalcModule: Merkle trees and content analysis need all content, MIDSTATE_DIR is ignored");
+        else if (!midstateDir.empty()) {
+            midstateStore = new MidstateStore(midstateDir);
+            midstatePatterns.clear();
+            std::string::size_type start = 0;
+            while (start <= midstatePaths.size()) {
+                std::string::size_type end = midstatePaths.find(';', start);
+                if (end == std::string::npos)
+                    end = midstatePaths.size();
+                if (end > start)
+                    midstatePatterns.push_back(midstatePaths.substr(start, end - start));
+                start = end + 1;
+            }
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Continuing files of at least " << midstateMiB << L" MiB matching "
+                << midstatePaths.c_str() << L" from their midstate in " << midstateDir.c_str();
+            LOGINFO(msg.str());
+        }
+
+        delete sharedExtents;
+        sharedExtents = NULL;
+        if (useSharedExtents && (calculateMerkle || !contentAnalyzers.empty()))
+            LOGWARN("HashCalcModule: Merkle trees and content analysis need all content, SHARED_EXTENTS is ignored");
+        else if (useSharedExtents) {
+            sharedExtents = new SharedExtentIndex(sharedExtentsMiB * 1024 * 1024);
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Copying the digests of files stored in the same extents as a hashed file,"
+                << L" remembering hashed layouts in up to " << sharedExtentsMiB << L" MiB";
+            LOGINFO(msg.str());
+        }
+
+        stopResultWriter();
+        if (dbBatch > 0) {
+            resultWriter = new HashResultWriter(dbBatch);
+
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Writing hashes to the database in batches of " << dbBatch;
+            LOGINFO(msg.str());
+        }
+
+        HashCalcTrace::close();
+        if (!tracePath.empty()) {
+#ifdef HASHCALC_NO_TRACE
+            (void) traceEvents;
+            LOGWARN("HashCalcModule: Tracing was requested but is not compiled into this build");
+#else
+            if (!HashCalcTrace::open(tracePath, traceEvents)) {
+                std::wstringstream msg;
+                msg << L"HashCalcModule: Unable to create trace file " << tracePath.c_str();
+                LOGERROR(msg.str());
+                return TskModule::FAIL;
+            }
+            std::wstringstream msg;
+            msg << L"HashCalcModule: Writing trace events to " << tracePath.c_str();
+            LOGINFO(msg.str());
+#endif
+        }
+
         return TskModule::OK;
     }
 
@@ -118,6 +2897,11 @@ extern "C"
     * to read the contents of the file and post calculated hashes of the 
     * file contents to the database.
     *
+    * With BATCH_READ, SCHEDULE_WINDOW, SINGLE_PASS, DEDUP_ONLY or
+    * SHARED_EXTENTS a file may be held back and hashed after run() has
+    * returned for it, at the latest when the module is finalized; its hash
+    * values are not in the database until then.
+    *
     * @param pFile A pointer to a file for which the hash calculations are to be performed.
     * @returns TskModule::OK on success, TskModule::FAIL on error.
     */
@@ -134,62 +2918,22 @@ extern "C"
         if (pFile->getTypeId() == TskImgDB::IMGDB_FILES_TYPE_UNUSED)
             return TskModule::OK;
 
+        // Once verification has found enough mismatches the remaining
+        // files are not read at all.
+        if (digestVerifier != NULL && digestVerifier->stopped()) {
+            digestVerifier->skip();
+            return TskModule::OK;
+        }
+
         try 
         {
-            TSK_MD5_CTX md5Ctx;
-            TSK_SHA_CTX sha1Ctx;
-
-            if (calculateMD5)
-                TSK_MD5_Init(&md5Ctx);
-
-            if (calculateSHA1)
-                TSK_SHA_Init(&sha1Ctx);
-
-            // file buffer
-            static const uint32_t FILE_BUFFER_SIZE = 32768;
-            char buffer[FILE_BUFFER_SIZE];
-
-            ssize_t bytesRead = 0;
-
-            // Read file content into buffer and write it to the DigestOutputStream.
-            do 
-            {
-                bytesRead = pFile->read(buffer, FILE_BUFFER_SIZE);
-                if (bytesRead > 0) {
-                    if (calculateMD5)
-                        TSK_MD5_Update(&md5Ctx, (unsigned char *) buffer, (unsigned int) bytesRead);
-
-                    if (calculateSHA1)
-                        TSK_SHA_Update(&sha1Ctx, (unsigned char *) buffer, (unsigned int) bytesRead);                  
-                }
-            } while (bytesRead > 0);
-
-            if (calculateMD5) {
-                unsigned char md5Hash[16];
-                TSK_MD5_Final(md5Hash, &md5Ctx);
-
-                char md5TextBuff[33];            
-                for (int i = 0; i < 16; i++) {
-                    md5TextBuff[2 * i] = hexMap[(md5Hash[i] >> 4) & 0xf];
-                    md5TextBuff[2 * i + 1] = hexMap[md5Hash[i] & 0xf];
-                }
-                md5TextBuff[32] = '\0';
-                pFile->setHash(TskImgDB::MD5, md5TextBuff);
-            }
-
-            if (calculateSHA1) {
-                unsigned char sha1Hash[20];
-                TSK_SHA_Final(sha1Hash, &sha1Ctx);
-
-                char textBuff[41];            
-                for (int i = 0; i < 20; i++) {
-                    textBuff[2 * i] = hexMap[(sha1Hash[i] >> 4) & 0xf];
-                    textBuff[2 * i + 1] = hexMap[sha1Hash[i] & 0xf];
-                }
-                textBuff[40] = '\0';
-                pFile->setHash(TskImgDB::SHA1, textBuff);
+            // In dedup-only mode nothing is read until all sizes are known.
+            if (dedupFilter != NULL) {
+                dedupFilter->add(pFile->getId(), (uint64_t) pFile->getSize());
+                return TskModule::OK;
             }
 
+            dispatchFile(pFile);
         }
         catch (TskException& tskEx)
         {
@@ -210,14 +2954,111 @@ extern "C"
     }
 
     /**
-    * Module cleanup function. This module does not need to free any 
-    * resources allocated during initialization or execution.
+    * Module cleanup function. Hashes the files collected in dedup-only mode
+    * that can have a duplicate, hashes files still waiting for a batch read,
+    * held back by the scheduler or collected for the single pass, hashes and
+    * verifies the whole image if requested, hashes files that waited in vain
+    * for a file in the same extents, stops the built-in content analyzers and
+    * their threads, reports the outcome of verify mode, writes the duplicate
+    * file report, writes out any hash values still waiting for a batch,
+    * closes the digest store and the raw image, closes the midstate store,
+    * stops the Merkle leaf threads and writes any trace events that are still
+    * buffered.
     *
-    * @returns TskModule::OK
+    * @returns TskModule::OK on success, TskModule::FAIL if some files could
+    * not be hashed, some files do not match their stored hash values, some
+    * hash values or the duplicate file report could not be written or the
+    * image hash does not match its acquisition hash.
     */
     TskModule::Status TSK_MODULE_EXPORT finalize()
     {
-        return TskModule::OK;
+        hashDedupCandidates();
+        stopBatchReader();
+        stopScheduler();
+        bool verified = runImageSweep();
+        stopSharedExtents();
+
+        // Every file has been hashed; the archive member thread must not
+        // outlive the module's reports and trace.
+        stopContentAnalyzers();
+        bool hashed = reportDeferredFailures();
+        bool matched = reportVerification();
+        bool grouped = reportDuplicates();
+        bool written = stopResultWriter();
+        closeDigestStore();
+        closeRawImage();
+        delete checkpointStore;
+        checkpointStore = NULL;
+        closeMidstateStore();
+        stopMerklePool();
+        HashCalcTrace::close();
+        return verified && hashed && matched && grouped && written ? TskModule::OK : TskModule::FAIL;
+    }
+
+    /**
+    * Checks a byte range of a file against the Merkle tree stored for it
+    * when the module was initialized with MERKLE. Only the leaves covering
+    * the range are read again; the stored leaves are checked against the
+    * stored root first.
+    *
+    * @param fileId Id of the file.
+    * @param offset Start of the range in the file.
+    * @param length Length of the range in bytes.
+    * @returns 1 if the range matches the tree, 0 if it does not and -1 if
+    * it cannot be checked.
+    */
+    TSK_MODULE_EXPORT int verifyRange(uint64_t fileId, uint64_t offset, uint64_t length)
+    {
+        return verifyFileRange(fileId, offset, length);
+    }
+
+    /**
+    * Returns the hash values of a file as hexadecimal text from the digest
+    * store the module was initialized with, which is the only place they
+    * are kept with DIGEST_TEXT=0. The digests are converted only for the
+    * file asked for. Must not be called while the module is being
+    * initialized or finalized.
+    *
+    * @param fileId Id of the file.
+    * @param md5Text Receives the MD5 as 32 characters and a terminating
+    * null, or an empty string if the store has no MD5 column; may be NULL.
+    * @param sha1Text Receives the SHA-1 as 40 characters and a terminating
+    * null, or an empty string if the store has no SHA-1 column; may be NULL.
+    * @returns 1 if the store has the file, 0 if it does not and -1 if no
+    * digest store is configured or it cannot be opened.
+    */
+    TSK_MODULE_EXPORT int lookupDigests(uint64_t fileId, char * md5Text, char * sha1Text)
+    {
+        return lookupStoredDigests(fileId, md5Text, sha1Text);
+    }
+
+    /**
+    * Registers an analysis that receives the content of every file the
+    * module hashes from then on, so that another module does not have to
+    * read it again. The content is passed to the analyzer's consumers
+    * in the read buffers, while the hashing of each chunk waits. Must not
+    * be called while files are being hashed.
+    *
+    * @param analyzer The analyzer; owned by the caller, which has to
+    * unregister it before deleting it.
+    * @returns 0 on success, 1 if the analyzer is NULL or already
+    * registered.
+    */
+    TSK_MODULE_EXPORT int registerContentAnalyzer(ContentAnalyzer * analyzer)
+    {
+        return addContentAnalyzer(analyzer) ? 0 : 1;
+    }
+
+    /**
+    * Unregisters an analyzer and deletes the consumers it created. Must not
+    * be called while files are being hashed.
+    *
+    * @param analyzer The analyzer.
+    * @returns 0 on success, 1 if the analyzer is not registered.
+    */
+    TSK_MODULE_EXPORT int unregisterContentAnalyzer(ContentAnalyzer * analyzer)
+    {
+        return removeContentAnalyzer(analyzer) ? 0 : 1;
     }
 }
 
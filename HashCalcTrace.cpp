@@ -0,0 +1,219 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file HashCalcTrace.cpp
+* Contains the implementation of the Chrome trace-event recorder.
+*/
+
+#include "HashCalcTrace.h"
+
+#ifndef HASHCALC_NO_TRACE
+
+// System includes
+#include <cstdio>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define HASHCALC_THREAD_LOCAL __declspec(thread)
+#else
+#include <time.h>
+#include <unistd.h>
+#define HASHCALC_THREAD_LOCAL __thread
+#endif
+
+// Poco includes
+#include "Poco/Mutex.h"
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char * name;
+        uint64_t start;
+        uint64_t end;
+        uint64_t fileId;
+    };
+
+    struct ThreadBuffer
+    {
+        uint32_t tid;
+        std::vector<TraceEvent> events;
+        size_t count;
+        Poco::FastMutex lock;
+    };
+
+    // Guards the trace file and the list of thread buffers.
+    Poco::FastMutex traceLock;
+    FILE * traceFile = NULL;
+    bool firstEvent = true;
+    size_t bufferCapacity = 0;
+    std::vector<ThreadBuffer *> buffers;
+    uint64_t traceStart = 0;
+    int processId = 0;
+
+    // Incremented every time a trace is opened so that threads notice that
+    // the buffer they cached belongs to a previous trace.
+    volatile unsigned int generation = 0;
+    volatile bool traceEnabled = false;
+
+    HASHCALC_THREAD_LOCAL ThreadBuffer * threadBuffer = NULL;
+    HASHCALC_THREAD_LOCAL unsigned int threadGeneration = 0;
+
+    /**
+    * Writes the buffered events of a thread to the trace file. Callers must
+    * hold both traceLock and the buffer lock.
+    */
+    void writeEvents(ThreadBuffer& buffer)
+    {
+        if (traceFile == NULL)
+            return;
+
+        for (size_t i = 0; i < buffer.count; i++) {
+            const TraceEvent& ev = buffer.events[i];
+            uint64_t ts = ev.start - traceStart;
+            uint64_t dur = ev.end - ev.start;
+
+            fprintf(traceFile,
+                "%s{\"name\":\"%s\",\"cat\":\"HashCalc\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                "\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"args\":{\"fileId\":%llu}}",
+                firstEvent ? "\n" : ",\n", ev.name, processId, buffer.tid,
+                (unsigned long long)(ts / 1000), (unsigned int)(ts % 1000),
+                (unsigned long long)(dur / 1000), (unsigned int)(dur % 1000),
+                (unsigned long long)ev.fileId);
+            firstEvent = false;
+        }
+        buffer.count = 0;
+    }
+
+    /**
+    * @returns The buffer of the calling thread for the current trace, or
+    * NULL if no trace is open.
+    */
+    ThreadBuffer * getThreadBuffer()
+    {
+        if (threadBuffer != NULL && threadGeneration == generation)
+            return threadBuffer;
+
+        Poco::FastMutex::ScopedLock guard(traceLock);
+        if (!traceEnabled)
+            return NULL;
+
+        ThreadBuffer * buffer = new ThreadBuffer();
+        buffer->tid = (uint32_t) buffers.size() + 1;
+        buffer->events.resize(bufferCapacity);
+        buffer->count = 0;
+        buffers.push_back(buffer);
+
+        threadBuffer = buffer;
+        threadGeneration = generation;
+        return buffer;
+    }
+}
+
+namespace HashCalcTrace
+{
+    uint64_t now()
+    {
+#ifdef _WIN32
+        static LARGE_INTEGER frequency = { 0 };
+        if (frequency.QuadPart == 0)
+            QueryPerformanceFrequency(&frequency);
+
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return (uint64_t) ((double) counter.QuadPart * 1.0e9 / (double) frequency.QuadPart);
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#endif
+    }
+
+    bool open(const std::string& path, size_t eventsPerThread)
+    {
+        close();
+
+        Poco::FastMutex::ScopedLock guard(traceLock);
+
+        traceFile = fopen(path.c_str(), "w");
+        if (traceFile == NULL)
+            return false;
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", traceFile);
+        firstEvent = true;
+        bufferCapacity = eventsPerThread > 0 ? eventsPerThread : 1;
+        traceStart = now();
+#ifdef _WIN32
+        processId = _getpid();
+#else
+        processId = (int) getpid();
+#endif
+        generation++;
+        traceEnabled = true;
+        return true;
+    }
+
+    void close()
+    {
+        Poco::FastMutex::ScopedLock guard(traceLock);
+
+        if (!traceEnabled)
+            return;
+        traceEnabled = false;
+
+        for (std::vector<ThreadBuffer *>::iterator it = buffers.begin(); it != buffers.end(); ++it) {
+            {
+                Poco::FastMutex::ScopedLock bufferGuard((*it)->lock);
+                writeEvents(**it);
+            }
+            // The calling thread and any thread that records again later
+            // detect the generation change before touching this buffer.
+            delete *it;
+        }
+        buffers.clear();
+
+        fputs("\n]}\n", traceFile);
+        fclose(traceFile);
+        traceFile = NULL;
+        generation++;
+    }
+
+    bool enabled()
+    {
+        return traceEnabled;
+    }
+
+    void record(const char * name, uint64_t start, uint64_t end, uint64_t fileId)
+    {
+        ThreadBuffer * buffer = getThreadBuffer();
+        if (buffer == NULL)
+            return;
+
+        buffer->lock.lock();
+        if (buffer->count == buffer->events.size()) {
+            // Locks are always taken in the order traceLock, buffer lock.
+            buffer->lock.unlock();
+            Poco::FastMutex::ScopedLock guard(traceLock);
+            buffer->lock.lock();
+            writeEvents(*buffer);
+        }
+
+        TraceEvent& ev = buffer->events[buffer->count++];
+        ev.name = name;
+        ev.start = start;
+        ev.end = end;
+        ev.fileId = fileId;
+        buffer->lock.unlock();
+    }
+}
+
+#endif
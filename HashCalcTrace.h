@@ -0,0 +1,111 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file HashCalcTrace.h
+* Contains the interface of the trace recorder that writes timelines of the
+* hash calculation module in the Chrome trace-event (Perfetto compatible)
+* JSON format.
+*/
+
+#ifndef _HASHCALC_TRACE_H
+#define _HASHCALC_TRACE_H
+
+// System includes
+#include <string>
+#include <cstddef>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* Records begin/end spans of the module's reads, digest updates, digest
+* finalization and database writes. Every thread that records a span gets
+* its own event buffer, so recording never contends with other threads;
+* a buffer is written to the trace file when it fills up and when the
+* trace is closed. Tracing is compiled out entirely when
+* HASHCALC_NO_TRACE is defined.
+*/
+namespace HashCalcTrace
+{
+#ifndef HASHCALC_NO_TRACE
+    /**
+    * Starts a trace.
+    *
+    * @param path Path of the JSON trace file to create.
+    * @param eventsPerThread Number of spans buffered per thread before
+    * the buffer is written to the file.
+    * @returns true if the trace file could be created.
+    */
+    bool open(const std::string& path, size_t eventsPerThread);
+
+    /**
+    * Writes all buffered spans, terminates the JSON document and closes the
+    * trace file. Does nothing if no trace is open. Other threads must have
+    * stopped recording before the trace is closed.
+    */
+    void close();
+
+    /**
+    * @returns true if a trace is currently being recorded.
+    */
+    bool enabled();
+
+    /**
+    * @returns A monotonic timestamp in nanoseconds.
+    */
+    uint64_t now();
+
+    /**
+    * Records a completed span for the calling thread.
+    *
+    * @param name Name of the span. Must be a string literal.
+    * @param start Start time as returned by now().
+    * @param end End time as returned by now().
+    * @param fileId Id of the file the span belongs to.
+    */
+    void record(const char * name, uint64_t start, uint64_t end, uint64_t fileId);
+
+    /**
+    * Records the lifetime of a scope as a span.
+    */
+    class Span
+    {
+    public:
+        Span(const char * name, uint64_t fileId)
+            : m_name(name), m_fileId(fileId), m_start(enabled() ? now() : 0) {}
+
+        ~Span()
+        {
+            if (m_start != 0)
+                record(m_name, m_start, now(), m_fileId);
+        }
+
+    private:
+        Span(const Span&);
+        Span& operator=(const Span&);
+
+        const char * m_name;
+        uint64_t m_fileId;
+        uint64_t m_start;
+    };
+#else
+    inline bool open(const std::string&, size_t) { return false; }
+    inline void close() {}
+    inline bool enabled() { return false; }
+#endif
+}
+
+#ifndef HASHCALC_NO_TRACE
+#define HASHCALC_TRACE_SPAN(var, name, fileId) HashCalcTrace::Span var(name, fileId)
+#else
+#define HASHCALC_TRACE_SPAN(var, name, fileId) ((void) (fileId))
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file HashResultWriter.cpp
+* Contains the implementation of the batched writer for hash values.
+*/
+
+// System includes
+#include <cstring>
+#include <sstream>
+
+// Module includes
+#include "HashResultWriter.h"
+#include "HashCalcTrace.h"
+
+HashResultWriter::HashResultWriter(size_t batchSize)
+    : m_batchSize(batchSize > 0 ? batchSize : 1),
+      m_failures(0)
+{
+    m_batch.reserve(m_batchSize);
+}
+
+HashResultWriter::~HashResultWriter()
+{
+    stop();
+}
+
+void HashResultWriter::post(uint64_t fileId, TskImgDB::HASH_TYPE hashType, const char * hash)
+{
+    HashRecord record;
+    record.fileId = fileId;
+    record.hashType = hashType;
+    strncpy(record.hash, hash, MAX_HASH_TEXT);
+    record.hash[MAX_HASH_TEXT] = '\0';
+    m_batch.push_back(record);
+
+    if (m_batch.size() >= m_batchSize)
+        writeBatch();
+}
+
+size_t HashResultWriter::stop()
+{
+    if (!m_batch.empty())
+        writeBatch();
+
+    size_t failures = m_failures;
+    m_failures = 0;
+    return failures;
+}
+
+void HashResultWriter::writeBatch()
+{
+    HASHCALC_TRACE_SPAN(batchSpan, "setHashBatch", m_batch.front().fileId);
+
+    TskImgDB& imgDB = TskServices::Instance().getImgDB();
+    size_t failures = 0;
+
+    bool begun = false;
+    try
+    {
+        begun = imgDB.begin() == 0;
+    }
+    catch (std::exception& ex)
+    {
+        std::wstringstream msg;
+        msg << L"HashResultWriter - Error beginning transaction: " << ex.what();
+        LOGERROR(msg.str());
+    }
+
+    if (!begun) {
+        std::wstringstream msg;
+        msg << L"HashResultWriter - Unable to begin a transaction for " << m_batch.size() << L" hashes";
+        LOGERROR(msg.str());
+        m_failures += m_batch.size();
+        m_batch.clear();
+        return;
+    }
+
+    // Once the transaction is begun it is committed whatever happens, so
+    // that the connection is usable again; the values posted before an
+    // error are kept.
+    std::vector<HashRecord>::const_iterator it = m_batch.begin();
+    try
+    {
+        for (; it != m_batch.end(); ++it) {
+            if (imgDB.setHash(it->fileId, it->hashType, it->hash) != 0) {
+                std::wstringstream msg;
+                msg << L"HashResultWriter - Error posting hash for file id " << it->fileId;
+                LOGERROR(msg.str());
+                failures++;
+            }
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::wstringstream msg;
+        msg << L"HashResultWriter - Error posting hash for file id " << it->fileId << L": " << ex.what();
+        LOGERROR(msg.str());
+        failures += m_batch.end() - it;
+    }
+
+    bool committed = false;
+    try
+    {
+        committed = imgDB.commit() == 0;
+    }
+    catch (std::exception& ex)
+    {
+        std::wstringstream msg;
+        msg << L"HashResultWriter - Error committing transaction: " << ex.what();
+        LOGERROR(msg.str());
+    }
+
+    if (!committed) {
+        std::wstringstream msg;
+        msg << L"HashResultWriter - Unable to commit a batch of " << m_batch.size() << L" hashes";
+        LOGERROR(msg.str());
+        failures = m_batch.size();
+    }
+
+    m_failures += failures;
+    m_batch.clear();
+}
@@ -0,0 +1,83 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file HashResultWriter.h
+* Contains the interface of the class that posts calculated hash values to
+* the image database in batched transactions.
+*/
+
+#ifndef _HASH_RESULT_WRITER_H
+#define _HASH_RESULT_WRITER_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* Collects hash values and writes them to the image database several at a
+* time inside a single transaction.
+*
+* The image database connection is shared with the pipeline and the other
+* modules, so the writer only uses it on the thread that calls post() and
+* stop(), which must be the pipeline thread: a transaction is begun and
+* committed within one call and is never open while another module runs.
+*/
+class HashResultWriter
+{
+public:
+    /// Longest hash value text, in characters, that can be posted.
+    static const size_t MAX_HASH_TEXT = 128;
+
+    /**
+    * @param batchSize Maximum number of hash values written per transaction.
+    */
+    explicit HashResultWriter(size_t batchSize);
+    ~HashResultWriter();
+
+    /**
+    * Queues a hash value for the given file and writes the queued values
+    * once there are batchSize of them.
+    *
+    * @param fileId Id of the file the hash belongs to.
+    * @param hashType Type of the hash.
+    * @param hash Hash value text.
+    */
+    void post(uint64_t fileId, TskImgDB::HASH_TYPE hashType, const char * hash);
+
+    /**
+    * Writes all queued hash values.
+    *
+    * @returns The number of hash values that could not be written since the
+    * last call to stop().
+    */
+    size_t stop();
+
+private:
+    struct HashRecord
+    {
+        uint64_t fileId;
+        TskImgDB::HASH_TYPE hashType;
+        char hash[MAX_HASH_TEXT + 1];
+    };
+
+    HashResultWriter(const HashResultWriter&);
+    HashResultWriter& operator=(const HashResultWriter&);
+
+    void writeBatch();
+
+    std::vector<HashRecord> m_batch;
+    size_t m_batchSize;
+    size_t m_failures;
+};
+
+#endif
@@ -0,0 +1,306 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ImageSweep.cpp
+* Contains the implementation of the single pass over the image.
+*/
+
+// System includes
+#include <algorithm>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+// Module includes
+#include "ImageSweep.h"
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+// Length of each image read.
+static const size_t SWEEP_CHUNK_LENGTH = 4 * 1024 * 1024;
+
+// Length of the reads of stashed content from the temporary file.
+static const size_t SPILL_READ_LENGTH = 65536;
+
+ImageSweep::ImageSweep(RawImage * image, uint64_t stashLimit)
+    : m_image(image), m_stashLimit(stashLimit), m_wholeImage(false), m_imageSize(0),
+      m_imageBytes(0), m_imageComplete(false), m_memoryStashed(0), m_spillFile(NULL),
+      m_spillLength(0), m_bytesRead(0), m_bytesStashed(0), m_bytesSpilled(0)
+{
+}
+
+ImageSweep::~ImageSweep()
+{
+    if (m_spillFile != NULL)
+        fclose(m_spillFile);
+}
+
+size_t ImageSweep::addFile(uint64_t fileId, const std::vector<ImageExtent>& extents)
+{
+    File file;
+    file.fileId = fileId;
+    file.segments = extents.size();
+    file.nextSegment = 0;
+    file.failed = false;
+    m_files.push_back(file);
+
+    for (size_t i = 0; i < extents.size(); i++) {
+        Segment segment;
+        segment.offset = extents[i].offset;
+        segment.length = extents[i].length;
+        segment.file = m_files.size() - 1;
+        segment.index = i;
+        segment.done = 0;
+        m_segments.push_back(segment);
+    }
+    return m_files.size() - 1;
+}
+
+void ImageSweep::readWholeImage(uint64_t imageSize)
+{
+    m_wholeImage = true;
+    m_imageSize = imageSize;
+}
+
+/**
+* Orders segments by image offset, and segments at the same offset by file.
+*/
+bool ImageSweep::compareSegments(const Segment& a, const Segment& b)
+{
+    return a.offset < b.offset || (a.offset == b.offset && a.file < b.file);
+}
+
+void ImageSweep::run(ImageSweepListener& listener)
+{
+    std::sort(m_segments.begin(), m_segments.end(), compareSegments);
+
+    std::vector<unsigned char> buffer(SWEEP_CHUNK_LENGTH);
+
+    // Segments overlapping the current chunk, in offset order.
+    std::vector<size_t> active;
+    size_t next = 0;
+    uint64_t position = 0;
+
+    // Whether the pass still reads every byte of the image.
+    bool wholeImage = m_wholeImage;
+    m_imageBytes = 0;
+    m_imageComplete = false;
+
+    while (wholeImage || next < m_segments.size() || !active.empty()) {
+        // Skip the gaps that no file owns.
+        if (!wholeImage && active.empty() && m_segments[next].offset > position)
+            position = m_segments[next].offset;
+
+        uint64_t end = position + SWEEP_CHUNK_LENGTH;
+        while (next < m_segments.size() && m_segments[next].offset < end)
+            active.push_back(next++);
+
+        if (wholeImage) {
+            if (m_imageSize > 0 && m_imageSize < end)
+                end = m_imageSize;
+        }
+        else {
+            // Do not read beyond the last segment of the chunk.
+            uint64_t needed = position;
+            for (std::vector<size_t>::const_iterator it = active.begin(); it != active.end(); ++it) {
+                const Segment& segment = m_segments[*it];
+                if (segment.offset + segment.length > needed)
+                    needed = segment.offset + segment.length;
+            }
+            if (needed < end)
+                end = needed;
+        }
+
+        size_t length = end > position ? read(position, &buffer[0], (size_t) (end - position)) : 0;
+        m_bytesRead += length;
+        uint64_t readEnd = position + length;
+
+        if (wholeImage) {
+            if (length > 0)
+                listener.imageData(&buffer[0], length);
+            m_imageBytes += length;
+
+            // A short read is the end of an image of unknown size, and an
+            // error otherwise. Either way the rest is only read for files.
+            if (readEnd < end || readEnd == m_imageSize) {
+                m_imageComplete = m_imageSize == 0 ? m_imageBytes > 0 : readEnd == m_imageSize;
+                wholeImage = false;
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < active.size(); i++) {
+            Segment& segment = m_segments[active[i]];
+            uint64_t from = segment.offset > position ? segment.offset : position;
+            uint64_t to = segment.offset + segment.length < end ? segment.offset + segment.length : end;
+
+            if (to <= readEnd)
+                deliver(active[i], &buffer[(size_t) (from - position)], (size_t) (to - from), listener);
+            else
+                fail(segment.file, listener);
+
+            if (segment.offset + segment.length > end)
+                active[kept++] = active[i];
+        }
+        active.resize(kept);
+        position = end;
+    }
+
+    m_stash.clear();
+    if (m_spillFile != NULL) {
+        fclose(m_spillFile);
+        m_spillFile = NULL;
+    }
+}
+
+size_t ImageSweep::read(uint64_t offset, unsigned char * buffer, size_t length)
+{
+    if (m_image != NULL) {
+        if (offset >= m_image->size())
+            return 0;
+        if (length > m_image->size() - offset)
+            length = (size_t) (m_image->size() - offset);
+        return m_image->read(offset, buffer, length) ? length : 0;
+    }
+
+    int bytesRead = TskServices::Instance().getImageFile().getByteData(offset, length, (char *) buffer);
+    return bytesRead > 0 ? (size_t) bytesRead : 0;
+}
+
+void ImageSweep::deliver(size_t segmentIndex, const unsigned char * data, size_t length, ImageSweepListener& listener)
+{
+    Segment& segment = m_segments[segmentIndex];
+    File& file = m_files[segment.file];
+
+    segment.done += length;
+    if (file.failed)
+        return;
+
+    if (segment.index != file.nextSegment) {
+        stash(segmentIndex, data, length);
+        return;
+    }
+
+    listener.fileData(segment.file, data, length);
+    if (segment.done == segment.length)
+        advance(segment.file, listener);
+}
+
+void ImageSweep::stash(size_t segmentIndex, const unsigned char * data, size_t length)
+{
+    const Segment& segment = m_segments[segmentIndex];
+    StashEntry& entry = m_stash[std::make_pair(segment.file, segment.index)];
+    entry.segment = segmentIndex;
+
+    StashPiece piece;
+    piece.length = length;
+    piece.spilled = false;
+    piece.spillOffset = 0;
+
+    if (m_memoryStashed + length > m_stashLimit) {
+        if (m_spillFile == NULL)
+            m_spillFile = tmpfile();
+        if (m_spillFile != NULL) {
+            fseek64(m_spillFile, (long long) m_spillLength, SEEK_SET);
+            if (fwrite(data, 1, length, m_spillFile) == length) {
+                piece.spilled = true;
+                piece.spillOffset = m_spillLength;
+                m_spillLength += length;
+                m_bytesSpilled += length;
+            }
+        }
+    }
+
+    // Keep the bytes in memory after all if they cannot be spilled.
+    if (!piece.spilled) {
+        piece.data.assign(data, data + length);
+        m_memoryStashed += length;
+    }
+
+    entry.pieces.push_back(piece);
+    m_bytesStashed += length;
+}
+
+void ImageSweep::advance(size_t fileIndex, ImageSweepListener& listener)
+{
+    File& file = m_files[fileIndex];
+
+    while (++file.nextSegment < file.segments) {
+        Stash::iterator it = m_stash.find(std::make_pair(fileIndex, file.nextSegment));
+        if (it == m_stash.end())
+            return;
+
+        size_t segmentIndex = it->second.segment;
+        bool replayed = replay(fileIndex, it->second, listener);
+        m_stash.erase(it);
+        if (!replayed) {
+            fail(fileIndex, listener);
+            return;
+        }
+
+        // The rest of the segment is passed on as it is read.
+        if (m_segments[segmentIndex].done < m_segments[segmentIndex].length)
+            return;
+    }
+
+    listener.fileCompleted(fileIndex);
+}
+
+bool ImageSweep::replay(size_t fileIndex, const StashEntry& entry, ImageSweepListener& listener)
+{
+    std::vector<unsigned char> buffer;
+
+    for (std::vector<StashPiece>::const_iterator it = entry.pieces.begin(); it != entry.pieces.end(); ++it) {
+        if (!it->spilled) {
+            listener.fileData(fileIndex, &it->data[0], it->length);
+            m_memoryStashed -= it->length;
+            continue;
+        }
+
+        buffer.resize(SPILL_READ_LENGTH);
+        if (fseek64(m_spillFile, (long long) it->spillOffset, SEEK_SET) != 0)
+            return false;
+
+        size_t remaining = it->length;
+        while (remaining > 0) {
+            size_t length = remaining < SPILL_READ_LENGTH ? remaining : SPILL_READ_LENGTH;
+            if (fread(&buffer[0], 1, length, m_spillFile) != length)
+                return false;
+            listener.fileData(fileIndex, &buffer[0], length);
+            remaining -= length;
+        }
+    }
+    return true;
+}
+
+void ImageSweep::fail(size_t fileIndex, ImageSweepListener& listener)
+{
+    File& file = m_files[fileIndex];
+    if (file.failed)
+        return;
+    file.failed = true;
+
+    // Drop whatever was stashed for the file.
+    Stash::iterator it = m_stash.lower_bound(std::make_pair(fileIndex, (size_t) 0));
+    while (it != m_stash.end() && it->first.first == fileIndex) {
+        for (std::vector<StashPiece>::const_iterator piece = it->second.pieces.begin();
+            piece != it->second.pieces.end(); ++piece) {
+            if (!piece->spilled)
+                m_memoryStashed -= piece->length;
+        }
+        m_stash.erase(it++);
+    }
+
+    listener.fileFailed(fileIndex);
+}
@@ -0,0 +1,197 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ImageSweep.h
+* Contains the interface of the single pass over the image that feeds the
+* content of many files at once.
+*/
+
+#ifndef _IMAGE_SWEEP_H
+#define _IMAGE_SWEEP_H
+
+// System includes
+#include <cstdio>
+#include <map>
+#include <vector>
+
+// Module includes
+#include "RawImage.h"
+
+/**
+* Receives the content of the files of a sweep.
+*/
+class ImageSweepListener
+{
+public:
+    virtual ~ImageSweepListener() {}
+
+    /**
+    * Called with the next bytes of a file's content, in file order.
+    *
+    * @param file Index of the file in the sweep.
+    */
+    virtual void fileData(size_t file, const unsigned char * data, size_t length) = 0;
+
+    /**
+    * Called once all content of a file has been passed to fileData().
+    */
+    virtual void fileCompleted(size_t file) = 0;
+
+    /**
+    * Called instead of fileCompleted() if part of a file's content could
+    * not be read. No more data of the file follows.
+    */
+    virtual void fileFailed(size_t file) = 0;
+
+    /**
+    * Called with every byte of the image, in image order, if the sweep
+    * reads the whole image.
+    */
+    virtual void imageData(const unsigned char * /* data */, size_t /* length */) {}
+};
+
+/**
+* Reads the image once, front to back, and passes every byte to each file
+* whose content it belongs to. Files are collected with addFile() first.
+*
+* Content that belongs to a file but is read before the preceding parts of
+* the file, as with fragments stored out of order, is stashed until those
+* parts have been passed on. Stashed bytes are kept in memory up to a
+* limit and written to a temporary file beyond it.
+*/
+class ImageSweep
+{
+public:
+    /**
+    * @param image The raw image to read, or NULL to read through the
+    * framework's image file, which supports all image types.
+    * @param stashLimit Number of stashed bytes to keep in memory.
+    */
+    ImageSweep(RawImage * image, uint64_t stashLimit);
+    ~ImageSweep();
+
+    /**
+    * Adds a file to the sweep.
+    *
+    * @param fileId Id of the file.
+    * @param extents Image extents of the file's content, in file order.
+    * @returns The index of the file in the sweep.
+    */
+    size_t addFile(uint64_t fileId, const std::vector<ImageExtent>& extents);
+
+    /// Number of files added.
+    size_t files() const { return m_files.size(); }
+
+    /// Id of a file added to the sweep.
+    uint64_t fileId(size_t file) const { return m_files[file].fileId; }
+
+    /**
+    * Makes run() read every byte of the image instead of just the content
+    * of the files, and pass it to ImageSweepListener::imageData().
+    *
+    * @param imageSize Size of the image in bytes, or 0 to read until the
+    * image ends.
+    */
+    void readWholeImage(uint64_t imageSize);
+
+    /**
+    * Reads the image and passes the content of every file to the listener.
+    */
+    void run(ImageSweepListener& listener);
+
+    /// Number of bytes passed to ImageSweepListener::imageData().
+    uint64_t imageBytes() const { return m_imageBytes; }
+
+    /// true if the whole image was read without errors.
+    bool imageComplete() const { return m_imageComplete; }
+
+    /// Number of bytes read from the image.
+    uint64_t bytesRead() const { return m_bytesRead; }
+
+    /// Number of bytes stashed in memory and in the temporary file.
+    uint64_t bytesStashed() const { return m_bytesStashed; }
+
+    /// Number of stashed bytes that went to the temporary file.
+    uint64_t bytesSpilled() const { return m_bytesSpilled; }
+
+private:
+    ImageSweep(const ImageSweep&);
+    ImageSweep& operator=(const ImageSweep&);
+
+    /// A run of a file's content in the image.
+    struct Segment
+    {
+        uint64_t offset;
+        uint64_t length;
+        size_t file;
+        /// Position of the segment in file order.
+        size_t index;
+        /// Bytes of the segment read so far.
+        uint64_t done;
+    };
+
+    /// Part of a stashed segment, in memory or in the temporary file.
+    struct StashPiece
+    {
+        std::vector<unsigned char> data;
+        bool spilled;
+        uint64_t spillOffset;
+        size_t length;
+    };
+
+    /// The stashed content of a segment.
+    struct StashEntry
+    {
+        /// Position of the segment in m_segments.
+        size_t segment;
+        std::vector<StashPiece> pieces;
+    };
+
+    struct File
+    {
+        uint64_t fileId;
+        size_t segments;
+        /// Index of the segment to pass on next.
+        size_t nextSegment;
+        bool failed;
+    };
+
+    static bool compareSegments(const Segment& a, const Segment& b);
+    size_t read(uint64_t offset, unsigned char * buffer, size_t length);
+    void deliver(size_t segment, const unsigned char * data, size_t length, ImageSweepListener& listener);
+    void stash(size_t segment, const unsigned char * data, size_t length);
+    void advance(size_t fileIndex, ImageSweepListener& listener);
+    bool replay(size_t fileIndex, const StashEntry& entry, ImageSweepListener& listener);
+    void fail(size_t fileIndex, ImageSweepListener& listener);
+
+    RawImage * m_image;
+    uint64_t m_stashLimit;
+
+    bool m_wholeImage;
+    uint64_t m_imageSize;
+    uint64_t m_imageBytes;
+    bool m_imageComplete;
+
+    std::vector<File> m_files;
+    std::vector<Segment> m_segments;
+
+    // Stashed content by file and segment position in the file.
+    typedef std::map<std::pair<size_t, size_t>, StashEntry> Stash;
+    Stash m_stash;
+    uint64_t m_memoryStashed;
+    FILE * m_spillFile;
+    uint64_t m_spillLength;
+
+    uint64_t m_bytesRead;
+    uint64_t m_bytesStashed;
+    uint64_t m_bytesSpilled;
+};
+
+#endif
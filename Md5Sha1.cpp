@@ -0,0 +1,351 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file Md5Sha1.cpp
+* Contains the implementation of MD5 (RFC 1321) and SHA-1 (FIPS 180-4)
+* with the rounds of both compression functions interleaved per block.
+*/
+
+// System includes
+#include <cstring>
+
+// Module includes
+#include "Md5Sha1.h"
+
+// One MD5 step; the callers rotate the roles of the four state words.
+#define MD5_STEP(f, a, b, c, d, x, t, s) \
+    a = b + rotl(a + f(b, c, d) + x + t, s)
+
+// One SHA-1 step; the callers rotate the roles of the five state words, so
+// e receives the new value of a.
+#define SHA1_STEP(f, k, a, b, c, d, e, w) \
+    e += rotl(a, 5) + f(b, c, d) + k + w; \
+    b = rotl(b, 30)
+
+// Expands the SHA-1 message schedule in a window of 16 words.
+#define SHA1_SCHEDULE(w, t) \
+    (w[(t) & 15] = rotl(w[((t) - 3) & 15] ^ w[((t) - 8) & 15] ^ w[((t) - 14) & 15] ^ w[(t) & 15], 1))
+
+namespace
+{
+    inline uint32_t rotl(uint32_t x, int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    inline uint32_t md5F(uint32_t b, uint32_t c, uint32_t d) { return d ^ (b & (c ^ d)); }
+    inline uint32_t md5G(uint32_t b, uint32_t c, uint32_t d) { return c ^ (d & (b ^ c)); }
+    inline uint32_t md5H(uint32_t b, uint32_t c, uint32_t d) { return b ^ c ^ d; }
+    inline uint32_t md5I(uint32_t b, uint32_t c, uint32_t d) { return c ^ (b | ~d); }
+
+    inline uint32_t sha1Ch(uint32_t b, uint32_t c, uint32_t d) { return d ^ (b & (c ^ d)); }
+    inline uint32_t sha1Parity(uint32_t b, uint32_t c, uint32_t d) { return b ^ c ^ d; }
+    inline uint32_t sha1Maj(uint32_t b, uint32_t c, uint32_t d) { return (b & c) | (d & (b | c)); }
+
+    /**
+    * Runs one block through both compression functions. MD5 has 64 steps
+    * and SHA-1 80, so each group of four MD5 steps is paired with five
+    * SHA-1 steps; the two chains do not depend on each other and the
+    * processor overlaps them.
+    *
+    * The blocks of the two hashes are the same except for the last block,
+    * where the length is stored in a different byte order.
+    */
+    void transform(uint32_t * md5State, uint32_t * sha1State, const unsigned char * md5Block,
+        const unsigned char * sha1Block)
+    {
+        // MD5 reads its block as little endian words, SHA-1 as big endian.
+        uint32_t x[16];
+        uint32_t w[16];
+        for (int i = 0; i < 16; i++) {
+            const unsigned char * p = md5Block + 4 * i;
+            x[i] = (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+            p = sha1Block + 4 * i;
+            w[i] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+        }
+
+        uint32_t ma = md5State[0], mb = md5State[1], mc = md5State[2], md = md5State[3];
+        uint32_t sa = sha1State[0], sb = sha1State[1], sc = sha1State[2], sd = sha1State[3], se = sha1State[4];
+
+        // MD5 steps 0-3, SHA-1 steps 0-4.
+        MD5_STEP(md5F, ma, mb, mc, md, x[0], 0xd76aa478, 7);
+        SHA1_STEP(sha1Ch, 0x5a827999, sa, sb, sc, sd, se, w[0]);
+        MD5_STEP(md5F, md, ma, mb, mc, x[1], 0xe8c7b756, 12);
+        SHA1_STEP(sha1Ch, 0x5a827999, se, sa, sb, sc, sd, w[1]);
+        MD5_STEP(md5F, mc, md, ma, mb, x[2], 0x242070db, 17);
+        SHA1_STEP(sha1Ch, 0x5a827999, sd, se, sa, sb, sc, w[2]);
+        MD5_STEP(md5F, mb, mc, md, ma, x[3], 0xc1bdceee, 22);
+        SHA1_STEP(sha1Ch, 0x5a827999, sc, sd, se, sa, sb, w[3]);
+        SHA1_STEP(sha1Ch, 0x5a827999, sb, sc, sd, se, sa, w[4]);
+
+        // MD5 steps 4-7, SHA-1 steps 5-9.
+        MD5_STEP(md5F, ma, mb, mc, md, x[4], 0xf57c0faf, 7);
+        SHA1_STEP(sha1Ch, 0x5a827999, sa, sb, sc, sd, se, w[5]);
+        MD5_STEP(md5F, md, ma, mb, mc, x[5], 0x4787c62a, 12);
+        SHA1_STEP(sha1Ch, 0x5a827999, se, sa, sb, sc, sd, w[6]);
+        MD5_STEP(md5F, mc, md, ma, mb, x[6], 0xa8304613, 17);
+        SHA1_STEP(sha1Ch, 0x5a827999, sd, se, sa, sb, sc, w[7]);
+        MD5_STEP(md5F, mb, mc, md, ma, x[7], 0xfd469501, 22);
+        SHA1_STEP(sha1Ch, 0x5a827999, sc, sd, se, sa, sb, w[8]);
+        SHA1_STEP(sha1Ch, 0x5a827999, sb, sc, sd, se, sa, w[9]);
+
+        // MD5 steps 8-11, SHA-1 steps 10-14.
+        MD5_STEP(md5F, ma, mb, mc, md, x[8], 0x698098d8, 7);
+        SHA1_STEP(sha1Ch, 0x5a827999, sa, sb, sc, sd, se, w[10]);
+        MD5_STEP(md5F, md, ma, mb, mc, x[9], 0x8b44f7af, 12);
+        SHA1_STEP(sha1Ch, 0x5a827999, se, sa, sb, sc, sd, w[11]);
+        MD5_STEP(md5F, mc, md, ma, mb, x[10], 0xffff5bb1, 17);
+        SHA1_STEP(sha1Ch, 0x5a827999, sd, se, sa, sb, sc, w[12]);
+        MD5_STEP(md5F, mb, mc, md, ma, x[11], 0x895cd7be, 22);
+        SHA1_STEP(sha1Ch, 0x5a827999, sc, sd, se, sa, sb, w[13]);
+        SHA1_STEP(sha1Ch, 0x5a827999, sb, sc, sd, se, sa, w[14]);
+
+        // MD5 steps 12-15, SHA-1 steps 15-19.
+        MD5_STEP(md5F, ma, mb, mc, md, x[12], 0x6b901122, 7);
+        SHA1_STEP(sha1Ch, 0x5a827999, sa, sb, sc, sd, se, w[15]);
+        MD5_STEP(md5F, md, ma, mb, mc, x[13], 0xfd987193, 12);
+        SHA1_STEP(sha1Ch, 0x5a827999, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 16));
+        MD5_STEP(md5F, mc, md, ma, mb, x[14], 0xa679438e, 17);
+        SHA1_STEP(sha1Ch, 0x5a827999, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 17));
+        MD5_STEP(md5F, mb, mc, md, ma, x[15], 0x49b40821, 22);
+        SHA1_STEP(sha1Ch, 0x5a827999, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 18));
+        SHA1_STEP(sha1Ch, 0x5a827999, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 19));
+
+        // MD5 steps 16-19, SHA-1 steps 20-24.
+        MD5_STEP(md5G, ma, mb, mc, md, x[1], 0xf61e2562, 5);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 20));
+        MD5_STEP(md5G, md, ma, mb, mc, x[6], 0xc040b340, 9);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 21));
+        MD5_STEP(md5G, mc, md, ma, mb, x[11], 0x265e5a51, 14);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 22));
+        MD5_STEP(md5G, mb, mc, md, ma, x[0], 0xe9b6c7aa, 20);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 23));
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 24));
+
+        // MD5 steps 20-23, SHA-1 steps 25-29.
+        MD5_STEP(md5G, ma, mb, mc, md, x[5], 0xd62f105d, 5);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 25));
+        MD5_STEP(md5G, md, ma, mb, mc, x[10], 0x02441453, 9);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 26));
+        MD5_STEP(md5G, mc, md, ma, mb, x[15], 0xd8a1e681, 14);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 27));
+        MD5_STEP(md5G, mb, mc, md, ma, x[4], 0xe7d3fbc8, 20);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 28));
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 29));
+
+        // MD5 steps 24-27, SHA-1 steps 30-34.
+        MD5_STEP(md5G, ma, mb, mc, md, x[9], 0x21e1cde6, 5);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 30));
+        MD5_STEP(md5G, md, ma, mb, mc, x[14], 0xc33707d6, 9);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 31));
+        MD5_STEP(md5G, mc, md, ma, mb, x[3], 0xf4d50d87, 14);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 32));
+        MD5_STEP(md5G, mb, mc, md, ma, x[8], 0x455a14ed, 20);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 33));
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 34));
+
+        // MD5 steps 28-31, SHA-1 steps 35-39.
+        MD5_STEP(md5G, ma, mb, mc, md, x[13], 0xa9e3e905, 5);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 35));
+        MD5_STEP(md5G, md, ma, mb, mc, x[2], 0xfcefa3f8, 9);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 36));
+        MD5_STEP(md5G, mc, md, ma, mb, x[7], 0x676f02d9, 14);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 37));
+        MD5_STEP(md5G, mb, mc, md, ma, x[12], 0x8d2a4c8a, 20);
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 38));
+        SHA1_STEP(sha1Parity, 0x6ed9eba1, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 39));
+
+        // MD5 steps 32-35, SHA-1 steps 40-44.
+        MD5_STEP(md5H, ma, mb, mc, md, x[5], 0xfffa3942, 4);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 40));
+        MD5_STEP(md5H, md, ma, mb, mc, x[8], 0x8771f681, 11);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 41));
+        MD5_STEP(md5H, mc, md, ma, mb, x[11], 0x6d9d6122, 16);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 42));
+        MD5_STEP(md5H, mb, mc, md, ma, x[14], 0xfde5380c, 23);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 43));
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 44));
+
+        // MD5 steps 36-39, SHA-1 steps 45-49.
+        MD5_STEP(md5H, ma, mb, mc, md, x[1], 0xa4beea44, 4);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 45));
+        MD5_STEP(md5H, md, ma, mb, mc, x[4], 0x4bdecfa9, 11);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 46));
+        MD5_STEP(md5H, mc, md, ma, mb, x[7], 0xf6bb4b60, 16);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 47));
+        MD5_STEP(md5H, mb, mc, md, ma, x[10], 0xbebfbc70, 23);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 48));
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 49));
+
+        // MD5 steps 40-43, SHA-1 steps 50-54.
+        MD5_STEP(md5H, ma, mb, mc, md, x[13], 0x289b7ec6, 4);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 50));
+        MD5_STEP(md5H, md, ma, mb, mc, x[0], 0xeaa127fa, 11);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 51));
+        MD5_STEP(md5H, mc, md, ma, mb, x[3], 0xd4ef3085, 16);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 52));
+        MD5_STEP(md5H, mb, mc, md, ma, x[6], 0x04881d05, 23);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 53));
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 54));
+
+        // MD5 steps 44-47, SHA-1 steps 55-59.
+        MD5_STEP(md5H, ma, mb, mc, md, x[9], 0xd9d4d039, 4);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 55));
+        MD5_STEP(md5H, md, ma, mb, mc, x[12], 0xe6db99e5, 11);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 56));
+        MD5_STEP(md5H, mc, md, ma, mb, x[15], 0x1fa27cf8, 16);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 57));
+        MD5_STEP(md5H, mb, mc, md, ma, x[2], 0xc4ac5665, 23);
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 58));
+        SHA1_STEP(sha1Maj, 0x8f1bbcdc, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 59));
+
+        // MD5 steps 48-51, SHA-1 steps 60-64.
+        MD5_STEP(md5I, ma, mb, mc, md, x[0], 0xf4292244, 6);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 60));
+        MD5_STEP(md5I, md, ma, mb, mc, x[7], 0x432aff97, 10);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 61));
+        MD5_STEP(md5I, mc, md, ma, mb, x[14], 0xab9423a7, 15);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 62));
+        MD5_STEP(md5I, mb, mc, md, ma, x[5], 0xfc93a039, 21);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 63));
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 64));
+
+        // MD5 steps 52-55, SHA-1 steps 65-69.
+        MD5_STEP(md5I, ma, mb, mc, md, x[12], 0x655b59c3, 6);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 65));
+        MD5_STEP(md5I, md, ma, mb, mc, x[3], 0x8f0ccc92, 10);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 66));
+        MD5_STEP(md5I, mc, md, ma, mb, x[10], 0xffeff47d, 15);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 67));
+        MD5_STEP(md5I, mb, mc, md, ma, x[1], 0x85845dd1, 21);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 68));
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 69));
+
+        // MD5 steps 56-59, SHA-1 steps 70-74.
+        MD5_STEP(md5I, ma, mb, mc, md, x[8], 0x6fa87e4f, 6);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 70));
+        MD5_STEP(md5I, md, ma, mb, mc, x[15], 0xfe2ce6e0, 10);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 71));
+        MD5_STEP(md5I, mc, md, ma, mb, x[6], 0xa3014314, 15);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 72));
+        MD5_STEP(md5I, mb, mc, md, ma, x[13], 0x4e0811a1, 21);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 73));
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 74));
+
+        // MD5 steps 60-63, SHA-1 steps 75-79.
+        MD5_STEP(md5I, ma, mb, mc, md, x[4], 0xf7537e82, 6);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sa, sb, sc, sd, se, SHA1_SCHEDULE(w, 75));
+        MD5_STEP(md5I, md, ma, mb, mc, x[11], 0xbd3af235, 10);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, se, sa, sb, sc, sd, SHA1_SCHEDULE(w, 76));
+        MD5_STEP(md5I, mc, md, ma, mb, x[2], 0x2ad7d2bb, 15);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sd, se, sa, sb, sc, SHA1_SCHEDULE(w, 77));
+        MD5_STEP(md5I, mb, mc, md, ma, x[9], 0xeb86d391, 21);
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sc, sd, se, sa, sb, SHA1_SCHEDULE(w, 78));
+        SHA1_STEP(sha1Parity, 0xca62c1d6, sb, sc, sd, se, sa, SHA1_SCHEDULE(w, 79));
+
+        md5State[0] += ma;
+        md5State[1] += mb;
+        md5State[2] += mc;
+        md5State[3] += md;
+
+        sha1State[0] += sa;
+        sha1State[1] += sb;
+        sha1State[2] += sc;
+        sha1State[3] += sd;
+        sha1State[4] += se;
+    }
+}
+
+void md5Sha1Init(Md5Sha1Context * context)
+{
+    static const uint32_t MD5_INITIAL_STATE[4] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+    };
+    static const uint32_t SHA1_INITIAL_STATE[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+
+    memcpy(context->md5State, MD5_INITIAL_STATE, sizeof(MD5_INITIAL_STATE));
+    memcpy(context->sha1State, SHA1_INITIAL_STATE, sizeof(SHA1_INITIAL_STATE));
+    context->length = 0;
+    context->buffered = 0;
+}
+
+void md5Sha1Update(Md5Sha1Context * context, const unsigned char * data, size_t length)
+{
+    if (length == 0)
+        return;
+    context->length += length;
+
+    if (context->buffered > 0) {
+        size_t fill = 64 - context->buffered;
+        if (fill > length)
+            fill = length;
+        memcpy(context->buffer + context->buffered, data, fill);
+        context->buffered += fill;
+        data += fill;
+        length -= fill;
+
+        if (context->buffered < 64)
+            return;
+        transform(context->md5State, context->sha1State, context->buffer, context->buffer);
+        context->buffered = 0;
+    }
+
+    while (length >= 64) {
+        transform(context->md5State, context->sha1State, data, data);
+        data += 64;
+        length -= 64;
+    }
+
+    memcpy(context->buffer, data, length);
+    context->buffered = length;
+}
+
+void md5Sha1Final(unsigned char * md5Digest, unsigned char * sha1Digest, Md5Sha1Context * context)
+{
+    uint64_t bits = context->length * 8;
+
+    // Pad with a one bit and zeros up to the length in the last 8 bytes of
+    // a block; if the one bit leaves no room for the length, the length
+    // goes into an extra block.
+    unsigned char * buffer = context->buffer;
+    size_t used = context->buffered;
+    buffer[used++] = 0x80;
+    if (used > 56) {
+        memset(buffer + used, 0, 64 - used);
+        transform(context->md5State, context->sha1State, buffer, buffer);
+        used = 0;
+    }
+    memset(buffer + used, 0, 56 - used);
+
+    // The last blocks of the two hashes only differ in the byte order of
+    // the length.
+    unsigned char sha1Block[64];
+    memcpy(sha1Block, buffer, 56);
+    for (int i = 0; i < 8; i++) {
+        buffer[56 + i] = (unsigned char) (bits >> (8 * i));
+        sha1Block[56 + i] = (unsigned char) (bits >> (56 - 8 * i));
+    }
+    transform(context->md5State, context->sha1State, buffer, sha1Block);
+
+    for (int i = 0; i < 4; i++) {
+        md5Digest[4 * i] = (unsigned char) context->md5State[i];
+        md5Digest[4 * i + 1] = (unsigned char) (context->md5State[i] >> 8);
+        md5Digest[4 * i + 2] = (unsigned char) (context->md5State[i] >> 16);
+        md5Digest[4 * i + 3] = (unsigned char) (context->md5State[i] >> 24);
+    }
+    for (int i = 0; i < 5; i++) {
+        sha1Digest[4 * i] = (unsigned char) (context->sha1State[i] >> 24);
+        sha1Digest[4 * i + 1] = (unsigned char) (context->sha1State[i] >> 16);
+        sha1Digest[4 * i + 2] = (unsigned char) (context->sha1State[i] >> 8);
+        sha1Digest[4 * i + 3] = (unsigned char) context->sha1State[i];
+    }
+}
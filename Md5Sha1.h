@@ -0,0 +1,49 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file Md5Sha1.h
+* Contains the interface of the combined MD5 and SHA-1 calculation used
+* when both hashes are enabled. Each block goes through both compression
+* functions at once, so it is loaded once and the two dependency chains
+* can execute side by side.
+*/
+
+#ifndef _MD5_SHA1_H
+#define _MD5_SHA1_H
+
+// System includes
+#include <cstddef>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* State of a combined MD5 and SHA-1 calculation, used like the TSK_MD5_CTX
+* and TSK_SHA_CTX contexts.
+*/
+struct Md5Sha1Context
+{
+    uint32_t md5State[4];
+    uint32_t sha1State[5];
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t buffered;
+};
+
+void md5Sha1Init(Md5Sha1Context * context);
+
+void md5Sha1Update(Md5Sha1Context * context, const unsigned char * data, size_t length);
+
+/**
+* Writes the 16 byte MD5 and the 20 byte SHA-1 digest.
+*/
+void md5Sha1Final(unsigned char * md5Digest, unsigned char * sha1Digest, Md5Sha1Context * context);
+
+#endif
@@ -0,0 +1,357 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file MerkleTree.cpp
+* Contains the implementation of the Merkle tree digest, its parallel leaf
+* hashing and its store.
+*/
+
+// System includes
+#include <cstdio>
+#include <cstring>
+
+// Module includes
+#include "MerkleTree.h"
+#include "StoreFile.h"
+
+namespace
+{
+    const char TREE_MAGIC[4] = { 'H', 'C', 'M', 'T' };
+    const uint32_t TREE_VERSION = 1;
+    const size_t HEADER_SIZE = 28 + SHA256_LENGTH;
+
+    const unsigned char LEAF_PREFIX = 0x00;
+    const unsigned char NODE_PREFIX = 0x01;
+}
+
+/**
+* Computes an inner node; the result may overwrite either child.
+*/
+static void hashMerkleNode(const unsigned char * left, const unsigned char * right, unsigned char * digest)
+{
+    Sha256Context context;
+    sha256Init(&context);
+    sha256Update(&context, &NODE_PREFIX, 1);
+    sha256Update(&context, left, SHA256_LENGTH);
+    sha256Update(&context, right, SHA256_LENGTH);
+    sha256Final(digest, &context);
+}
+
+void hashMerkleLeaf(const unsigned char * data, size_t length, unsigned char * digest)
+{
+    Sha256Context context;
+    sha256Init(&context);
+    sha256Update(&context, &LEAF_PREFIX, 1);
+    sha256Update(&context, data, length);
+    sha256Final(digest, &context);
+}
+
+void computeMerkleRoot(const unsigned char * leaves, size_t count, unsigned char * root)
+{
+    // Pairing a level and carrying up a node without a sibling gives the
+    // same tree as splitting the leaves into perfect subtrees by the binary
+    // digits of the count and joining those from the right. The subtrees
+    // are built on a stack, one entry per height, so no level is copied.
+    static const size_t MAX_HEIGHT = 64;
+    unsigned char stack[MAX_HEIGHT][SHA256_LENGTH];
+    size_t heights[MAX_HEIGHT];
+    size_t depth = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        memcpy(stack[depth], leaves + i * SHA256_LENGTH, SHA256_LENGTH);
+        heights[depth] = 0;
+        depth++;
+
+        while (depth > 1 && heights[depth - 2] == heights[depth - 1]) {
+            hashMerkleNode(stack[depth - 2], stack[depth - 1], stack[depth - 2]);
+            heights[depth - 2]++;
+            depth--;
+        }
+    }
+
+    while (depth > 1) {
+        hashMerkleNode(stack[depth - 2], stack[depth - 1], stack[depth - 2]);
+        depth--;
+    }
+    memcpy(root, stack[0], SHA256_LENGTH);
+}
+
+MerkleHashPool::MerkleHashPool(size_t threadCount, uint32_t leafSize)
+    : m_leafSize(leafSize), m_leaves(threadCount > 1 ? threadCount : 0), m_stopping(false),
+      m_threads(threadCount > 1 ? threadCount - 1 : 0)
+{
+    m_free.reserve(m_leaves.size());
+    m_queued.reserve(m_leaves.size());
+    for (size_t i = 0; i < m_leaves.size(); i++) {
+        m_leaves[i].data.resize(leafSize);
+        m_free.push_back(&m_leaves[i]);
+    }
+
+    for (size_t i = 0; i < m_threads.size(); i++) {
+        m_threads[i] = new Poco::Thread("MerkleHash");
+        m_threads[i]->start(*this);
+    }
+}
+
+MerkleHashPool::~MerkleHashPool()
+{
+    {
+        Poco::FastMutex::ScopedLock guard(m_lock);
+        m_stopping = true;
+        m_work.broadcast();
+    }
+    for (size_t i = 0; i < m_threads.size(); i++) {
+        m_threads[i]->join();
+        delete m_threads[i];
+    }
+}
+
+MerkleHashPool::Leaf * MerkleHashPool::startLeaf(MerkleTreeBuilder& builder)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+    builder.m_leaves.resize((builder.m_count + 1) * SHA256_LENGTH);
+
+    if (m_free.empty() && !m_queued.empty())
+        hashQueued();
+    if (m_free.empty())
+        return NULL;
+
+    Leaf * leaf = m_free.back();
+    m_free.pop_back();
+    leaf->owner = &builder;
+    leaf->index = builder.m_count;
+    return leaf;
+}
+
+void MerkleHashPool::submit(Leaf * leaf)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+    leaf->owner->m_pending++;
+    m_queued.push_back(leaf);
+    m_work.signal();
+}
+
+void MerkleHashPool::release(Leaf * leaf)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+    m_free.push_back(leaf);
+}
+
+void MerkleHashPool::wait(MerkleTreeBuilder& builder)
+{
+    Poco::FastMutex::ScopedLock guard(m_lock);
+    while (builder.m_pending > 0) {
+        if (!m_queued.empty())
+            hashQueued();
+        else
+            m_done.wait(m_lock);
+    }
+}
+
+void MerkleHashPool::hashQueued()
+{
+    Leaf * leaf = m_queued.back();
+    m_queued.pop_back();
+
+    unsigned char digest[SHA256_LENGTH];
+    m_lock.unlock();
+    hashMerkleLeaf(&leaf->data[0], leaf->length, digest);
+    m_lock.lock();
+
+    // The owner only resizes its digest list with the lock held.
+    MerkleTreeBuilder& owner = *leaf->owner;
+    memcpy(&owner.m_leaves[leaf->index * SHA256_LENGTH], digest, SHA256_LENGTH);
+    owner.m_pending--;
+    m_free.push_back(leaf);
+    m_done.broadcast();
+}
+
+void MerkleHashPool::run()
+{
+    m_lock.lock();
+    while (true) {
+        while (!m_stopping && m_queued.empty())
+            m_work.wait(m_lock);
+        if (m_stopping)
+            break;
+        hashQueued();
+    }
+    m_lock.unlock();
+}
+
+MerkleTreeBuilder::MerkleTreeBuilder(MerkleHashPool& pool)
+    : m_pool(pool), m_leafSize(pool.leafSize()), m_leaf(NULL), m_inLeaf(false),
+      m_filled(0), m_count(0), m_pending(0), m_length(0)
+{
+}
+
+MerkleTreeBuilder::~MerkleTreeBuilder()
+{
+    reset();
+}
+
+void MerkleTreeBuilder::reset()
+{
+    // Leaves of an unfinished tree may still be hashed into m_leaves.
+    if (m_leaf != NULL) {
+        m_pool.release(m_leaf);
+        m_leaf = NULL;
+    }
+    m_pool.wait(*this);
+
+    // The digests of a very large file are not kept for the next one.
+    static const size_t KEPT_LEAVES = 65536;
+    if (m_leaves.capacity() > KEPT_LEAVES * SHA256_LENGTH)
+        std::vector<unsigned char>().swap(m_leaves);
+    else
+        m_leaves.clear();
+
+    m_inLeaf = false;
+    m_filled = 0;
+    m_count = 0;
+    m_length = 0;
+}
+
+void MerkleTreeBuilder::startLeaf()
+{
+    m_leaf = m_pool.startLeaf(*this);
+    if (m_leaf == NULL) {
+        sha256Init(&m_context);
+        sha256Update(&m_context, &LEAF_PREFIX, 1);
+    }
+    m_inLeaf = true;
+    m_filled = 0;
+    m_count++;
+}
+
+void MerkleTreeBuilder::endLeaf()
+{
+    if (m_leaf != NULL) {
+        m_leaf->length = m_filled;
+        m_pool.submit(m_leaf);
+        m_leaf = NULL;
+    }
+    else {
+        // The pool writes other digests of the list meanwhile, but does
+        // not resize it.
+        sha256Final(&m_leaves[(m_count - 1) * SHA256_LENGTH], &m_context);
+    }
+    m_inLeaf = false;
+}
+
+void MerkleTreeBuilder::update(const unsigned char * data, size_t length)
+{
+    m_length += length;
+    while (length > 0) {
+        if (!m_inLeaf)
+            startLeaf();
+
+        size_t chunk = m_leafSize - m_filled;
+        if (chunk > length)
+            chunk = length;
+        if (m_leaf != NULL)
+            memcpy(&m_leaf->data[m_filled], data, chunk);
+        else
+            sha256Update(&m_context, data, chunk);
+        m_filled += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (m_filled == m_leafSize)
+            endLeaf();
+    }
+}
+
+void MerkleTreeBuilder::final(MerkleTree& tree)
+{
+    // An empty file still has one leaf.
+    if (m_count == 0)
+        startLeaf();
+    if (m_inLeaf)
+        endLeaf();
+    m_pool.wait(*this);
+
+    tree.leafSize = m_leafSize;
+    tree.fileSize = m_length;
+    tree.leaves.swap(m_leaves);
+    computeMerkleRoot(&tree.leaves[0], tree.leafCount(), tree.root);
+    reset();
+}
+
+MerkleStore::MerkleStore(const std::string& directory)
+    : m_directory(directory), m_saved(0)
+{
+}
+
+const std::string& MerkleStore::path(uint64_t fileId) const
+{
+    // Built in a member that keeps its memory, since a tree is saved for
+    // every file.
+    char name[32];
+    sprintf(name, "/%llu.hmt", (unsigned long long) fileId);
+    m_path.assign(m_directory);
+    m_path.append(name);
+    return m_path;
+}
+
+bool MerkleStore::load(uint64_t fileId, MerkleTree& tree) const
+{
+    FILE * file = fopen(path(fileId).c_str(), "rb");
+    if (file == NULL)
+        return false;
+
+    unsigned char header[HEADER_SIZE];
+    bool valid = fread(header, HEADER_SIZE, 1, file) == 1 &&
+        memcmp(header, TREE_MAGIC, 4) == 0 &&
+        getUInt32(header + 4) == TREE_VERSION &&
+        getUInt32(header + 8) > 0;
+
+    if (valid) {
+        tree.leafSize = getUInt32(header + 8);
+        tree.fileSize = getUInt64(header + 12);
+        uint64_t count = getUInt64(header + 20);
+        uint64_t expected = tree.fileSize == 0 ? 1 : (tree.fileSize + tree.leafSize - 1) / tree.leafSize;
+        valid = count == expected;
+        if (valid) {
+            tree.leaves.resize((size_t) count * SHA256_LENGTH);
+            valid = fread(&tree.leaves[0], tree.leaves.size(), 1, file) == 1;
+        }
+    }
+    fclose(file);
+
+    // A tree whose leaves do not produce its root was damaged on disk.
+    if (valid) {
+        memcpy(tree.root, header + 28, SHA256_LENGTH);
+        unsigned char root[SHA256_LENGTH];
+        computeMerkleRoot(&tree.leaves[0], tree.leafCount(), root);
+        valid = memcmp(root, tree.root, SHA256_LENGTH) == 0;
+    }
+    return valid;
+}
+
+bool MerkleStore::save(uint64_t fileId, const MerkleTree& tree)
+{
+    unsigned char header[HEADER_SIZE];
+    memcpy(header, TREE_MAGIC, 4);
+    putUInt32(header + 4, TREE_VERSION);
+    putUInt32(header + 8, tree.leafSize);
+    putUInt64(header + 12, tree.fileSize);
+    putUInt64(header + 20, tree.leafCount());
+    memcpy(header + 28, tree.root, SHA256_LENGTH);
+
+    const std::string& target = path(fileId);
+    m_temp.assign(target);
+    m_temp.append(".tmp");
+    if (!replaceStoreFile(target, m_temp, header, HEADER_SIZE, &tree.leaves[0], tree.leaves.size()))
+        return false;
+
+    m_saved++;
+    return true;
+}
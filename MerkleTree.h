@@ -0,0 +1,227 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file MerkleTree.h
+* Contains the interface of the Merkle tree digest: SHA-256 over fixed size
+* leaves of a file, combined pairwise up to a single root. Leaves are
+* independent, so they can be hashed in parallel, and any byte range can
+* later be verified by rehashing only the leaves it covers.
+*/
+
+#ifndef _MERKLE_TREE_H
+#define _MERKLE_TREE_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// Poco includes
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+#include "Poco/Mutex.h"
+#include "Poco/Condition.h"
+
+// Module includes
+#include "Sha256.h"
+
+/**
+* The Merkle tree of one file. A leaf digest is SHA-256(0x00 || leaf), an
+* inner node is SHA-256(0x01 || left || right), and a node without a
+* sibling is carried up to the next level unchanged. An empty file has a
+* single empty leaf.
+*/
+struct MerkleTree
+{
+    /// Size of each leaf in bytes; the last leaf may be shorter.
+    uint32_t leafSize;
+    /// Size of the file the tree was computed over.
+    uint64_t fileSize;
+    /// Leaf digests, SHA256_LENGTH bytes each, in file order.
+    std::vector<unsigned char> leaves;
+    /// Root of the tree.
+    unsigned char root[SHA256_LENGTH];
+
+    size_t leafCount() const { return leaves.size() / SHA256_LENGTH; }
+};
+
+/**
+* Computes the leaf digest of one leaf.
+*/
+void hashMerkleLeaf(const unsigned char * data, size_t length, unsigned char * digest);
+
+/**
+* Computes the root over a list of leaf digests.
+*
+* @param leaves Leaf digests, SHA256_LENGTH bytes each.
+* @param count Number of leaves; at least one.
+* @param root Receives the root.
+*/
+void computeMerkleRoot(const unsigned char * leaves, size_t count, unsigned char * root);
+
+class MerkleTreeBuilder;
+
+/**
+* Hashes the leaves of the trees being built on a set of threads. The pool
+* owns one leaf buffer per thread, allocated with the pool: a builder
+* copies a leaf into a free buffer and hands it over as soon as it is full.
+* When no buffer is free the builder hashes the leaf itself as its content
+* arrives, so the memory of the pool does not grow with the number of
+* files being hashed at the same time. A pool of one thread starts no
+* threads and has no buffers.
+*/
+class MerkleHashPool : public Poco::Runnable
+{
+public:
+    MerkleHashPool(size_t threadCount, uint32_t leafSize);
+    virtual ~MerkleHashPool();
+
+    /// Number of threads hashing leaves, including the calling thread.
+    size_t threads() const { return m_threads.size() + 1; }
+
+    /// Size of each leaf.
+    uint32_t leafSize() const { return m_leafSize; }
+
+    virtual void run();
+
+private:
+    friend class MerkleTreeBuilder;
+
+    /// A leaf buffer and the builder whose leaf it holds.
+    struct Leaf
+    {
+        std::vector<unsigned char> data;
+        size_t length;
+        MerkleTreeBuilder * owner;
+        size_t index;
+    };
+
+    // Makes room for the digest of the next leaf of a builder and takes a
+    // free buffer for it, hashing a queued leaf first if that frees one.
+    // Returns NULL if no buffer is free.
+    Leaf * startLeaf(MerkleTreeBuilder& builder);
+
+    // Queues a full leaf for the threads.
+    void submit(Leaf * leaf);
+
+    // Returns the buffer of a leaf that was not submitted.
+    void release(Leaf * leaf);
+
+    // Returns when every leaf a builder submitted has been hashed; the
+    // calling thread hashes queued leaves meanwhile.
+    void wait(MerkleTreeBuilder& builder);
+
+    // Hashes the last queued leaf; called with the lock held.
+    void hashQueued();
+
+    uint32_t m_leafSize;
+    std::vector<Leaf> m_leaves;
+    std::vector<Leaf *> m_free;
+    std::vector<Leaf *> m_queued;
+    bool m_stopping;
+
+    std::vector<Poco::Thread *> m_threads;
+    Poco::FastMutex m_lock;
+    Poco::Condition m_work;
+    Poco::Condition m_done;
+};
+
+/**
+* Builds the Merkle tree of a file from its content given in order, in
+* chunks of any size. Each full leaf is handed to the pool, so a builder
+* holds no content beyond the leaf it is filling.
+*/
+class MerkleTreeBuilder
+{
+public:
+    explicit MerkleTreeBuilder(MerkleHashPool& pool);
+    ~MerkleTreeBuilder();
+
+    /**
+    * Starts a new tree, dropping the leaves of an unfinished one. Keeps
+    * the memory of the leaf digest list unless it grew large.
+    */
+    void reset();
+
+    void update(const unsigned char * data, size_t length);
+
+    /**
+    * Hashes the remaining content and completes the tree.
+    */
+    void final(MerkleTree& tree);
+
+private:
+    friend class MerkleHashPool;
+
+    MerkleTreeBuilder(const MerkleTreeBuilder&);
+    MerkleTreeBuilder& operator=(const MerkleTreeBuilder&);
+
+    void startLeaf();
+    void endLeaf();
+
+    MerkleHashPool& m_pool;
+    uint32_t m_leafSize;
+    /// Buffer of the leaf being filled, or NULL if the leaf is hashed in
+    /// m_context as its content arrives.
+    MerkleHashPool::Leaf * m_leaf;
+    Sha256Context m_context;
+    bool m_inLeaf;
+    size_t m_filled;
+    /// Number of leaves started.
+    size_t m_count;
+    /// Leaves handed to the pool and not yet hashed; guarded by the lock
+    /// of the pool, which also guards resizing m_leaves.
+    size_t m_pending;
+    std::vector<unsigned char> m_leaves;
+    uint64_t m_length;
+};
+
+/**
+* Keeps the Merkle tree of each file in a directory. A tree file
+* <fileId>.hmt holds the magic "HCMT", the format version and the leaf size
+* as 32 bit little endian integers, the file size and the leaf count as 64
+* bit little endian integers, the root and the leaf digests. Inner nodes
+* are not stored; they are recomputed from the leaves, which costs a
+* fraction of a second even for very large files.
+*/
+class MerkleStore
+{
+public:
+    /**
+    * @param directory Directory to keep the trees in. Must exist.
+    */
+    explicit MerkleStore(const std::string& directory);
+
+    /**
+    * Loads the tree of a file and checks its leaves against its root.
+    *
+    * @returns false if there is no valid tree for the file.
+    */
+    bool load(uint64_t fileId, MerkleTree& tree) const;
+
+    /**
+    * Saves the tree of a file, replacing the previous one.
+    *
+    * @returns false if the tree could not be written.
+    */
+    bool save(uint64_t fileId, const MerkleTree& tree);
+
+    /// Number of trees written.
+    uint64_t saved() const { return m_saved; }
+
+private:
+    const std::string& path(uint64_t fileId) const;
+
+    std::string m_directory;
+    mutable std::string m_path;
+    std::string m_temp;
+    uint64_t m_saved;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file MidstateStore.cpp
+* Contains the implementation of the midstate store.
+*/
+
+// System includes
+#include <cstdio>
+#include <cstring>
+
+// Module includes
+#include "MidstateStore.h"
+#include "FileDigests.h"
+#include "StoreFile.h"
+
+namespace
+{
+    const char MIDSTATE_MAGIC[4] = { 'H', 'C', 'M', 'S' };
+    const uint32_t MIDSTATE_VERSION = 1;
+    const size_t HEADER_SIZE = 20 + CONTENT_GUARD_LENGTH + 4;
+
+    // Midstates hold a few hundred bytes of state, like checkpoints.
+    const uint32_t MAX_STATE_LENGTH = 65536;
+}
+
+MidstateStore::MidstateStore(const std::string& directory)
+    : m_directory(directory), m_saved(0)
+{
+}
+
+std::string MidstateStore::path(const std::string& key) const
+{
+    // Paths contain characters that file names cannot; their digest is a
+    // name that fits any file system.
+    TSK_MD5_CTX md5Ctx;
+    unsigned char digest[FileDigests::MD5_LENGTH];
+    TSK_MD5_Init(&md5Ctx);
+    TSK_MD5_Update(&md5Ctx, (unsigned char *) key.data(), (unsigned int) key.size());
+    TSK_MD5_Final(digest, &md5Ctx);
+
+    char textBuff[2 * FileDigests::MD5_LENGTH + 1];
+    digestToHex(digest, FileDigests::MD5_LENGTH, textBuff);
+    return m_directory + "/" + textBuff + ".hms";
+}
+
+bool MidstateStore::load(const std::string& key, Midstate& midstate) const
+{
+    FILE * file = fopen(path(key).c_str(), "rb");
+    if (file == NULL)
+        return false;
+
+    unsigned char header[HEADER_SIZE];
+    bool valid = fread(header, HEADER_SIZE, 1, file) == 1 &&
+        memcmp(header, MIDSTATE_MAGIC, 4) == 0 &&
+        getUInt32(header + 4) == MIDSTATE_VERSION &&
+        getUInt32(header + 8) <= MAX_STATE_LENGTH;
+
+    if (valid) {
+        midstate.state.resize(getUInt32(header + 8));
+        valid = (midstate.state.empty() || fread(&midstate.state[0], midstate.state.size(), 1, file) == 1) &&
+            storeChecksum(midstate.state) == getUInt32(header + 20 + CONTENT_GUARD_LENGTH);
+    }
+    fclose(file);
+
+    if (valid) {
+        midstate.length = getUInt64(header + 12);
+        memcpy(midstate.guard, header + 20, CONTENT_GUARD_LENGTH);
+    }
+    return valid;
+}
+
+bool MidstateStore::save(const std::string& key, const Midstate& midstate)
+{
+    unsigned char header[HEADER_SIZE];
+    memcpy(header, MIDSTATE_MAGIC, 4);
+    putUInt32(header + 4, MIDSTATE_VERSION);
+    putUInt32(header + 8, (uint32_t) midstate.state.size());
+    putUInt64(header + 12, midstate.length);
+    memcpy(header + 20, midstate.guard, CONTENT_GUARD_LENGTH);
+    putUInt32(header + 20 + CONTENT_GUARD_LENGTH, storeChecksum(midstate.state));
+
+    std::string target = path(key);
+    if (!replaceStoreFile(target, target + ".tmp", header, HEADER_SIZE,
+            midstate.state.empty() ? NULL : &midstate.state[0], midstate.state.size()))
+        return false;
+
+    m_saved++;
+    return true;
+}
@@ -0,0 +1,85 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file MidstateStore.h
+* Contains the interface of the store that keeps the hash state of files
+* across images, so that files that only grow are hashed from where they
+* ended before.
+*/
+
+#ifndef _MIDSTATE_STORE_H
+#define _MIDSTATE_STORE_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+// Module includes
+#include "StoreFile.h"
+
+/**
+* The hash state of a file after its first bytes.
+*/
+struct Midstate
+{
+    // Number of bytes the state covers.
+    uint64_t length;
+    // Digest of samples of those bytes, to tell whether they changed.
+    unsigned char guard[CONTENT_GUARD_LENGTH];
+    std::vector<unsigned char> state;
+};
+
+/**
+* Keeps one midstate per file path in a directory. Unlike checkpoints,
+* which belong to one file id, midstates are found by path and so carry
+* over to the same file in a later image of the same system.
+*
+* A midstate file <MD5 of the path>.hms holds the magic "HCMS", the format
+* version and the length of the state as 32 bit little endian integers,
+* the number of bytes covered as a 64 bit little endian integer, the guard
+* digest, a 32 bit checksum of the state and the state itself. Files are
+* written to a temporary file and renamed, as checkpoints are.
+*/
+class MidstateStore
+{
+public:
+    /**
+    * @param directory Directory to keep the midstates in. Must exist.
+    */
+    explicit MidstateStore(const std::string& directory);
+
+    /**
+    * Loads the midstate stored for a path.
+    *
+    * @returns false if there is no valid midstate for the path.
+    */
+    bool load(const std::string& key, Midstate& midstate) const;
+
+    /**
+    * Saves the midstate of a path, replacing the previous one.
+    *
+    * @returns false if the midstate could not be written.
+    */
+    bool save(const std::string& key, const Midstate& midstate);
+
+    /// Number of midstates written.
+    uint64_t saved() const { return m_saved; }
+
+private:
+    std::string path(const std::string& key) const;
+
+    std::string m_directory;
+    uint64_t m_saved;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file ObjectPool.h
+* Contains a pool that keeps per-file state objects for reuse, so that
+* hashing a file does not allocate once the pool holds as many objects as
+* are in use at the same time.
+*/
+
+#ifndef _OBJECT_POOL_H
+#define _OBJECT_POOL_H
+
+// System includes
+#include <vector>
+#include <cstddef>
+
+// Poco includes
+#include "Poco/Mutex.h"
+
+/**
+* Hands out default constructed objects of type T and keeps them when they
+* are released. Objects are not reset on release; callers prepare them
+* after acquire(), which lets objects keep buffers they have grown.
+*/
+template <class T>
+class ObjectPool
+{
+public:
+    ObjectPool() {}
+
+    ~ObjectPool()
+    {
+        for (size_t i = 0; i < m_allocated.size(); i++)
+            delete m_allocated[i];
+    }
+
+    /**
+    * Takes an object from the pool, creating a new one if all objects are
+    * in use.
+    */
+    T * acquire()
+    {
+        Poco::FastMutex::ScopedLock guard(m_lock);
+        if (!m_free.empty()) {
+            T * object = m_free.back();
+            m_free.pop_back();
+            return object;
+        }
+
+        T * object = new T();
+        m_allocated.push_back(object);
+
+        // Make room for its release now, so that release() never allocates.
+        m_free.reserve(m_allocated.size());
+        return object;
+    }
+
+    /**
+    * Returns an object taken with acquire() to the pool.
+    */
+    void release(T * object)
+    {
+        Poco::FastMutex::ScopedLock guard(m_lock);
+        m_free.push_back(object);
+    }
+
+    /**
+    * Destroys the objects of the pool. No object may be in use.
+    */
+    void clear()
+    {
+        Poco::FastMutex::ScopedLock guard(m_lock);
+        for (size_t i = 0; i < m_allocated.size(); i++)
+            delete m_allocated[i];
+        m_allocated.clear();
+        m_free.clear();
+    }
+
+    /// Number of objects the pool has created.
+    size_t allocated() const { return m_allocated.size(); }
+
+private:
+    ObjectPool(const ObjectPool&);
+    ObjectPool& operator=(const ObjectPool&);
+
+    // Every object created by the pool, and those not in use.
+    std::vector<T *> m_allocated;
+    std::vector<T *> m_free;
+    Poco::FastMutex m_lock;
+};
+
+/**
+* Holds an object of a pool for the lifetime of a scope.
+*/
+template <class T>
+class PooledObject
+{
+public:
+    explicit PooledObject(ObjectPool<T>& pool) : m_pool(pool), m_object(pool.acquire()) {}
+    ~PooledObject() { m_pool.release(m_object); }
+
+    T& operator*() const { return *m_object; }
+    T * operator->() const { return m_object; }
+
+private:
+    PooledObject(const PooledObject&);
+    PooledObject& operator=(const PooledObject&);
+
+    ObjectPool<T>& m_pool;
+    T * m_object;
+};
+
+#endif
@@ -0,0 +1,343 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file RawImage.cpp
+* Contains the implementation of the raw image view and of the file extent
+* lookup.
+*/
+
+// System includes
+#include <memory>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// Module includes
+#include "RawImage.h"
+
+// The image database reports sector runs in 512 byte units regardless of
+// the sector size of the image.
+static const uint64_t DB_SECTOR_SIZE = 512;
+
+bool getFileExtents(uint64_t fileId, uint64_t fileSize, std::vector<ImageExtent>& extents)
+{
+    extents.clear();
+    if (fileSize == 0)
+        return false;
+
+    std::auto_ptr<SectorRuns> runs(TskServices::Instance().getImgDB().getFileSectors(fileId));
+    if (runs.get() == NULL)
+        return false;
+
+    uint64_t remaining = fileSize;
+    runs->begin();
+    do {
+        uint64_t length = runs->getDataLen() * DB_SECTOR_SIZE;
+        if (length == 0)
+            continue;
+
+        ImageExtent extent;
+        extent.offset = runs->getDataStart() * DB_SECTOR_SIZE;
+        extent.length = length < remaining ? length : remaining;
+
+        // Merge runs that are contiguous in the image.
+        if (!extents.empty() && extents.back().offset + extents.back().length == extent.offset)
+            extents.back().length += extent.length;
+        else
+            extents.push_back(extent);
+
+        remaining -= extent.length;
+    } while (remaining > 0 && runs->next() != -1);
+
+    // Runs that do not cover the whole file mean that part of the content
+    // is resident, sparse or compressed and has to be read through TskFile.
+    if (remaining > 0) {
+        extents.clear();
+        return false;
+    }
+    return true;
+}
+
+RawImage::RawImage()
+#ifdef _WIN32
+    : m_file(INVALID_HANDLE_VALUE), m_mapping(NULL), m_directFile(INVALID_HANDLE_VALUE),
+#else
+    : m_fd(-1), m_directFd(-1),
+#endif
+      m_size(0), m_granularity(0), m_windowSize(0),
+      m_window(NULL), m_windowOffset(0), m_windowLength(0)
+{
+}
+
+RawImage::~RawImage()
+{
+    close();
+}
+
+bool RawImage::openCaseImage()
+{
+    TskImgDB& imgDB = TskServices::Instance().getImgDB();
+
+    int type = 0;
+    int sectorSize = 0;
+    if (imgDB.getImageInfo(type, sectorSize) != 0 || type != TSK_IMG_TYPE_RAW)
+        return false;
+
+    std::vector<std::string> names = imgDB.getImageNames();
+    if (names.size() != 1)
+        return false;
+
+    return open(names[0]);
+}
+
+bool RawImage::open(const std::string& path)
+{
+    close();
+
+    // Large windows keep the number of map calls low, but a 32 bit process
+    // does not have the address space for them.
+    m_windowSize = sizeof(void *) >= 8 ? (1ULL << 30) : (64ULL << 20);
+
+#ifdef _WIN32
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    m_size = (uint64_t) size.QuadPart;
+
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping == NULL) {
+        close();
+        return false;
+    }
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    m_granularity = info.dwAllocationGranularity;
+#else
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || st.st_size == 0) {
+        close();
+        return false;
+    }
+    m_size = (uint64_t) st.st_size;
+    m_granularity = (uint64_t) sysconf(_SC_PAGESIZE);
+#endif
+
+    m_path = path;
+    return true;
+}
+
+bool RawImage::openDirect()
+{
+    if (m_path.empty())
+        return false;
+
+#ifdef _WIN32
+    if (m_directFile == INVALID_HANDLE_VALUE)
+        m_directFile = CreateFileA(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    return m_directFile != INVALID_HANDLE_VALUE;
+#else
+    if (m_directFd >= 0)
+        return true;
+
+#if defined(O_DIRECT)
+    m_directFd = ::open(m_path.c_str(), O_RDONLY | O_DIRECT);
+#elif defined(F_NOCACHE)
+    m_directFd = ::open(m_path.c_str(), O_RDONLY);
+    if (m_directFd >= 0 && fcntl(m_directFd, F_NOCACHE, 1) != 0) {
+        ::close(m_directFd);
+        m_directFd = -1;
+    }
+#endif
+    return m_directFd >= 0;
+#endif
+}
+
+void RawImage::close()
+{
+    unmapWindow();
+
+#ifdef _WIN32
+    if (m_mapping != NULL) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    if (m_directFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_directFile);
+        m_directFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    if (m_directFd >= 0) {
+        ::close(m_directFd);
+        m_directFd = -1;
+    }
+#endif
+    m_path.clear();
+    m_size = 0;
+}
+
+bool RawImage::contains(const std::vector<ImageExtent>& extents) const
+{
+    for (std::vector<ImageExtent>::const_iterator it = extents.begin(); it != extents.end(); ++it) {
+        if (it->offset > m_size || it->length > m_size - it->offset)
+            return false;
+    }
+    return true;
+}
+
+void RawImage::unmapWindow()
+{
+    if (m_window == NULL)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_window);
+#else
+    munmap(m_window, (size_t) m_windowLength);
+#endif
+    m_window = NULL;
+    m_windowOffset = 0;
+    m_windowLength = 0;
+}
+
+const unsigned char * RawImage::map(uint64_t offset, size_t length)
+{
+    if (length > MAX_MAP_LENGTH || offset > m_size || length > m_size - offset)
+        return NULL;
+
+    if (m_window != NULL && offset >= m_windowOffset &&
+        offset + length <= m_windowOffset + m_windowLength)
+        return m_window + (offset - m_windowOffset);
+
+    unmapWindow();
+
+    uint64_t start = offset - (offset % m_granularity);
+    uint64_t windowLength = m_size - start < m_windowSize ? m_size - start : m_windowSize;
+
+#ifdef _WIN32
+    void * view = MapViewOfFile(m_mapping, FILE_MAP_READ, (DWORD) (start >> 32),
+        (DWORD) (start & 0xffffffff), (SIZE_T) windowLength);
+    if (view == NULL)
+        return NULL;
+#else
+    void * view = mmap(NULL, (size_t) windowLength, PROT_READ, MAP_SHARED, m_fd, (off_t) start);
+    if (view == MAP_FAILED)
+        return NULL;
+
+    // The window is consumed front to back once: ask for aggressive
+    // read-ahead and, where the kernel supports it for file mappings,
+    // huge pages to cut TLB misses.
+    madvise(view, (size_t) windowLength, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(view, (size_t) windowLength, MADV_HUGEPAGE);
+#endif
+#endif
+
+    m_window = (unsigned char *) view;
+    m_windowOffset = start;
+    m_windowLength = windowLength;
+    return m_window + (offset - m_windowOffset);
+}
+
+bool RawImage::read(uint64_t offset, unsigned char * buffer, size_t length) const
+{
+    while (length > 0) {
+#ifdef _WIN32
+        // A synchronous read at an explicit offset does not depend on the
+        // position of the handle.
+        OVERLAPPED overlapped = { 0 };
+        overlapped.Offset = (DWORD) (offset & 0xffffffff);
+        overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+        DWORD chunk = length > 0x40000000 ? 0x40000000 : (DWORD) length;
+        DWORD bytesRead = 0;
+        if (!ReadFile(m_file, buffer, chunk, &bytesRead, &overlapped) || bytesRead == 0)
+            return false;
+#else
+        ssize_t bytesRead = pread(m_fd, buffer, length, (off_t) offset);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return false;
+#endif
+        offset += bytesRead;
+        buffer += bytesRead;
+        length -= bytesRead;
+    }
+    return true;
+}
+
+bool RawImage::readDirect(uint64_t offset, unsigned char * buffer, size_t length, size_t& bytesRead) const
+{
+    bytesRead = 0;
+    while (length > 0) {
+#ifdef _WIN32
+        OVERLAPPED overlapped = { 0 };
+        overlapped.Offset = (DWORD) (offset & 0xffffffff);
+        overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+        // Keep chunks aligned; the limit only matters for huge lengths.
+        DWORD chunk = length > 0x40000000 ? 0x40000000 : (DWORD) length;
+        DWORD count = 0;
+        if (!ReadFile(m_directFile, buffer, chunk, &count, &overlapped)) {
+            if (GetLastError() == ERROR_HANDLE_EOF)
+                return true;
+            return false;
+        }
+#else
+        ssize_t count = pread(m_directFd, buffer, length, (off_t) offset);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            return false;
+#endif
+        // A short read only happens at the end of the image, where the
+        // remaining length is not aligned anymore.
+        if (count == 0)
+            return true;
+
+        offset += count;
+        buffer += count;
+        length -= count;
+        bytesRead += count;
+        if (bytesRead % DIRECT_IO_ALIGNMENT != 0)
+            return true;
+    }
+    return true;
+}
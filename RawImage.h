@@ -0,0 +1,166 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file RawImage.h
+* Contains the interface of the class that gives the module direct access
+* to the bytes of a raw (dd) image file, and of the helper that maps a file
+* to the image extents holding its content.
+*/
+
+#ifndef _RAW_IMAGE_H
+#define _RAW_IMAGE_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* A contiguous run of file content inside the image.
+*/
+struct ImageExtent
+{
+    /// Byte offset of the run in the image.
+    uint64_t offset;
+    /// Length of the run in bytes.
+    uint64_t length;
+};
+
+/**
+* Gets the image extents that hold the content of a file, in file order,
+* trimmed to the size of the file. Fails for files whose content is not
+* stored as plain runs of sectors, such as resident, sparse or compressed
+* files, and for files without a sector map.
+*
+* @param fileId Id of the file.
+* @param fileSize Size of the file in bytes.
+* @param extents Receives the extents.
+* @returns true if the extents cover exactly the content of the file.
+*/
+bool getFileExtents(uint64_t fileId, uint64_t fileSize, std::vector<ImageExtent>& extents);
+
+/**
+* Read-only view of a single-segment raw image file. Content is accessed
+* through a memory mapped window that slides over the image, so hashing
+* reads straight from the page cache without copying into a buffer.
+*/
+class RawImage
+{
+public:
+    RawImage();
+    ~RawImage();
+
+    /**
+    * Opens the image file of the current case if it is a single-segment
+    * raw image.
+    *
+    * @returns false if the image is not a raw image or cannot be opened.
+    */
+    bool openCaseImage();
+
+    /**
+    * Opens an image file.
+    *
+    * @param path Path of the image file.
+    * @returns false if the file cannot be opened.
+    */
+    bool open(const std::string& path);
+
+    void close();
+
+    /**
+    * @returns The size of the image in bytes.
+    */
+    uint64_t size() const { return m_size; }
+
+    /**
+    * @returns true if every extent lies inside the image.
+    */
+    bool contains(const std::vector<ImageExtent>& extents) const;
+
+    /**
+    * Maps a range of the image into memory. The pointer stays valid until
+    * the next call to map() or close().
+    *
+    * @param offset Byte offset of the range.
+    * @param length Length of the range; at most MAX_MAP_LENGTH bytes.
+    * @returns A pointer to the bytes of the range, or NULL on error.
+    */
+    const unsigned char * map(uint64_t offset, size_t length);
+
+    /**
+    * Reads a range of the image without moving a shared file position, so
+    * several threads may read at the same time.
+    *
+    * @returns true if the whole range was read.
+    */
+    bool read(uint64_t offset, unsigned char * buffer, size_t length) const;
+
+#ifndef _WIN32
+    /**
+    * @returns The file descriptor of the image file.
+    */
+    int descriptor() const { return m_fd; }
+#endif
+
+    /**
+    * Opens a second handle of the image file that bypasses the page cache
+    * (O_DIRECT, F_NOCACHE or FILE_FLAG_NO_BUFFERING), for readDirect().
+    *
+    * @returns false if the platform or file system does not support it.
+    */
+    bool openDirect();
+
+    /**
+    * Reads a range of the image through the handle opened by openDirect().
+    * The offset, the length and the buffer address must be multiples of
+    * DIRECT_IO_ALIGNMENT.
+    *
+    * @param bytesRead Receives the number of bytes read, which is less
+    * than length only at the end of the image.
+    * @returns false on a read error.
+    */
+    bool readDirect(uint64_t offset, unsigned char * buffer, size_t length, size_t& bytesRead) const;
+
+    /// Longest range that can be mapped with a single call to map().
+    static const size_t MAX_MAP_LENGTH = 8 * 1024 * 1024;
+
+    /// Alignment of direct reads. A multiple of the logical sector size of
+    /// both 512 byte and 4 KiB sector disks.
+    static const size_t DIRECT_IO_ALIGNMENT = 4096;
+
+private:
+    RawImage(const RawImage&);
+    RawImage& operator=(const RawImage&);
+
+    void unmapWindow();
+
+    std::string m_path;
+#ifdef _WIN32
+    void * m_file;
+    void * m_mapping;
+    void * m_directFile;
+#else
+    int m_fd;
+    int m_directFd;
+#endif
+    uint64_t m_size;
+    uint64_t m_granularity;
+    uint64_t m_windowSize;
+
+    // Currently mapped window.
+    unsigned char * m_window;
+    uint64_t m_windowOffset;
+    uint64_t m_windowLength;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file Sha256.cpp
+* Contains the implementation of SHA-256 as specified in FIPS 180-4.
+*/
+
+// System includes
+#include <cstring>
+
+// Module includes
+#include "Sha256.h"
+
+namespace
+{
+    const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    inline uint32_t rotr(uint32_t x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void transform(uint32_t * state, const unsigned char * block)
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = ((uint32_t) block[4 * i] << 24) | ((uint32_t) block[4 * i + 1] << 16) |
+                ((uint32_t) block[4 * i + 2] << 8) | (uint32_t) block[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+void sha256Init(Sha256Context * context)
+{
+    static const uint32_t INITIAL_STATE[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(context->state, INITIAL_STATE, sizeof(INITIAL_STATE));
+    context->length = 0;
+    context->buffered = 0;
+}
+
+void sha256Update(Sha256Context * context, const unsigned char * data, size_t length)
+{
+    if (length == 0)
+        return;
+    context->length += length;
+
+    if (context->buffered > 0) {
+        size_t fill = 64 - context->buffered;
+        if (fill > length)
+            fill = length;
+        memcpy(context->buffer + context->buffered, data, fill);
+        context->buffered += fill;
+        data += fill;
+        length -= fill;
+
+        if (context->buffered < 64)
+            return;
+        transform(context->state, context->buffer);
+        context->buffered = 0;
+    }
+
+    while (length >= 64) {
+        transform(context->state, data);
+        data += 64;
+        length -= 64;
+    }
+
+    memcpy(context->buffer, data, length);
+    context->buffered = length;
+}
+
+void sha256Final(unsigned char * digest, Sha256Context * context)
+{
+    uint64_t bits = context->length * 8;
+
+    // Pad with a one bit, zeros and the message length in bits so that the
+    // last block ends exactly after the length.
+    static const unsigned char PADDING[64] = { 0x80 };
+    size_t padding = context->buffered < 56 ? 56 - context->buffered : 120 - context->buffered;
+    sha256Update(context, PADDING, padding);
+
+    unsigned char lengthBytes[8];
+    for (int i = 0; i < 8; i++)
+        lengthBytes[i] = (unsigned char) (bits >> (56 - 8 * i));
+    sha256Update(context, lengthBytes, 8);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (unsigned char) (context->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char) (context->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char) (context->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char) context->state[i];
+    }
+}
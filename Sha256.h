@@ -0,0 +1,44 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file Sha256.h
+* Contains the interface of the SHA-256 implementation used for Merkle
+* tree digests. The TSK library only provides MD5 and SHA-1.
+*/
+
+#ifndef _SHA256_H
+#define _SHA256_H
+
+// System includes
+#include <cstddef>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/// Length of a SHA-256 digest in bytes.
+static const size_t SHA256_LENGTH = 32;
+
+/**
+* State of a SHA-256 calculation, used like the TSK_MD5_CTX and TSK_SHA_CTX
+* contexts.
+*/
+struct Sha256Context
+{
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t buffered;
+};
+
+void sha256Init(Sha256Context * context);
+void sha256Update(Sha256Context * context, const unsigned char * data, size_t length);
+void sha256Final(unsigned char * digest, Sha256Context * context);
+
+#endif
@@ -0,0 +1,145 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file SharedExtentIndex.cpp
+* Contains the implementation of the shared extent index.
+*/
+
+// System includes
+#include <cstring>
+
+// Module includes
+#include "SharedExtentIndex.h"
+
+namespace
+{
+    // Approximate memory of a hashed layout: the key and digests, the map
+    // node and the entry in the order of layouts.
+    const size_t HASHED_LAYOUT_SIZE = 128;
+
+    void updateUInt64(TSK_MD5_CTX * md5Ctx, uint64_t value)
+    {
+        unsigned char buf[8];
+        for (int i = 0; i < 8; i++)
+            buf[i] = (unsigned char) (value >> (8 * i));
+        TSK_MD5_Update(md5Ctx, buf, sizeof(buf));
+    }
+}
+
+bool SharedExtentIndex::LayoutKey::operator<(const LayoutKey& other) const
+{
+    return memcmp(digest, other.digest, sizeof(digest)) < 0;
+}
+
+SharedExtentIndex::SharedExtentIndex(size_t memoryLimit)
+    : m_maxHashed(memoryLimit / HASHED_LAYOUT_SIZE > 0 ? memoryLimit / HASHED_LAYOUT_SIZE : 1),
+      m_copiedFiles(0), m_copiedBytes(0), m_forgotten(0)
+{
+}
+
+SharedExtentIndex::LayoutKey SharedExtentIndex::layoutKey(uint64_t size, const std::vector<ImageExtent>& extents)
+{
+    TSK_MD5_CTX md5Ctx;
+    TSK_MD5_Init(&md5Ctx);
+    updateUInt64(&md5Ctx, size);
+    for (std::vector<ImageExtent>::const_iterator it = extents.begin(); it != extents.end(); ++it) {
+        updateUInt64(&md5Ctx, it->offset);
+        updateUInt64(&md5Ctx, it->length);
+    }
+
+    LayoutKey key;
+    TSK_MD5_Final(key.digest, &md5Ctx);
+    return key;
+}
+
+SharedExtentIndex::Lookup SharedExtentIndex::lookup(uint64_t fileId, uint64_t size,
+    const std::vector<ImageExtent>& extents, FileDigests& digests)
+{
+    LayoutKey key = layoutKey(size, extents);
+
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    std::map<LayoutKey, FileDigests>::const_iterator hashed = m_hashed.find(key);
+    if (hashed != m_hashed.end()) {
+        digests = hashed->second;
+        m_copiedFiles++;
+        m_copiedBytes += size;
+        return LOOKUP_HASHED;
+    }
+
+    std::map<LayoutKey, PendingLayout>::iterator pending = m_pending.find(key);
+    if (pending != m_pending.end()) {
+        // The same file may be looked up again if it is hashed more than
+        // once; it still owns the layout.
+        if (pending->second.owner == fileId)
+            return LOOKUP_NEW;
+
+        Waiter waiter;
+        waiter.fileId = fileId;
+        waiter.size = size;
+        pending->second.waiters.push_back(waiter);
+        return LOOKUP_PENDING;
+    }
+
+    PendingLayout& layout = m_pending[key];
+    layout.owner = fileId;
+    m_owners[fileId] = key;
+    return LOOKUP_NEW;
+}
+
+void SharedExtentIndex::complete(uint64_t fileId, const FileDigests& digests, std::vector<Waiter>& waiters)
+{
+    waiters.clear();
+
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    std::map<uint64_t, LayoutKey>::iterator owner = m_owners.find(fileId);
+    if (owner == m_owners.end())
+        return;
+
+    LayoutKey key = owner->second;
+    m_owners.erase(owner);
+
+    std::map<LayoutKey, PendingLayout>::iterator pending = m_pending.find(key);
+    if (pending != m_pending.end()) {
+        waiters.swap(pending->second.waiters);
+        m_pending.erase(pending);
+    }
+    std::pair<std::map<LayoutKey, FileDigests>::iterator, bool> hashed =
+        m_hashed.insert(std::make_pair(key, digests));
+    if (hashed.second)
+        m_hashedOrder.push_back(key);
+    else
+        hashed.first->second = digests;
+
+    while (m_hashed.size() > m_maxHashed) {
+        m_hashed.erase(m_hashedOrder.front());
+        m_hashedOrder.pop_front();
+        m_forgotten++;
+    }
+
+    for (std::vector<Waiter>::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+        m_copiedFiles++;
+        m_copiedBytes += it->size;
+    }
+}
+
+void SharedExtentIndex::abandon(std::vector<Waiter>& waiters)
+{
+    waiters.clear();
+
+    Poco::FastMutex::ScopedLock guard(m_lock);
+
+    for (std::map<LayoutKey, PendingLayout>::const_iterator it = m_pending.begin(); it != m_pending.end(); ++it)
+        waiters.insert(waiters.end(), it->second.waiters.begin(), it->second.waiters.end());
+
+    m_pending.clear();
+    m_owners.clear();
+}
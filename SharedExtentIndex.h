@@ -0,0 +1,139 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file SharedExtentIndex.h
+* Contains the interface of the index that recognizes files stored in the
+* same extents of the image as a file that was already hashed.
+*/
+
+#ifndef _SHARED_EXTENT_INDEX_H
+#define _SHARED_EXTENT_INDEX_H
+
+// System includes
+#include <deque>
+#include <map>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+// Module includes
+#include "FileDigests.h"
+#include "RawImage.h"
+
+// Poco includes
+#include "Poco/Mutex.h"
+
+/**
+* Maps the physical layout of files, their size and list of image extents,
+* to their digests. Hard links, shadow copies and reflinked files appear as
+* separate files stored in the same extents; only the first of them has to
+* be read, the others get its digests.
+*
+* A layout is identified by an MD5 of the size and the extents. A file is
+* the owner of its layout from lookup() until its digests are posted with
+* complete(); files with the same layout that arrive in the meantime wait
+* for those digests. Hashed layouts are kept up to a memory limit; beyond
+* it the oldest are forgotten, and a file with a forgotten layout is hashed
+* again.
+*/
+class SharedExtentIndex
+{
+public:
+    enum Lookup
+    {
+        /// The layout is new; the file has to be hashed.
+        LOOKUP_NEW,
+        /// A file with the layout is being hashed; the file waits for it.
+        LOOKUP_PENDING,
+        /// The layout was hashed; its digests were returned.
+        LOOKUP_HASHED
+    };
+
+    /**
+    * A file waiting for the digests of another file.
+    */
+    struct Waiter
+    {
+        uint64_t fileId;
+        uint64_t size;
+    };
+
+    /**
+    * @param memoryLimit Number of bytes the hashed layouts may use.
+    */
+    explicit SharedExtentIndex(size_t memoryLimit);
+
+    /**
+    * Looks up the layout of a file.
+    *
+    * @param fileId Id of the file.
+    * @param size Size of the file.
+    * @param extents Image extents of the file's content, in file order.
+    * @param digests Receives the digests if the layout was hashed.
+    */
+    Lookup lookup(uint64_t fileId, uint64_t size, const std::vector<ImageExtent>& extents, FileDigests& digests);
+
+    /**
+    * Records the digests of a file. If the file owns a layout, the layout
+    * is hashed from then on.
+    *
+    * @param waiters Receives the files that waited for these digests.
+    */
+    void complete(uint64_t fileId, const FileDigests& digests, std::vector<Waiter>& waiters);
+
+    /**
+    * Gives up on all layouts whose owner was not completed, for example
+    * because it could not be read.
+    *
+    * @param waiters Receives the files that waited for them; they have to
+    * be hashed themselves.
+    */
+    void abandon(std::vector<Waiter>& waiters);
+
+    /// Number of files that got the digests of another file.
+    uint64_t copiedFiles() const { return m_copiedFiles; }
+    /// Number of bytes of those files, which were not read.
+    uint64_t copiedBytes() const { return m_copiedBytes; }
+    /// Number of hashed layouts forgotten to stay within the memory limit.
+    uint64_t forgotten() const { return m_forgotten; }
+
+private:
+    struct LayoutKey
+    {
+        unsigned char digest[FileDigests::MD5_LENGTH];
+
+        bool operator<(const LayoutKey& other) const;
+    };
+
+    struct PendingLayout
+    {
+        uint64_t owner;
+        std::vector<Waiter> waiters;
+    };
+
+    static LayoutKey layoutKey(uint64_t size, const std::vector<ImageExtent>& extents);
+
+    std::map<LayoutKey, FileDigests> m_hashed;
+    // Hashed layouts, oldest first.
+    std::deque<LayoutKey> m_hashedOrder;
+    size_t m_maxHashed;
+    std::map<LayoutKey, PendingLayout> m_pending;
+    // Layout owned by each file that is being hashed.
+    std::map<uint64_t, LayoutKey> m_owners;
+
+    uint64_t m_copiedFiles;
+    uint64_t m_copiedBytes;
+    uint64_t m_forgotten;
+
+    Poco::FastMutex m_lock;
+};
+
+#endif
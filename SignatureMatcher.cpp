@@ -0,0 +1,237 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file SignatureMatcher.cpp
+* Contains the implementation of the file signature matcher.
+*/
+
+// System includes
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <cstdlib>
+
+// Module includes
+#include "SignatureMatcher.h"
+
+namespace
+{
+    struct DefaultSignature
+    {
+        uint32_t offset;
+        const char * bytes;
+        size_t length;
+        const char * type;
+    };
+
+#define SIGNATURE(offset, bytes, type) { offset, bytes, sizeof(bytes) - 1, type }
+
+    const DefaultSignature DEFAULT_SIGNATURES[] = {
+        SIGNATURE(0, "%PDF-", "application/pdf"),
+        SIGNATURE(0, "%!PS", "application/postscript"),
+        SIGNATURE(0, "{\\rtf", "text/rtf"),
+        SIGNATURE(0, "<?xml", "text/xml"),
+        SIGNATURE(0, "\x89PNG\r\n\x1a\n", "image/png"),
+        SIGNATURE(0, "\xff\xd8\xff", "image/jpeg"),
+        SIGNATURE(0, "GIF87a", "image/gif"),
+        SIGNATURE(0, "GIF89a", "image/gif"),
+        SIGNATURE(0, "II*\x00", "image/tiff"),
+        SIGNATURE(0, "MM\x00*", "image/tiff"),
+        SIGNATURE(0, "PK\x03\x04", "application/zip"),
+        SIGNATURE(0, "\x1f\x8b", "application/gzip"),
+        SIGNATURE(0, "BZh", "application/x-bzip2"),
+        SIGNATURE(0, "\xfd" "7zXZ\x00", "application/x-xz"),
+        SIGNATURE(0, "7z\xbc\xaf\x27\x1c", "application/x-7z-compressed"),
+        SIGNATURE(0, "Rar!\x1a\x07", "application/x-rar-compressed"),
+        SIGNATURE(0, "MSCF", "application/vnd.ms-cab-compressed"),
+        SIGNATURE(257, "ustar", "application/x-tar"),
+        SIGNATURE(0, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", "application/x-ole-storage"),
+        SIGNATURE(0, "SQLite format 3\x00", "application/x-sqlite3"),
+        SIGNATURE(0, "regf", "application/x-windows-registry"),
+        SIGNATURE(0, "EVF\x09\x0d\x0a\xff\x00", "application/x-ewf"),
+        SIGNATURE(0, "\x7f" "ELF", "application/x-executable"),
+        SIGNATURE(0, "MZ", "application/x-dosexec"),
+        SIGNATURE(0, "\xca\xfe\xba\xbe", "application/java-vm"),
+        SIGNATURE(0, "ID3", "audio/mpeg"),
+        SIGNATURE(0, "OggS", "audio/ogg"),
+        SIGNATURE(0, "fLaC", "audio/flac"),
+        SIGNATURE(8, "WAVE", "audio/x-wav"),
+        SIGNATURE(8, "AVI ", "video/x-msvideo"),
+        SIGNATURE(4, "ftyp", "video/mp4"),
+        SIGNATURE(0, "\x1a\x45\xdf\xa3", "video/x-matroska")
+    };
+
+#undef SIGNATURE
+
+    bool parseHex(const std::string& text, std::vector<unsigned char>& bytes)
+    {
+        bytes.clear();
+        if (text.empty() || text.size() % 2 != 0)
+            return false;
+
+        for (size_t i = 0; i < text.size(); i += 2) {
+            int value = 0;
+            for (size_t j = i; j < i + 2; j++) {
+                char c = text[j];
+                value <<= 4;
+                if (c >= '0' && c <= '9')
+                    value |= c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    value |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F')
+                    value |= c - 'A' + 10;
+                else
+                    return false;
+            }
+            bytes.push_back((unsigned char) value);
+        }
+        return true;
+    }
+}
+
+SignatureMatcher::SignatureMatcher() : m_window(0)
+{
+}
+
+bool SignatureMatcher::add(uint32_t offset, const std::vector<unsigned char>& bytes, const std::string& type)
+{
+    if (bytes.empty() || offset > MAX_WINDOW || bytes.size() > MAX_WINDOW - offset)
+        return false;
+
+    Signature signature;
+    signature.offset = offset;
+    signature.length = (uint32_t) bytes.size();
+    signature.type = type;
+    m_signatures.push_back(signature);
+    m_patterns.push_back(bytes);
+
+    if (offset + bytes.size() > m_window)
+        m_window = offset + bytes.size();
+    return true;
+}
+
+void SignatureMatcher::addDefaults()
+{
+    for (size_t i = 0; i < sizeof(DEFAULT_SIGNATURES) / sizeof(DEFAULT_SIGNATURES[0]); i++) {
+        const DefaultSignature& signature = DEFAULT_SIGNATURES[i];
+        std::vector<unsigned char> bytes(signature.bytes, signature.bytes + signature.length);
+        add(signature.offset, bytes, signature.type);
+    }
+}
+
+bool SignatureMatcher::load(const std::string& path)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string offsetText, hex, type;
+        if (!(fields >> offsetText) || offsetText[0] == '#')
+            continue;
+
+        char * end = NULL;
+        unsigned long offset = strtoul(offsetText.c_str(), &end, 10);
+        std::vector<unsigned char> bytes;
+        if (*end != '\0' || !(fields >> hex >> type) || !parseHex(hex, bytes) ||
+            offset > MAX_WINDOW || !add((uint32_t) offset, bytes, type))
+            return false;
+    }
+    return true;
+}
+
+void SignatureMatcher::compile()
+{
+    static const uint32_t NONE = 0xffffffff;
+
+    // Build the trie of the patterns.
+    m_next.assign(256, NONE);
+    m_outputs.assign(1, std::vector<uint32_t>());
+    for (size_t id = 0; id < m_patterns.size(); id++) {
+        uint32_t state = 0;
+        const std::vector<unsigned char>& pattern = m_patterns[id];
+        for (size_t i = 0; i < pattern.size(); i++) {
+            uint32_t& next = m_next[state * 256 + pattern[i]];
+            if (next == NONE) {
+                next = (uint32_t) m_outputs.size();
+                m_outputs.push_back(std::vector<uint32_t>());
+                m_next.resize(m_next.size() + 256, NONE);
+            }
+            // The resize may have moved the table.
+            state = m_next[state * 256 + pattern[i]];
+        }
+        m_outputs[state].push_back((uint32_t) id);
+    }
+
+    // Turn the trie into a complete automaton in breadth first order: a
+    // missing transition follows the failure link, the state of the
+    // longest proper suffix that is also in the trie. A state also reports
+    // the patterns of its failure state.
+    std::vector<uint32_t> fail(m_outputs.size(), 0);
+    std::deque<uint32_t> queue;
+    for (int c = 0; c < 256; c++) {
+        uint32_t& next = m_next[c];
+        if (next == NONE)
+            next = 0;
+        else
+            queue.push_back(next);
+    }
+
+    while (!queue.empty()) {
+        uint32_t state = queue.front();
+        queue.pop_front();
+
+        const std::vector<uint32_t>& inherited = m_outputs[fail[state]];
+        m_outputs[state].insert(m_outputs[state].end(), inherited.begin(), inherited.end());
+
+        for (int c = 0; c < 256; c++) {
+            uint32_t& next = m_next[state * 256 + c];
+            uint32_t fallback = m_next[fail[state] * 256 + c];
+            if (next == NONE)
+                next = fallback;
+            else {
+                fail[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    m_patterns.clear();
+}
+
+const std::string * SignatureMatcher::match(const unsigned char * head, size_t length) const
+{
+    if (m_next.empty())
+        return NULL;
+
+    if (length > m_window)
+        length = m_window;
+
+    const Signature * best = NULL;
+    uint32_t state = 0;
+    for (size_t i = 0; i < length; i++) {
+        state = m_next[state * 256 + head[i]];
+
+        // Patterns are found where they end; a signature only counts at
+        // its own offset.
+        const std::vector<uint32_t>& outputs = m_outputs[state];
+        for (std::vector<uint32_t>::const_iterator it = outputs.begin(); it != outputs.end(); ++it) {
+            const Signature& signature = m_signatures[*it];
+            if (i + 1 != (size_t) signature.offset + signature.length)
+                continue;
+            if (best == NULL || signature.length > best->length ||
+                (signature.length == best->length && &signature < best))
+                best = &signature;
+        }
+    }
+    return best != NULL ? &best->type : NULL;
+}
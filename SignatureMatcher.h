@@ -0,0 +1,103 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file SignatureMatcher.h
+* Contains the interface of the matcher that recognizes the type of a file
+* from signatures (magic numbers) at fixed offsets in its first bytes.
+*/
+
+#ifndef _SIGNATURE_MATCHER_H
+#define _SIGNATURE_MATCHER_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* Matches a set of signatures against the head of a file in one pass. The
+* signatures are compiled into an Aho-Corasick automaton, so the cost per
+* byte does not depend on the number of signatures.
+*/
+class SignatureMatcher
+{
+public:
+    /// Signatures must end within this many bytes of the start of a file.
+    static const size_t MAX_WINDOW = 65536;
+
+    SignatureMatcher();
+
+    /**
+    * Adds a signature. Signatures can only be added before compile().
+    *
+    * @param offset Offset of the signature in the file.
+    * @param bytes The signature.
+    * @param type The file type it identifies.
+    * @returns false if the signature is empty or ends past MAX_WINDOW.
+    */
+    bool add(uint32_t offset, const std::vector<unsigned char>& bytes, const std::string& type);
+
+    /**
+    * Adds signatures of common file types.
+    */
+    void addDefaults();
+
+    /**
+    * Adds the signatures of a file with one signature per line: the
+    * decimal offset, the signature in hexadecimal and the type, separated
+    * by white space. Empty lines and lines starting with '#' are skipped.
+    *
+    * @returns false if the file cannot be read or has an invalid line.
+    */
+    bool load(const std::string& path);
+
+    /**
+    * Builds the automaton from the signatures added so far.
+    */
+    void compile();
+
+    /// Number of signatures.
+    size_t size() const { return m_signatures.size(); }
+
+    /// Number of bytes at the start of a file that signatures can cover.
+    size_t window() const { return m_window; }
+
+    /**
+    * Finds the longest signature that matches the head of a file; the
+    * first one added wins between signatures of the same length.
+    *
+    * @param head The first bytes of the file; bytes past window() are
+    * ignored.
+    * @param length Number of bytes in head.
+    * @returns The type of the matching signature, or NULL if none matches.
+    */
+    const std::string * match(const unsigned char * head, size_t length) const;
+
+private:
+    struct Signature
+    {
+        uint32_t offset;
+        uint32_t length;
+        std::string type;
+    };
+
+    std::vector<Signature> m_signatures;
+    std::vector<std::vector<unsigned char> > m_patterns;
+    size_t m_window;
+
+    // Transitions of the automaton, 256 per state, and the signatures that
+    // end in each state.
+    std::vector<uint32_t> m_next;
+    std::vector<std::vector<uint32_t> > m_outputs;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file SizeCollisionFilter.cpp
+* Contains the implementation of the size collision filter.
+*/
+
+// System includes
+#include <algorithm>
+#include <cstring>
+
+// Module includes
+#include "SizeCollisionFilter.h"
+
+namespace
+{
+    bool sameKey(const DedupCandidate& a, const DedupCandidate& b)
+    {
+        return a.size == b.size && memcmp(a.head, b.head, DedupCandidate::HEAD_DIGEST_LENGTH) == 0;
+    }
+
+    bool compareCandidates(const DedupCandidate& a, const DedupCandidate& b)
+    {
+        if (a.size != b.size)
+            return a.size < b.size;
+        int head = memcmp(a.head, b.head, DedupCandidate::HEAD_DIGEST_LENGTH);
+        if (head != 0)
+            return head < 0;
+        return a.fileId < b.fileId;
+    }
+}
+
+SizeCollisionFilter::SizeCollisionFilter()
+    : m_files(0), m_droppedFiles(0), m_droppedBytes(0)
+{
+}
+
+void SizeCollisionFilter::add(uint64_t fileId, uint64_t size)
+{
+    m_files++;
+
+    // Empty files are all the same and not worth reporting.
+    if (size == 0) {
+        m_droppedFiles++;
+        return;
+    }
+
+    DedupCandidate candidate;
+    candidate.size = size;
+    memset(candidate.head, 0, sizeof(candidate.head));
+    candidate.fileId = fileId;
+    m_candidates.push_back(candidate);
+}
+
+size_t SizeCollisionFilter::keepCollisions()
+{
+    std::sort(m_candidates.begin(), m_candidates.end(), compareCandidates);
+
+    // Compact the files of every run of equal keys longer than one.
+    size_t kept = 0;
+    size_t dropped = 0;
+    size_t start = 0;
+    while (start < m_candidates.size()) {
+        size_t end = start + 1;
+        while (end < m_candidates.size() && sameKey(m_candidates[start], m_candidates[end]))
+            end++;
+
+        if (end - start > 1) {
+            for (size_t i = start; i < end; i++)
+                m_candidates[kept++] = m_candidates[i];
+        }
+        else {
+            m_droppedBytes += m_candidates[start].size;
+            dropped++;
+        }
+        start = end;
+    }
+
+    m_candidates.resize(kept);
+    m_droppedFiles += dropped;
+    return dropped;
+}
@@ -0,0 +1,78 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file SizeCollisionFilter.h
+* Contains the interface of the filter that finds the files that can have
+* a duplicate before any of them is read.
+*/
+
+#ifndef _SIZE_COLLISION_FILTER_H
+#define _SIZE_COLLISION_FILTER_H
+
+// System includes
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* A file waiting for the filter, with the keys that have to match another
+* file for it to be a possible duplicate.
+*/
+struct DedupCandidate
+{
+    static const size_t HEAD_DIGEST_LENGTH = 16;
+
+    uint64_t size;
+    // Digest of the first bytes of the content; all zero until set.
+    unsigned char head[HEAD_DIGEST_LENGTH];
+    uint64_t fileId;
+};
+
+/**
+* Collects the sizes of files and drops those that cannot have a
+* duplicate: empty files and files whose size, or whose size and head
+* digest, no other file has. Only the files that remain need to be read.
+*/
+class SizeCollisionFilter
+{
+public:
+    SizeCollisionFilter();
+
+    void add(uint64_t fileId, uint64_t size);
+
+    /**
+    * Sorts the files by size, head digest and id and drops every file
+    * without another file of the same size and head digest.
+    *
+    * @returns The number of files dropped.
+    */
+    size_t keepCollisions();
+
+    /**
+    * @returns The remaining files, in the order of the last
+    * keepCollisions().
+    */
+    std::vector<DedupCandidate>& candidates() { return m_candidates; }
+
+    /// Number of files added.
+    uint64_t files() const { return m_files; }
+    /// Number of files dropped and the bytes of their content.
+    uint64_t droppedFiles() const { return m_droppedFiles; }
+    uint64_t droppedBytes() const { return m_droppedBytes; }
+
+private:
+    std::vector<DedupCandidate> m_candidates;
+    uint64_t m_files;
+    uint64_t m_droppedFiles;
+    uint64_t m_droppedBytes;
+};
+
+#endif
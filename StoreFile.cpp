@@ -0,0 +1,56 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file StoreFile.cpp
+* Contains the implementation of the helpers shared by the store files.
+*/
+
+// System includes
+#include <cstdio>
+
+// Module includes
+#include "StoreFile.h"
+
+uint32_t storeChecksum(const std::vector<unsigned char>& data)
+{
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+bool replaceStoreFile(const std::string& target, const std::string& temp,
+    const unsigned char * header, size_t headerLength, const unsigned char * body, size_t bodyLength)
+{
+    FILE * file = fopen(temp.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    bool written = fwrite(header, headerLength, 1, file) == 1 &&
+        (bodyLength == 0 || fwrite(body, bodyLength, 1, file) == 1);
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        ::remove(temp.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows.
+    ::remove(target.c_str());
+#endif
+    if (rename(temp.c_str(), target.c_str()) != 0) {
+        ::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
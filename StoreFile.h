@@ -0,0 +1,95 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file StoreFile.h
+* Contains the helpers shared by the files the module keeps between runs:
+* checkpoints, midstates, Merkle trees, the digest store and the spill
+* files of the duplicate index.
+*/
+
+#ifndef _STORE_FILE_H
+#define _STORE_FILE_H
+
+// System includes
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+
+/**
+* Length of the guard stored with a hash state to tell whether the content
+* it covers has changed: an MD5 of samples of that content.
+*/
+const size_t CONTENT_GUARD_LENGTH = 16;
+
+/**
+* Writes a 32 bit integer as 4 little endian bytes.
+*/
+inline void putUInt32(unsigned char * buf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        buf[i] = (unsigned char) (value >> (8 * i));
+}
+
+/**
+* Reads a 32 bit integer from 4 little endian bytes.
+*/
+inline uint32_t getUInt32(const unsigned char * buf)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--)
+        value = (value << 8) | buf[i];
+    return value;
+}
+
+/**
+* Writes a 64 bit integer as 8 little endian bytes.
+*/
+inline void putUInt64(unsigned char * buf, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        buf[i] = (unsigned char) (value >> (8 * i));
+}
+
+/**
+* Reads a 64 bit integer from 8 little endian bytes.
+*/
+inline uint64_t getUInt64(const unsigned char * buf)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+        value = (value << 8) | buf[i];
+    return value;
+}
+
+/**
+* Calculates the Adler-32 checksum of data, to detect stored states that
+* were damaged on disk.
+*/
+uint32_t storeChecksum(const std::vector<unsigned char>& data);
+
+/**
+* Writes a header and a body to a temporary file and renames it over the
+* target, so a crash while writing leaves the previous file intact.
+*
+* @param target Path of the file to replace.
+* @param temp Path of the temporary file, in the directory of the target.
+* @param header The header bytes.
+* @param headerLength Number of header bytes.
+* @param body The body bytes; may be NULL if bodyLength is 0.
+* @param bodyLength Number of body bytes.
+* @returns false if the file could not be written; the target is then
+* unchanged and the temporary file removed.
+*/
+bool replaceStoreFile(const std::string& target, const std::string& temp,
+    const unsigned char * header, size_t headerLength, const unsigned char * body, size_t bodyLength);
+
+#endif
@@ -0,0 +1,191 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file AllocationTest.cpp
+* Checks that hashing a file makes no heap allocations once the module
+* has hashed a few files, by counting the calls of operator new while
+* files are passed to run().
+*/
+
+// System includes
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+// Framework includes
+#include "TskModuleDev.h"
+#include "Services/TskImgDBSqlite.h"
+
+// Poco includes
+#include "Poco/File.h"
+#include "Poco/Thread.h"
+
+extern "C"
+{
+    TskModule::Status initialize(const char * arguments);
+    TskModule::Status run(TskFile * pFile);
+    TskModule::Status finalize();
+}
+
+namespace
+{
+    const int WARM_UP_FILES = 100;
+    const int COUNTED_FILES = 100;
+
+    // Allocations are counted on the thread that calls run() only; the
+    // main thread is not a Poco thread.
+    bool counting = false;
+    long allocations = 0;
+
+    void * allocate(size_t size)
+    {
+        if (counting && Poco::Thread::current() == NULL)
+            allocations++;
+        void * memory = malloc(size != 0 ? size : 1);
+        if (memory == NULL)
+            throw std::bad_alloc();
+        return memory;
+    }
+
+    /**
+    * A file whose content is held in memory.
+    */
+    class MemoryFile : public TskFile
+    {
+    public:
+        MemoryFile(uint64_t id, const std::string& content) : m_content(content), m_offset(0)
+        {
+            m_id = id;
+            m_fileRecord.fileId = id;
+            m_fileRecord.typeId = TskImgDB::IMGDB_FILES_TYPE_DERIVED;
+            m_fileRecord.size = content.size();
+        }
+
+        bool exists() const { return true; }
+        bool isFileSystem() const { return false; }
+        bool isDirectory() const { return false; }
+        bool isVirtual() const { return false; }
+        std::string getPath() const { return std::string(); }
+        void open() { m_offset = 0; }
+        void close() {}
+        void save() {}
+
+        ssize_t read(char * buf, const size_t count)
+        {
+            // A seek may have moved past the end of the content.
+            if (m_offset >= (TSK_OFF_T) m_content.size())
+                return 0;
+
+            size_t length = m_content.size() - (size_t) m_offset;
+            if (length > count)
+                length = count;
+            memcpy(buf, m_content.data() + m_offset, length);
+            m_offset += length;
+            return (ssize_t) length;
+        }
+
+        TSK_OFF_T tell() const { return m_offset; }
+
+        TSK_OFF_T seek(const TSK_OFF_T off, std::ios::seekdir origin)
+        {
+            if (origin == std::ios::beg)
+                m_offset = off;
+            else if (origin == std::ios::cur)
+                m_offset += off;
+            else
+                m_offset = (TSK_OFF_T) m_content.size() + off;
+            return m_offset;
+        }
+
+    private:
+        std::string m_content;
+        TSK_OFF_T m_offset;
+    };
+
+    /**
+    * Hashes files with the given arguments and returns the number of
+    * allocations made while the files after the warm-up were hashed, or
+    * -1 if a file could not be hashed.
+    */
+    long countAllocations(const char * arguments, std::vector<MemoryFile *>& files)
+    {
+        if (initialize(arguments) != TskModule::OK)
+            return -1;
+
+        bool hashed = true;
+        allocations = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            counting = i >= (size_t) WARM_UP_FILES;
+            if (run(files[i]) != TskModule::OK)
+                hashed = false;
+        }
+        counting = false;
+
+        if (finalize() != TskModule::OK)
+            hashed = false;
+        return hashed ? allocations : -1;
+    }
+}
+
+void * operator new(size_t size) { return allocate(size); }
+void * operator new[](size_t size) { return allocate(size); }
+void operator delete(void * memory) throw() { free(memory); }
+void operator delete[](void * memory) throw() { free(memory); }
+
+int main()
+{
+    Poco::File outDir("AllocationTest.out");
+    outDir.createDirectories();
+
+    Log log;
+    TskServices::Instance().setLog(log);
+    TskImgDBSqlite imgDB(outDir.path().c_str());
+    if (imgDB.initialize() != 0) {
+        fprintf(stderr, "AllocationTest: unable to create the image database\n");
+        return 1;
+    }
+    TskServices::Instance().setImgDB(imgDB);
+
+    // Sizes from a few bytes to a few hundred KiB, so that files take one
+    // or many reads.
+    std::vector<MemoryFile *> files;
+    for (int i = 0; i < WARM_UP_FILES + COUNTED_FILES; i++) {
+        std::string content(1 + (size_t) i * 997 % 300000, (char) ('a' + i % 26));
+        files.push_back(new MemoryFile(i + 1, content));
+    }
+
+    // Hash values are posted in one batch when the module is finalized, so
+    // that allocations of the database do not count.
+    const char * const ARGUMENTS[] = { "MD5 SHA1 DB_BATCH=1000", "MD5 DB_BATCH=1000", "SHA1 DB_BATCH=1000" };
+    int failures = 0;
+    for (size_t a = 0; a < sizeof(ARGUMENTS) / sizeof(ARGUMENTS[0]); a++) {
+        long counted = countAllocations(ARGUMENTS[a], files);
+        if (counted != 0) {
+            if (counted < 0)
+                fprintf(stderr, "FAILED: \"%s\" could not hash the files\n", ARGUMENTS[a]);
+            else
+                fprintf(stderr, "FAILED: \"%s\" made %ld allocations for %d files\n", ARGUMENTS[a], counted, COUNTED_FILES);
+            failures++;
+        }
+    }
+
+    for (size_t i = 0; i < files.size(); i++)
+        delete files[i];
+
+    if (failures > 0) {
+        fprintf(stderr, "AllocationTest: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("AllocationTest: passed\n");
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*
+* The Sleuth Kit
+*
+* Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2011-2012 Basis Technology Corporation. All Rights
+* reserved.
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/** \file DuplicateIndexTest.cpp
+* Checks that the duplicate file index reports the same groups whether or
+* not it spills to temporary files, and that it spills only when the files
+* it holds reach the memory limit, also while it groups spilled files.
+*/
+
+// System includes
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Module includes
+#include "../DuplicateIndex.h"
+
+namespace
+{
+    const uint64_t FILE_COUNT = 300000;
+    const uint32_t DISTINCT_DIGESTS = 100000;
+    const size_t KEY_LENGTH = 20;
+
+    int failures = 0;
+
+    void check(bool condition, const char * what)
+    {
+        if (!condition) {
+            fprintf(stderr, "FAILED: %s\n", what);
+            failures++;
+        }
+    }
+
+    /**
+    * Makes the digest of file i; every DISTINCT_DIGESTS-th file has the
+    * same one.
+    */
+    void makeDigest(uint64_t i, unsigned char * digest)
+    {
+        uint32_t value = (uint32_t) (i * 7919 % DISTINCT_DIGESTS) * 2654435761u;
+        for (size_t b = 0; b < KEY_LENGTH; b++)
+            digest[b] = (unsigned char) ((value >> (b % 4 * 8)) ^ b);
+    }
+
+    /**
+    * Groups FILE_COUNT files with the given memory limit and returns the
+    * lines of the report, sorted since partitions are reported one by one.
+    */
+    std::vector<std::string> groupFiles(size_t memoryLimit, const char * reportPath, DuplicateIndex& index)
+    {
+        std::vector<std::string> lines;
+        if (!index.openReport(reportPath)) {
+            check(false, "the report can be created");
+            return lines;
+        }
+
+        unsigned char digest[KEY_LENGTH];
+        for (uint64_t i = 0; i < FILE_COUNT; i++) {
+            makeDigest(i, digest);
+            index.add(digest, i);
+        }
+        check(index.report(), "the report is written");
+
+        std::ifstream report(reportPath);
+        std::string line;
+        while (std::getline(report, line))
+            lines.push_back(line);
+        report.close();
+        remove(reportPath);
+
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    }
+}
+
+int main()
+{
+    DuplicateIndex inMemory(KEY_LENGTH, 1024 * 1024 * 1024);
+    std::vector<std::string> expected = groupFiles(1024 * 1024 * 1024, "DuplicateIndexTest0.txt", inMemory);
+    check(inMemory.spills() == 0, "a large limit does not spill");
+    check(inMemory.groups() == DISTINCT_DIGESTS, "every digest forms a group");
+    check(inMemory.duplicates() == FILE_COUNT - DISTINCT_DIGESTS, "every file after the first of a group is a copy");
+    check(expected.size() == DISTINCT_DIGESTS, "the report has a line per group");
+
+    // 64 KiB holds about 1600 files of 20 byte digests, so the table is
+    // spilled a couple of hundred times; it must not spill on every add()
+    // once the limit was reached for the first time.
+    const size_t memoryLimit = 64 * 1024;
+    DuplicateIndex spilling(KEY_LENGTH, memoryLimit);
+    std::vector<std::string> spilled = groupFiles(memoryLimit, "DuplicateIndexTest1.txt", spilling);
+    check(spilling.spills() > 0, "a small limit spills");
+    check(spilling.spills() < FILE_COUNT / 1000, "the table is refilled between spills");
+    check(spilling.groups() == inMemory.groups(), "spilling finds the same number of groups");
+    check(spilling.duplicates() == inMemory.duplicates(), "spilling finds the same number of copies");
+    check(spilled == expected, "spilling reports the same groups");
+
+    // A partition holds a sixteenth of the files, over 20 times the limit
+    // here, so partitions are split again rather than loaded whole.
+    check(spilling.splits() > 0, "partitions beyond the limit are split");
+    check(spilling.peakMemory() <= memoryLimit + 2 * KEY_LENGTH + 20, "the table stays within the limit");
+
+    // Files with the ignored digest are counted but never grouped.
+    DuplicateIndex ignoring(KEY_LENGTH, memoryLimit);
+    unsigned char digest[KEY_LENGTH];
+    makeDigest(0, digest);
+    ignoring.ignore(digest);
+    std::vector<std::string> withoutIgnored = groupFiles(memoryLimit, "DuplicateIndexTest2.txt", ignoring);
+    check(ignoring.files() == FILE_COUNT, "ignored files are counted");
+    check(ignoring.groups() == DISTINCT_DIGESTS - 1, "the ignored digest is not grouped");
+    check(withoutIgnored.size() == expected.size() - 1, "the ignored digest is not reported");
+
+    if (failures > 0) {
+        fprintf(stderr, "DuplicateIndexTest: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("DuplicateIndexTest: passed\n");
+    return 0;
+}